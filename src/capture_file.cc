@@ -0,0 +1,377 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "capture_file.hh"
+#include "decimal_format.hh"
+#include <stdexcept>
+#include <algorithm>
+#include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char MAGIC[8] = {'U', 'T', '6', '1', 'B', 'C', 'A', 'P'};
+
+static_assert(sizeof(Capture_Header) == 32, "invalid header size");
+static_assert(sizeof(Capture_Record) == 32, "invalid record size");
+
+
+/**
+ * Lookup table of the CRC-32 calculation
+ */
+struct CRC32_Table
+{
+    uint32_t v[256];
+    
+    CRC32_Table()
+    {
+        for(uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for(int k = 0; k < 8; ++k) {
+                c = (c & 1) ? (0xedb88320 ^ (c >> 1)) : (c >> 1);
+            }
+            v[i] = c;
+        }
+    }
+};
+
+
+/**
+ * Return CRC-32 (IEEE 802.3) of data
+ */
+uint32_t crc32(const unsigned char* data, size_t len)
+{
+    static const CRC32_Table table;
+    uint32_t c = 0xffffffff;
+    for(size_t i = 0; i < len; ++i) {
+        c = table.v[(c ^ data[i]) & 0xff] ^ (c >> 8);
+    }
+    return c ^ 0xffffffff;
+}
+
+
+/**
+ * Return whether checksum matches
+ */
+bool Capture_Record::valid() const
+{
+    return (checksum == crc32((const unsigned char*)this,
+        offsetof(Capture_Record, checksum)));
+}
+
+
+/**
+ * Return whether the record declares an adapter
+ */
+bool Capture_Record::declaration() const
+{
+    return (device & 0x8000) != 0;
+}
+
+
+/**
+ * Return whether the record holds a state
+ */
+bool Capture_Record::state() const
+{
+    return (device & 0xc000) == 0x4000;
+}
+
+
+/**
+ * Return whether the adapter was reconnected
+ */
+bool Capture_Record::connected() const
+{
+    return frame[0] == 1;
+}
+
+
+/**
+ * Set checksum
+ */
+void Capture_Record::seal()
+{
+    checksum = crc32((const unsigned char*)this,
+        offsetof(Capture_Record, checksum));
+}
+
+
+/**
+ * Write header
+ */
+Capture_Writer::Capture_Writer(Log_Writer& out, int64_t start) : out(out)
+{
+    if(start == 0) {
+        timespec t;
+        clock_gettime(CLOCK_REALTIME, &t);
+        start = (int64_t)t.tv_sec*1000000000 + t.tv_nsec;
+    }
+    Capture_Header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.version = 3;
+    h.record_size = sizeof(Capture_Record);
+    h.start_sec = start/1000000000;
+    h.start_nsec = start%1000000000;
+    out.write((const char*)&h, sizeof(h));
+}
+
+
+/**
+ * Fill device records
+ */
+size_t Capture_Writer::declare(Capture_Record* r, uint64_t time,
+    const char* device, uint16_t& index) const
+{
+    index = 0;
+    if(device == 0) {
+        return 0;
+    }
+    while(index < devices.size() && devices[index] != device) {
+        index++;
+    }
+    if(index < devices.size()) {
+        return 0;
+    }
+    size_t n = 0;
+    size_t len = strnlen(device, CAPTURE_DECLARATION_MAX*14);
+    do {
+        memset(&r[n], 0, sizeof(r[n]));
+        r[n].time = time;
+        r[n].device = 0x8000 | index;
+        memcpy(r[n].frame, device + 14*n, std::min(len - 14*n, (size_t)14));
+        r[n].seal();
+        n++;
+    } while(14*n < len);
+    return n;
+}
+
+
+/**
+ * Write record
+ */
+void Capture_Writer::write(uint64_t time, const char* frame,
+    const Reading& reading, const char* device)
+{
+    // the declaration is written in the same buffer as the first frame, so
+    // that the log file either holds both or none
+    Capture_Record r[CAPTURE_DECLARATION_MAX+1];
+    uint16_t index;
+    size_t d = declare(r, time, device, index);
+    size_t n = d;
+    memset(&r[n], 0, sizeof(r[n]));
+    r[n].time = time;
+    r[n].value = reading.value_unscaled;
+    r[n].device = index;
+    memcpy(r[n].frame, frame, 14);
+    r[n].seal();
+    n++;
+    if(out.write((const char*)r, n*sizeof(Capture_Record)) && d != 0) {
+        devices.push_back(device);
+    }
+}
+
+
+/**
+ * Write state record
+ */
+void Capture_Writer::mark(uint64_t time, bool connected, const char* device)
+{
+    Capture_Record r[CAPTURE_DECLARATION_MAX+1];
+    uint16_t index;
+    size_t d = declare(r, time, device, index);
+    size_t n = d;
+    memset(&r[n], 0, sizeof(r[n]));
+    r[n].time = time;
+    r[n].device = 0x4000 | index;
+    r[n].frame[0] = connected ? 1 : 2;
+    r[n].seal();
+    n++;
+    if(out.write((const char*)r, n*sizeof(Capture_Record)) && d != 0) {
+        devices.push_back(device);
+    }
+}
+
+
+/**
+ * Map capture file
+ */
+Capture_Reader::Capture_Reader(const std::string& path) : map(0), map_size(0)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        throw std::runtime_error("Opening capture file " + path + " failed");
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Capture_Header)) {
+        close(fd);
+        throw std::runtime_error("Invalid capture file " + path);
+    }
+    map_size = st.st_size;
+    void* p = mmap(0, map_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED) {
+        throw std::runtime_error("Mapping capture file " + path + " failed");
+    }
+    map = (const char*)p;
+    
+    const Capture_Header& h = header();
+    if(memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0
+        || h.version < 1 || h.version > 3
+        || h.record_size != sizeof(Capture_Record)) {
+        munmap((void*)map, map_size);
+        throw std::runtime_error("Invalid capture file " + path);
+    }
+}
+
+
+/**
+ * Unmap capture file
+ */
+Capture_Reader::~Capture_Reader()
+{
+    munmap((void*)map, map_size);
+}
+
+
+/**
+ * Return file header
+ */
+const Capture_Header& Capture_Reader::header() const
+{
+    return *(const Capture_Header*)map;
+}
+
+
+/**
+ * Return number of complete records
+ */
+size_t Capture_Reader::size() const
+{
+    return (map_size - sizeof(Capture_Header))/sizeof(Capture_Record);
+}
+
+
+/**
+ * Return record
+ */
+const Capture_Record& Capture_Reader::operator[](size_t i) const
+{
+    return ((const Capture_Record*)(map + sizeof(Capture_Header)))[i];
+}
+
+
+/**
+ * Truncate torn records
+ */
+size_t Capture_Reader::recover(const std::string& path)
+{
+    size_t n;
+    {
+        Capture_Reader reader(path);
+        
+        // drop trailing records which were not completely written
+        n = reader.size();
+        while(n > 0 && !reader[n-1].valid()) {
+            n--;
+        }
+    }
+    off_t size = sizeof(Capture_Header) + n*sizeof(Capture_Record);
+    if(truncate(path.c_str(), size) != 0) {
+        throw std::runtime_error("Truncating capture file " + path + " failed");
+    }
+    return n;
+}
+
+
+/**
+ * Write column header of the text log format
+ */
+void capture_text_header(std::ostream& os)
+{
+    os << "# time[s] value_unscaled value prefix unit power min/max hold ";
+    os << "rel auto apo bat diode beep";
+}
+
+
+/**
+ * Append label and space
+ */
+static char* append(char* p, const Label& l)
+{
+    memcpy(p, l.str, l.len);
+    p += l.len;
+    *p++ = ' ';
+    return p;
+}
+
+
+/**
+ * Format frame in the text log format
+ */
+size_t capture_text_format(char* buf, double time, const Reading& r)
+{
+    size_t n = format_fixed(buf, time, 6);
+    buf[n++] = ' ';
+    return n + capture_text_values(buf+n, r);
+}
+
+
+/**
+ * Format columns after the time
+ */
+size_t capture_text_values(char* buf, const Reading& r)
+{
+    char* p = buf;
+    if(r.has(FLAG_OVERFLOW)) {
+        memcpy(p, "inf inf ", 8);
+        p += 8;
+    }
+    else {
+        p += format_decimal(p, r.count, r.exponent);
+        *p++ = ' ';
+        p += format_decimal(p, r.count, r.decimal);
+        *p++ = ' ';
+    }
+    p = append(p, FS9922_DMM3::unit_prefix_label((unit_prefix_t)r.prefix));
+    p = append(p, FS9922_DMM3::unit_label((unit_t)r.unit));
+    p = append(p, FS9922_DMM3::power_label((power_t)r.power));
+    p = append(p, FS9922_DMM3::minmax_label((minmax_t)r.minmax));
+    static const reading_flag_t FLAGS[7] = {FLAG_HOLD, FLAG_RELATIVE,
+        FLAG_AUTORANGE, FLAG_AUTOPOWEROFF, FLAG_LOWBATTERY, FLAG_DIODE,
+        FLAG_BEEP};
+    for(int i = 0; i < 7; ++i) {
+        *p++ = r.has(FLAGS[i]) ? '1' : '0';
+        *p++ = ' ';
+    }
+    *p = 0;
+    return p - buf;
+}
+
+
+/**
+ * Write frame in the text log format
+ */
+void capture_text_line(std::ostream& os, double time, const Reading& r)
+{
+    char buf[CAPTURE_TEXT_MAX];
+    os.write(buf, capture_text_format(buf, time, r));
+}
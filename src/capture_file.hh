@@ -0,0 +1,269 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Binary capture file format
+ * 
+ * -------
+ * Layout:
+ * 
+ * The file starts with a 32 byte header followed by fixed-size 32 byte
+ * records. All values are stored in host byte order.
+ * 
+ * header:
+ *   0  char[8]  magic "UT61BCAP"
+ *   8  uint32   format version (3, version 1 has no device records,
+ *               version 2 no state records)
+ *  12  uint32   record size (32)
+ *  16  int64    wall-clock start time of the capture (s since epoch)
+ *  24  int64    wall-clock start time of the capture (ns part)
+ * 
+ * record:
+ *   0  uint64   monotonic time since start of capture in ns
+ *   8  float    decoded value, see `FS9922_DMM3::value_unscaled()`
+ *  12  char[14] raw FS9922-DMM3 frame
+ *  26  uint16   index of the adapter (0 for a capture of a single adapter)
+ *  28  uint32   CRC-32 of bytes 0-27
+ * 
+ * A capture of several adapters declares each adapter by device records
+ * directly before its first frame. Their index has the bit 0x8000 set and
+ * their frames hold the path of the adapter in pieces of 14 characters, the
+ * last piece null padded. Consecutive device records of the same index are
+ * concatenated.
+ * 
+ * A lost or reconnected adapter is recorded by a state record, whose index
+ * has the bit 0x4000 set and whose first frame byte is 1 (reconnected) or
+ * 2 (lost). A gap of the frames after a lost adapter is thus
+ * distinguishable from a steady reading.
+ */
+#ifndef CAPTURE_FILE_HH
+#define CAPTURE_FILE_HH
+
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <ostream>
+#include "log_writer.hh"
+#include "fs9922_dmm3.hh"
+
+
+// maximum number of device records declaring an adapter
+const size_t CAPTURE_DECLARATION_MAX = 10;
+
+
+/**
+ * File header
+ */
+struct Capture_Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    int64_t start_sec;
+    int64_t start_nsec;
+};
+
+
+/**
+ * Single record of a captured frame
+ */
+struct Capture_Record
+{
+    uint64_t time;
+    float value;
+    char frame[14];
+    uint16_t device;
+    uint32_t checksum;
+    
+    /**
+     * Return whether the record declares an adapter instead of holding a
+     * frame
+     */
+    bool declaration() const;
+    
+    /**
+     * Return whether the record holds a lost or reconnected adapter instead
+     * of a frame
+     */
+    bool state() const;
+    
+    /**
+     * Return whether the state record holds a reconnected adapter
+     */
+    bool connected() const;
+    
+    /**
+     * Return whether the checksum matches the record data
+     */
+    bool valid() const;
+    
+    /**
+     * Calculate and set checksum
+     */
+    void seal();
+};
+
+
+/**
+ * This class writes captured frames in the binary capture format
+ */
+class Capture_Writer
+{
+    public:
+        
+        /**
+         * Write header
+         * \param out log file the capture is written to
+         * \param start wall-clock start time of the capture in ns since
+         *              epoch, to which the times of the records refer
+         *              (0 = now)
+         */
+        Capture_Writer(Log_Writer& out, int64_t start=0);
+        
+        /**
+         * Write record of a single frame
+         * \param time monotonic time since start of capture in ns
+         * \param frame raw frame data
+         * \param r decoded frame
+         * \param device path of the adapter, which is declared together
+         *               with its first frame, or 0 for a capture of a single
+         *               adapter
+         */
+        void write(uint64_t time, const char* frame, const Reading& r,
+            const char* device=0);
+        
+        /**
+         * Write state record of a lost or reconnected adapter
+         * \param time monotonic time since start of capture in ns
+         * \param connected whether the adapter was reconnected or lost
+         * \param device path of the adapter, which is declared if it has no
+         *               frames yet, or 0 for a capture of a single adapter
+         */
+        void mark(uint64_t time, bool connected, const char* device=0);
+        
+    private:
+        
+        /**
+         * Fill device records declaring an adapter, unless it is declared
+         * already
+         * \param r destination of CAPTURE_DECLARATION_MAX records
+         * \param time monotonic time since start of capture in ns
+         * \param device path of the adapter or 0
+         * \param index set to the index of the adapter
+         * \return number of device records
+         */
+        size_t declare(Capture_Record* r, uint64_t time, const char* device,
+            uint16_t& index) const;
+        
+        // log file
+        Log_Writer& out;
+        
+        // paths of the declared adapters
+        std::vector<std::string> devices;
+};
+
+
+/**
+ * This class provides random access to the records of a capture file by
+ * mapping it into memory
+ */
+class Capture_Reader
+{
+    public:
+        
+        /**
+         * Map capture file and check header
+         * \param path path of the capture file
+         */
+        Capture_Reader(const std::string& path);
+        ~Capture_Reader();
+        
+        /**
+         * Return file header
+         */
+        const Capture_Header& header() const;
+        
+        /**
+         * Return number of complete records
+         */
+        size_t size() const;
+        
+        /**
+         * Return record
+         * \param i index of record
+         */
+        const Capture_Record& operator[](size_t i) const;
+        
+        /**
+         * Truncate torn or corrupted records at the end of a capture file,
+         * which are left behind by a crash during writing
+         * \param path path of the capture file
+         * \return number of remaining records
+         */
+        static size_t recover(const std::string& path);
+        
+    private:
+        
+        // mapped file and its size
+        const char* map;
+        size_t map_size;
+};
+
+
+/**
+ * Return CRC-32 (IEEE 802.3) of data
+ */
+uint32_t crc32(const unsigned char* data, size_t len);
+
+/**
+ * Write column header of the text log format
+ */
+void capture_text_header(std::ostream& os);
+
+// maximum length of a line of the text log format including the
+// terminating null
+const size_t CAPTURE_TEXT_MAX = 192;
+
+/**
+ * Format a single frame in the text log format (without line break) into a
+ * buffer. The values are written exactly as displayed by the multimeter.
+ * \param buf destination of at least CAPTURE_TEXT_MAX bytes, null terminated
+ * \param time time since start of capture in s
+ * \param r decoded frame
+ * \return length of the line
+ */
+size_t capture_text_format(char* buf, double time, const Reading& r);
+
+/**
+ * Format the columns after the time of the text log format
+ * \param buf destination of at least CAPTURE_TEXT_MAX bytes, null terminated
+ * \param r decoded frame
+ * \return length of the columns
+ */
+size_t capture_text_values(char* buf, const Reading& r);
+
+/**
+ * Write a single frame in the text log format (without line break)
+ * \param os output stream
+ * \param time time since start of capture in s
+ * \param r decoded frame
+ */
+void capture_text_line(std::ostream& os, double time, const Reading& r);
+
+#endif
@@ -0,0 +1,254 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ch9325_adapter.hh"
+#include <time.h>
+
+
+/**
+ * Create adapter
+ */
+CH9325_Adapter::CH9325_Adapter() : t_frame(0), m_reports(0), m_empty(0),
+    callback(0), callback_arg(0)
+{
+}
+
+
+/**
+ * Destroy adapter
+ */
+CH9325_Adapter::~CH9325_Adapter()
+{
+    if(m_reports != 0) {
+        Metrics_Registry::instance().remove(this);
+    }
+}
+
+
+/**
+ * Return identity
+ */
+const std::string& CH9325_Adapter::path() const
+{
+    return id;
+}
+
+
+/**
+ * Set callback function
+ */
+void CH9325_Adapter::set_callback(void (*callback)(const char* data, void* arg),
+    void* arg)
+{
+    this->callback = callback;
+    this->callback_arg = arg;
+}
+
+
+/**
+ * Return frame synchronizer
+ */
+const Frame_Sync& CH9325_Adapter::synchronizer() const
+{
+    return sync;
+}
+
+
+/**
+ * Return frame timing
+ */
+const Frame_Timing& CH9325_Adapter::timing() const
+{
+    return frame_timing;
+}
+
+
+/**
+ * Return reception time of the current frame
+ */
+uint64_t CH9325_Adapter::frame_time() const
+{
+    return t_frame;
+}
+
+
+/**
+ * Return whether hotplug events are supported
+ */
+bool CH9325_Adapter::hotplug() const
+{
+    return false;
+}
+
+
+/**
+ * Return whether adapter can return
+ */
+bool CH9325_Adapter::recoverable() const
+{
+    return true;
+}
+
+
+/**
+ * Return file descriptor
+ */
+int CH9325_Adapter::fd() const
+{
+    return -1;
+}
+
+
+/**
+ * Handle pending data
+ */
+void CH9325_Adapter::dispatch() { }
+
+
+/**
+ * Pass data of a single data package to the synchronizer
+ */
+void CH9325_Adapter::handle_report(const unsigned char* data,
+    uint64_t time)
+{
+    if(m_reports == 0) {
+        init_metrics();
+    }
+    m_reports->add();
+    
+    // frame contains data --> pass data to synchronizer
+    if(data[0] != 0xf1) {
+        m_empty->add();
+        return;
+    }
+    const char* frame = sync.push(data[1]);
+    if(frame == 0) {
+        return;
+    }
+    t_frame = time;
+    frame_timing.record(time);
+    if(callback != 0) {
+        callback(frame, callback_arg);
+    }
+}
+
+
+/**
+ * Restart data retrieval
+ */
+void CH9325_Adapter::restart()
+{
+    sync.reset();
+    frame_timing.restart();
+}
+
+
+/**
+ * Return monotonic time
+ */
+uint64_t CH9325_Adapter::now()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec*1000000000 + t.tv_nsec;
+}
+
+
+/**
+ * Return number of accepted frames
+ */
+static double frames_accepted(const void* arg)
+{
+    return ((const CH9325_Adapter*)arg)->synchronizer().accepted();
+}
+
+
+/**
+ * Return number of rejected frames
+ */
+static double frames_rejected(const void* arg)
+{
+    return ((const CH9325_Adapter*)arg)->synchronizer().rejected();
+}
+
+
+/**
+ * Return number of skipped bytes
+ */
+static double bytes_skipped(const void* arg)
+{
+    return ((const CH9325_Adapter*)arg)->synchronizer().skipped();
+}
+
+
+/**
+ * Return number of dropped frames
+ */
+static double frames_dropped(const void* arg)
+{
+    return ((const CH9325_Adapter*)arg)->timing().dropped();
+}
+
+
+/**
+ * Return frame rate
+ */
+static double frame_rate(const void* arg)
+{
+    uint64_t t = ((const CH9325_Adapter*)arg)->timing().interval();
+    return (t == 0) ? 0 : 1e9/t;
+}
+
+
+/**
+ * Return jitter in s
+ */
+static double frame_jitter(const void* arg)
+{
+    return ((const CH9325_Adapter*)arg)->timing().jitter()*1e-9;
+}
+
+
+/**
+ * Register metrics
+ */
+void CH9325_Adapter::init_metrics()
+{
+    Metrics_Registry& reg = Metrics_Registry::instance();
+    std::string l = Metrics_Registry::label("device", id);
+    m_reports = &reg.counter("ut61b_reports_total",
+        "Received data packages", l);
+    m_empty = &reg.counter("ut61b_empty_reports_total",
+        "Received data packages without data", l);
+    reg.probe("ut61b_frames_total", "Valid frames", l, METRIC_COUNTER,
+        frames_accepted, this);
+    reg.probe("ut61b_frames_rejected_total",
+        "Frames rejected by the structural validation", l, METRIC_COUNTER,
+        frames_rejected, this);
+    reg.probe("ut61b_bytes_skipped_total",
+        "Bytes skipped while resynchronizing", l, METRIC_COUNTER,
+        bytes_skipped, this);
+    reg.probe("ut61b_frames_dropped_total",
+        "Frames missing in the regular frame interval", l, METRIC_COUNTER,
+        frames_dropped, this);
+    reg.probe("ut61b_frame_rate", "Frames per second", l, METRIC_GAUGE,
+        frame_rate, this);
+    reg.probe("ut61b_frame_jitter_seconds",
+        "Mean deviation from the regular frame interval", l, METRIC_GAUGE,
+        frame_jitter, this);
+}
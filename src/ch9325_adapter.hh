@@ -0,0 +1,177 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Transport abstraction of a serial-to-usb adapter
+ * 
+ * An adapter delivers the 8 byte data packages of the WCH CH9325 protocol (see
+ * wch_ch9325.hh) to the frame assembler of this base class, which extracts
+ * the 14 byte frames of the FS9922-DMM3 serial protocol. Implementations are
+ * the real libusb device (WCH_CH9325), a simulated device (CH9325_Sim) and a
+ * byte stream read from a file descriptor, e.g. a pty (CH9325_Stream).
+ */
+#ifndef CH9325_ADAPTER_HH
+#define CH9325_ADAPTER_HH
+
+#include <string>
+#include <stdint.h>
+#include "frame_sync.hh"
+#include "frame_timing.hh"
+#include "metrics.hh"
+
+
+/**
+ * This class represents the common part of all adapters
+ */
+class CH9325_Adapter
+{
+    public:
+        CH9325_Adapter();
+        virtual ~CH9325_Adapter();
+        
+        /**
+         * Return stable identity of the adapter, e.g. the bus/port path
+         */
+        const std::string& path() const;
+        
+        /**
+         * Set callback function, which is called for each retrieved valid
+         * 14 byte data frame of the FS9922-DMM3 serial protocol
+         * \param callback function called for each retrieved data frame
+         * \param arg additional argument passed to the callback function
+         */
+        void set_callback(void (*callback)(const char*, void*), void* arg=0);
+        
+        /**
+         * Return frame synchronizer, which provides statistics of accepted
+         * and rejected frames and skipped bytes
+         */
+        const Frame_Sync& synchronizer() const;
+        
+        /**
+         * Return intervals, jitter and dropped frames of the retrieved frames
+         */
+        const Frame_Timing& timing() const;
+        
+        /**
+         * Return monotonic time in ns at which the data package completing
+         * the current frame was received, valid within the callback
+         */
+        uint64_t frame_time() const;
+        
+        /**
+         * Start data retrieval without blocking. The data is delivered while
+         * the adapter is serviced by an event loop (see `fd()` and
+         * `dispatch()`).
+         */
+        virtual void start() = 0;
+        
+        /**
+         * Stop data retrieval
+         */
+        virtual void finish() = 0;
+        
+        /**
+         * Return whether data is retrieved. An adapter which stops being
+         * active on its own is considered lost.
+         */
+        virtual bool active() const = 0;
+        
+        /**
+         * Close lost adapter
+         */
+        virtual void close() = 0;
+        
+        /**
+         * Try to reopen lost adapter
+         * \return whether adapter is open again
+         */
+        virtual bool reopen() = 0;
+        
+        /**
+         * Return whether the return of a lost adapter is signalled by hotplug
+         * events. Otherwise, reopening is tried periodically.
+         */
+        virtual bool hotplug() const;
+        
+        /**
+         * Return whether a lost adapter can return at all, which is not the
+         * case e.g. for the end of a regular file
+         */
+        virtual bool recoverable() const;
+        
+        /**
+         * Return file descriptor, which becomes readable when `dispatch()` has
+         * to be called, or -1 if the adapter is serviced by libusb
+         */
+        virtual int fd() const;
+        
+        /**
+         * Handle pending data after `fd()` became readable
+         */
+        virtual void dispatch();
+        
+    protected:
+        
+        /**
+         * Pass data of a single 8 byte data package to the synchronizer and
+         * call callback for each completed frame
+         * \param data data package
+         * \param time monotonic reception time of the data package in ns
+         */
+        void handle_report(const unsigned char* data, uint64_t time);
+        
+        /**
+         * Discard partial frame and forget last frame time when data
+         * retrieval (re)starts
+         */
+        void restart();
+        
+        /**
+         * Return monotonic time in ns
+         */
+        static uint64_t now();
+        
+        /**
+         * Register metrics of the adapter, which are labelled with its path
+         */
+        void init_metrics();
+        
+        // identity of the adapter
+        std::string id;
+        
+        // extracts frames from the received bytes
+        Frame_Sync sync;
+        
+        // intervals between frames
+        Frame_Timing frame_timing;
+        
+        // reception time of the data package completing the current frame
+        uint64_t t_frame;
+        
+        // counters of all and of empty data packages (0 = not registered)
+        Metric_Counter* m_reports;
+        Metric_Counter* m_empty;
+        
+    private:
+        
+        // callback and optional argument
+        void (*callback)(const char*, void*);
+        void* callback_arg;
+};
+#endif
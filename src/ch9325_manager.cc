@@ -0,0 +1,459 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ch9325_manager.hh"
+#include "wch_ch9325.hh"
+#include <iostream>
+#include <stdexcept>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+
+/**
+ * Return monotonic time in ms
+ */
+static int64_t now_ms()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (int64_t)t.tv_sec*1000 + t.tv_nsec/1000000;
+}
+
+
+/**
+ * Create manager without adapters
+ */
+CH9325_Manager::CH9325_Manager() : callback(0), callback_arg(0),
+    state_callback(0), state_callback_arg(0), transfers(4), max_usb(0),
+    usb(false), hotplug(false), do_listen(false)
+{
+    wakeup = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+    if(wakeup < 0) {
+        throw std::runtime_error("Creating eventfd failed");
+    }
+}
+
+
+/**
+ * Close adapters
+ */
+CH9325_Manager::~CH9325_Manager()
+{
+    for(size_t i = 0; i < sources.size(); ++i) {
+        delete sources[i]->dev;
+        delete sources[i];
+    }
+    close(wakeup);
+}
+
+
+/**
+ * Open connected usb adapters
+ */
+size_t CH9325_Manager::open_usb(size_t max)
+{
+    usb = true;
+    max_usb = max;
+    size_t n = 0;
+    std::vector<std::string> paths = WCH_CH9325::list();
+    for(size_t i = 0; i < paths.size(); ++i) {
+        if(max != 0 && n == max) {
+            break;
+        }
+        try {
+            WCH_CH9325* dev = new WCH_CH9325(paths[i]);
+            dev->set_transfers(transfers);
+            add(dev);
+            n++;
+        } catch(std::exception& e) {
+            std::cerr << e.what() << "\n";
+        }
+    }
+    return n;
+}
+
+
+/**
+ * Add adapter
+ */
+void CH9325_Manager::add(CH9325_Adapter* dev)
+{
+    Source* src = new Source;
+    src->mgr = this;
+    src->dev = dev;
+    src->path = dev->path();
+    src->open = true;
+    src->reconnect = 0;
+    src->retry = 0;
+    sources.push_back(src);
+    dev->set_callback(handle_frame, src);
+}
+
+
+/**
+ * Set callback function
+ */
+void CH9325_Manager::set_callback(
+    void (*callback)(const CH9325_Adapter*, const char*, void*), void* arg)
+{
+    this->callback = callback;
+    this->callback_arg = arg;
+}
+
+
+/**
+ * Set state callback function
+ */
+void CH9325_Manager::set_state_callback(
+    void (*callback)(const std::string&, bool, void*), void* arg)
+{
+    this->state_callback = callback;
+    this->state_callback_arg = arg;
+}
+
+
+/**
+ * Set number of queued transfers per usb adapter
+ */
+void CH9325_Manager::set_transfers(int n)
+{
+    transfers = (n < 1) ? 1 : n;
+    for(size_t i = 0; i < sources.size(); ++i) {
+        WCH_CH9325* dev = dynamic_cast<WCH_CH9325*>(sources[i]->dev);
+        if(dev != 0) {
+            dev->set_transfers(transfers);
+        }
+    }
+}
+
+
+/**
+ * Return number of adapters
+ */
+size_t CH9325_Manager::size() const
+{
+    return sources.size();
+}
+
+
+/**
+ * Return adapter
+ */
+CH9325_Adapter* CH9325_Manager::device(size_t i)
+{
+    return sources.at(i)->dev;
+}
+
+
+/**
+ * Listen for data of all adapters
+ */
+void CH9325_Manager::listen()
+{
+    std::vector<pollfd> fds;
+    start();
+    while(true) {
+        fds.clear();
+        pollfds(fds);
+        poll(fds.empty() ? 0 : &fds[0], fds.size(), next_timeout(100));
+        if(!dispatch(fds)) {
+            break;
+        }
+    }
+    finish();
+}
+
+
+/**
+ * Stop listening
+ */
+void CH9325_Manager::stop()
+{
+    do_listen = false;
+    uint64_t one = 1;
+    if(write(wakeup, &one, sizeof(one)) != sizeof(one)) {
+        // counter is already set
+    }
+}
+
+
+/**
+ * Start transfers of all adapters
+ */
+void CH9325_Manager::start()
+{
+    hotplug = usb && WCH_CH9325::set_hotplug_callback(handle_hotplug, this);
+    do_listen = true;
+    for(size_t i = 0; i < sources.size(); ++i) {
+        sources[i]->dev->start();
+    }
+}
+
+
+/**
+ * Append polled file descriptors
+ */
+void CH9325_Manager::pollfds(std::vector<pollfd>& fds)
+{
+    pollfd f;
+    f.fd = wakeup;
+    f.events = POLLIN;
+    f.revents = 0;
+    fds.push_back(f);
+    for(size_t i = 0; i < sources.size(); ++i) {
+        if(sources[i]->open && sources[i]->dev->fd() >= 0) {
+            f.fd = sources[i]->dev->fd();
+            fds.push_back(f);
+        }
+    }
+    if(usb) {
+        WCH_CH9325::pollfds(fds);
+    }
+}
+
+
+/**
+ * Return time until dispatch has to be called
+ */
+int CH9325_Manager::next_timeout(int timeout)
+{
+    int64_t t = now_ms();
+    for(size_t i = 0; i < sources.size(); ++i) {
+        const Source* src = sources[i];
+        if(!src->open && src->reconnect > 0) {
+            int64_t wait = (src->retry > t) ? src->retry - t : 0;
+            if(timeout < 0 || wait < timeout) {
+                timeout = wait;
+            }
+        }
+    }
+    return usb ? WCH_CH9325::next_timeout(timeout) : timeout;
+}
+
+
+/**
+ * Handle events of the polled file descriptors
+ */
+bool CH9325_Manager::dispatch(const std::vector<pollfd>& fds)
+{
+    if(usb) {
+        WCH_CH9325::handle_events(0);
+    }
+    for(size_t i = 0; i < fds.size(); ++i) {
+        if(fds[i].revents == 0) {
+            continue;
+        }
+        if(fds[i].fd == wakeup) {
+            uint64_t cnt;
+            if(read(wakeup, &cnt, sizeof(cnt)) < 0) {
+                // already reset
+            }
+            continue;
+        }
+        for(size_t k = 0; k < sources.size(); ++k) {
+            if(sources[k]->open && sources[k]->dev->fd() == fds[i].fd) {
+                sources[k]->dev->dispatch();
+                break;
+            }
+        }
+    }
+    return check() && do_listen;
+}
+
+
+/**
+ * Stop transfers of all adapters
+ */
+void CH9325_Manager::finish()
+{
+    do_listen = false;
+    for(size_t i = 0; i < sources.size(); ++i) {
+        if(sources[i]->open) {
+            sources[i]->dev->finish();
+        }
+    }
+    if(hotplug) {
+        WCH_CH9325::set_hotplug_callback(0);
+        hotplug = false;
+    }
+}
+
+
+/**
+ * Detect lost adapters and reopen them
+ */
+bool CH9325_Manager::check()
+{
+    bool active = false;
+    bool waiting = false;
+    int64_t t = now_ms();
+    for(size_t i = 0; i < sources.size(); ++i) {
+        Source* src = sources[i];
+        if(src->open && !src->dev->active()) {
+            lost(src);
+            
+            // an adapter, which failed without being unplugged, sends no
+            // arrival event and is retried as long as it is enumerated
+            if(src->dev->hotplug() && enumerated(src->path)) {
+                src->reconnect = 20;
+                src->retry = t + 1000;
+            }
+        }
+        
+        // adapters without hotplug events are retried once per second,
+        // others as long as a hotplug event requests it
+        if(!src->open && src->dev != 0 && !src->dev->hotplug()
+            && src->dev->recoverable()) {
+            waiting = true;
+            if(src->reconnect == 0) {
+                src->reconnect = 1;
+                src->retry = t + 1000;
+            }
+        }
+        if(!src->open && src->reconnect > 0 && t >= src->retry) {
+            src->retry = t + 100;
+            reopen(src);
+        }
+        active |= src->open;
+    }
+    
+    // lost usb adapters are parked until they are connected again
+    return active || hotplug || waiting;
+}
+
+
+/**
+ * Close lost adapter
+ */
+void CH9325_Manager::lost(Source* src)
+{
+    std::cerr << "Device " << src->path << " lost\n";
+    src->dev->finish();
+    src->dev->close();
+    src->open = false;
+    if(state_callback != 0) {
+        state_callback(src->path, false, state_callback_arg);
+    }
+}
+
+
+/**
+ * Return whether a usb adapter is connected
+ */
+bool CH9325_Manager::enumerated(const std::string& path)
+{
+    std::vector<std::string> paths = WCH_CH9325::list();
+    for(size_t i = 0; i < paths.size(); ++i) {
+        if(paths[i] == path) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Try to reopen lost adapter
+ */
+void CH9325_Manager::reopen(Source* src)
+{
+    src->reconnect--;
+    try {
+        if(src->dev == 0) {
+            WCH_CH9325* dev = new WCH_CH9325(src->path);
+            dev->set_transfers(transfers);
+            dev->set_callback(handle_frame, src);
+            src->dev = dev;
+        }
+        else if(!src->dev->reopen()) {
+            // permissions might not be applied yet, retry later
+            return;
+        }
+    } catch(std::exception&) {
+        return;
+    }
+    try {
+        src->dev->start();
+    } catch(std::exception& e) {
+        std::cerr << e.what() << "\n";
+        src->dev->finish();
+        src->dev->close();
+        return;
+    }
+    src->open = true;
+    src->reconnect = 0;
+    std::cerr << "Device " << src->path << " reconnected\n";
+    if(state_callback != 0) {
+        state_callback(src->path, true, state_callback_arg);
+    }
+}
+
+
+/**
+ * Forward frame of a single adapter
+ */
+void CH9325_Manager::handle_frame(const char* frame, void* arg)
+{
+    Source* src = (Source*)arg;
+    if(src->mgr->callback != 0) {
+        src->mgr->callback(src->dev, frame, src->mgr->callback_arg);
+    }
+}
+
+
+/**
+ * Handle hotplug event
+ */
+void CH9325_Manager::handle_hotplug(const std::string& path, bool arrived,
+    void* arg)
+{
+    CH9325_Manager* mgr = (CH9325_Manager*)arg;
+    if(!arrived) {
+        return;
+    }
+    
+    // retry opening for about 2 s
+    size_t n = 0;
+    for(size_t i = 0; i < mgr->sources.size(); ++i) {
+        Source* src = mgr->sources[i];
+        if(src->dev != 0 && !src->dev->hotplug()) {
+            continue;
+        }
+        if(src->path == path) {
+            if(!src->open) {
+                src->reconnect = 20;
+            }
+            return;
+        }
+        n++;
+    }
+    
+    // newly connected adapter, opened on the first attempt
+    if(mgr->max_usb == 0 || n < mgr->max_usb) {
+        Source* src = new Source;
+        src->mgr = mgr;
+        src->dev = 0;
+        src->path = path;
+        src->open = false;
+        src->reconnect = 20;
+        src->retry = 0;
+        mgr->sources.push_back(src);
+    }
+}
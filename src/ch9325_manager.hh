@@ -0,0 +1,249 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Manager for several CH9325 adapters (real, simulated or streams), which are
+ * serviced from a single poll() event loop in one thread, either its own or
+ * the event loop of an application
+ */
+#ifndef CH9325_MANAGER_HH
+#define CH9325_MANAGER_HH
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <stdint.h>
+#include <poll.h>
+#include "ch9325_adapter.hh"
+
+
+/**
+ * This class opens all (or up to a maximum number of) connected usb adapters
+ * and further added adapters and retrieves their data frames in a common event
+ * loop. Lost adapters are closed and reopened as soon as they are connected
+ * again.
+ * 
+ * The event loop is either run by `listen()` or embedded into the event loop
+ * of an application:
+ * 
+ *   mgr.start();
+ *   while(true) {
+ *       fds.clear();
+ *       mgr.pollfds(fds);
+ *       ... append further file descriptors of the application
+ *       poll(&fds[0], fds.size(), mgr.next_timeout(100));
+ *       if(!mgr.dispatch(fds)) break;
+ *   }
+ *   mgr.finish();
+ */
+class CH9325_Manager
+{
+    public:
+        CH9325_Manager();
+        ~CH9325_Manager();
+        
+        /**
+         * Open connected usb adapters
+         * \param max maximum number of adapters to open (0 = all), also
+         *            limits adapters connected later
+         * \return number of opened adapters
+         */
+        size_t open_usb(size_t max=0);
+        
+        /**
+         * Add adapter, which is deleted by the manager
+         * \param dev adapter
+         */
+        void add(CH9325_Adapter* dev);
+        
+        /**
+         * Set callback function, which is called for each retrieved valid
+         * 14 byte data frame of any adapter
+         * \param callback function called for each retrieved data frame with
+         *                 the device the frame originates from
+         * \param arg additional argument passed to the callback function
+         */
+        void set_callback(
+            void (*callback)(const CH9325_Adapter*, const char*, void*),
+            void* arg=0);
+        
+        /**
+         * Set callback function, which is called whenever an adapter is lost
+         * or reconnected
+         * \param callback function called with the path of the adapter and whether it is connected
+         * \param arg additional argument passed to the callback function
+         */
+        void set_state_callback(
+            void (*callback)(const std::string&, bool, void*), void* arg=0);
+        
+        /**
+         * Set number of queued asynchronous transfers per usb adapter
+         * \param n number of queued transfers (at least 1)
+         */
+        void set_transfers(int n);
+        
+        /**
+         * Return number of opened adapters
+         */
+        size_t size() const;
+        
+        /**
+         * Return opened adapter
+         * \param i index of adapter
+         * \return adapter or 0 if a hotplugged adapter was never opened
+         */
+        CH9325_Adapter* device(size_t i);
+        
+        /**
+         * Start transfers of all adapters and retrieve data until stopped.
+         * Listening also stops if no adapter is left and none can return.
+         */
+        void listen();
+        
+        /**
+         * Stop listen. It can be called from any thread and from a signal
+         * handler and wakes up the event loop immediately.
+         */
+        void stop();
+        
+        /**
+         * Start transfers of all adapters without blocking. The adapters are
+         * serviced by an external event loop via `pollfds()`,
+         * `next_timeout()` and `dispatch()`.
+         */
+        void start();
+        
+        /**
+         * Append file descriptors, which have to be polled before calling
+         * `dispatch()`: those of the adapters, of libusb and the wakeup of
+         * `stop()`. The set changes whenever an adapter is lost or reopened,
+         * so it has to be retrieved again after each `dispatch()`.
+         * \param fds list of polled file descriptors
+         */
+        void pollfds(std::vector<pollfd>& fds);
+        
+        /**
+         * Return time until `dispatch()` has to be called at the latest,
+         * e.g. for internal timeouts of libusb or reopening lost adapters
+         * \param timeout maximum time in ms (-1 = infinite)
+         * \return time in ms, at most `timeout`
+         */
+        int next_timeout(int timeout);
+        
+        /**
+         * Handle events of the polled file descriptors, detect lost adapters
+         * and try to reopen them
+         * \param fds polled file descriptors including those of other
+         *            sources of the application, which are ignored
+         * \return false if listening stopped, because `stop()` was called or
+         *         no adapter is left and none can return
+         */
+        bool dispatch(const std::vector<pollfd>& fds);
+        
+        /**
+         * Stop transfers of all adapters
+         */
+        void finish();
+        
+    private:
+        
+        /**
+         * A single adapter together with its manager, which is passed as
+         * argument to the frame callback of the adapter
+         */
+        struct Source
+        {
+            CH9325_Manager* mgr;
+            CH9325_Adapter* dev;
+            
+            // path of the adapter
+            std::string path;
+            
+            // flag whether the adapter is open
+            bool open;
+            
+            // remaining attempts to reopen a lost hotplug adapter
+            int reconnect;
+            
+            // monotonic time of the next attempt to reopen in ms
+            int64_t retry;
+        };
+        
+        /**
+         * Forwards frames of a single adapter to the callback
+         */
+        static void handle_frame(const char* frame, void* arg);
+        
+        /**
+         * Marks lost adapters for reconnection when they arrive again
+         */
+        static void handle_hotplug(const std::string& path, bool arrived,
+            void* arg);
+        
+        /**
+         * Detect lost adapters and reopen them
+         * \return whether an adapter is open or can return
+         */
+        bool check();
+        
+        /**
+         * Close lost adapter
+         */
+        void lost(Source* src);
+        
+        /**
+         * Return whether a usb adapter is connected
+         * \param path bus/port path of the adapter
+         */
+        static bool enumerated(const std::string& path);
+        
+        /**
+         * Try to reopen lost adapter and resume its transfers
+         */
+        void reopen(Source* src);
+        
+        // opened adapters
+        std::vector<Source*> sources;
+        
+        // callback and optional argument
+        void (*callback)(const CH9325_Adapter*, const char*, void*);
+        void* callback_arg;
+        
+        // state callback and optional argument
+        void (*state_callback)(const std::string&, bool, void*);
+        void* state_callback_arg;
+        
+        // number of queued transfers per usb adapter
+        int transfers;
+        
+        // maximum number of usb adapters (0 = all)
+        size_t max_usb;
+        
+        // flag whether usb adapters are managed
+        bool usb;
+        
+        // flag whether arrival of usb adapters is signalled by hotplug events
+        bool hotplug;
+        
+        // flag whether in listen mode, cleared by `stop()` from any thread
+        std::atomic<bool> do_listen;
+        
+        // eventfd, which wakes up the event loop on `stop()`
+        int wakeup;
+};
+#endif
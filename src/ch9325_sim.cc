@@ -0,0 +1,245 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ch9325_sim.hh"
+#include <stdexcept>
+#include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+
+/**
+ * Create simulated adapter
+ */
+CH9325_Sim::CH9325_Sim(const std::string& path, unsigned int seed) :
+    frame_rate(2), report_rate(100), noise(0), disconnect_interval(0),
+    disconnect_duration(2), rng(seed*2654435761ULL+1), count(1234), byte(14),
+    gap(0), t_lost(0), t_return(0), running(false)
+{
+    id = path;
+    tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+    if(tfd < 0) {
+        throw std::runtime_error("Creating timer failed");
+    }
+}
+
+
+/**
+ * Destroy simulated adapter
+ */
+CH9325_Sim::~CH9325_Sim()
+{
+    ::close(tfd);
+}
+
+
+/**
+ * Set rates
+ */
+void CH9325_Sim::set_rate(double frames, double reports)
+{
+    frame_rate = frames;
+    report_rate = (reports < 14*frames) ? 14*frames : reports;
+}
+
+
+/**
+ * Set noise
+ */
+void CH9325_Sim::set_noise(double p)
+{
+    noise = p;
+}
+
+
+/**
+ * Set disconnects
+ */
+void CH9325_Sim::set_disconnects(double interval, double duration)
+{
+    disconnect_interval = interval;
+    disconnect_duration = duration;
+}
+
+
+/**
+ * Start emitting data packages
+ */
+void CH9325_Sim::start()
+{
+    restart();
+    byte = 14;
+    gap = 0;
+    
+    // schedule next disconnect with exponentially distributed interval
+    t_lost = 0;
+    if(disconnect_interval > 0) {
+        t_lost = now()*1e-9 - disconnect_interval*log(1-random());
+    }
+    
+    long long period = (long long)(1e9/report_rate);
+    itimerspec its;
+    its.it_interval.tv_sec = period/1000000000;
+    its.it_interval.tv_nsec = period%1000000000;
+    its.it_value = its.it_interval;
+    timerfd_settime(tfd, 0, &its, 0);
+    running = true;
+}
+
+
+/**
+ * Stop emitting data packages
+ */
+void CH9325_Sim::finish()
+{
+    itimerspec its = {{0, 0}, {0, 0}};
+    timerfd_settime(tfd, 0, &its, 0);
+    running = false;
+}
+
+
+/**
+ * Return whether data packages are emitted
+ */
+bool CH9325_Sim::active() const
+{
+    return running;
+}
+
+
+/**
+ * Close lost adapter
+ */
+void CH9325_Sim::close()
+{
+    finish();
+}
+
+
+/**
+ * Reopen adapter after the disconnect duration
+ */
+bool CH9325_Sim::reopen()
+{
+    return (t_return == 0 || now()*1e-9 >= t_return);
+}
+
+
+/**
+ * Return timer file descriptor
+ */
+int CH9325_Sim::fd() const
+{
+    return tfd;
+}
+
+
+/**
+ * Emit due data packages
+ */
+void CH9325_Sim::dispatch()
+{
+    uint64_t expirations = 0;
+    if(read(tfd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return;
+    }
+    
+    // inject disconnect
+    uint64_t t = now();
+    if(t_lost != 0 && t*1e-9 >= t_lost) {
+        t_return = t*1e-9 + disconnect_duration;
+        finish();
+        return;
+    }
+    
+    // catch up at most one second of missed packages
+    if(expirations > report_rate) {
+        expirations = report_rate;
+    }
+    for(uint64_t i = 0; i < expirations && running; ++i) {
+        emit(t);
+    }
+}
+
+
+/**
+ * Return random number
+ */
+double CH9325_Sim::random()
+{
+    // xorshift64*
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return ((rng*2685821657736338717ULL) >> 11)*(1.0/9007199254740992.0);
+}
+
+
+/**
+ * Generate next frame
+ */
+void CH9325_Sim::next_frame()
+{
+    // random walk of the displayed value
+    count += (int)((random()-0.5)*20);
+    count = (count > 9999) ? 9999 : ((count < -9999) ? -9999 : count);
+    
+    char digits[8];
+    snprintf(digits, sizeof(digits), "%04d", (count < 0) ? -count : count);
+    frame[0] = (count < 0) ? '-' : '+';
+    for(int i = 0; i < 4; ++i) {
+        frame[1+i] = digits[i];
+    }
+    frame[5] = ' ';
+    frame[6] = 0x32;             // 88.88
+    frame[7] = 0x20|0x10|0x01;   // autorange, DC, bargraph
+    frame[8] = 0;
+    frame[9] = 0;
+    frame[10] = (char)0x80;      // volt
+    frame[11] = (char)(((count < 0) ? 0x80 : 0) | ((count < 0) ? -count : count)*40/9999);
+    frame[12] = 0x0d;
+    frame[13] = 0x0a;
+    byte = 0;
+    gap = (int)(report_rate/frame_rate) - 14;
+}
+
+
+/**
+ * Emit next data package
+ */
+void CH9325_Sim::emit(uint64_t time)
+{
+    unsigned char report[8] = {0xf0, 0, 0, 0, 0, 0, 0, 0};
+    if(byte == 14) {
+        if(gap > 0) {
+            gap--;
+        }
+        else {
+            next_frame();
+        }
+    }
+    if(byte < 14) {
+        report[0] = 0xf1;
+        report[1] = frame[byte++];
+        if(noise > 0 && random() < noise) {
+            report[1] = (unsigned char)(random()*256);
+        }
+    }
+    handle_report(report, time);
+}
@@ -0,0 +1,124 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Simulated CH9325 adapter with a connected multimeter, which emits the same
+ * 8 byte data packages as the real device at a configurable rate. Noise and
+ * disconnects can be injected to test the capture stack without hardware.
+ */
+#ifndef CH9325_SIM_HH
+#define CH9325_SIM_HH
+
+#include <stdint.h>
+#include "ch9325_adapter.hh"
+
+
+/**
+ * This class represents a simulated adapter. The data packages are paced by a
+ * timerfd, which is polled by the event loop.
+ */
+class CH9325_Sim : public CH9325_Adapter
+{
+    public:
+        
+        /**
+         * Create simulated adapter
+         * \param path identity of the adapter
+         * \param seed seed of the random number generator
+         */
+        CH9325_Sim(const std::string& path, unsigned int seed=1);
+        ~CH9325_Sim();
+        
+        /**
+         * Set rates
+         * \param frames number of frames per second
+         * \param reports number of data packages per second, the packages
+         *                between two frames are empty
+         */
+        void set_rate(double frames, double reports=100);
+        
+        /**
+         * Set probability that a transmitted byte is corrupted
+         * \param p probability between 0 and 1
+         */
+        void set_noise(double p);
+        
+        /**
+         * Set disconnects
+         * \param interval mean time between two disconnects in s (0 = never)
+         * \param duration time until the adapter returns in s
+         */
+        void set_disconnects(double interval, double duration=2);
+        
+        void start();
+        void finish();
+        bool active() const;
+        void close();
+        bool reopen();
+        int fd() const;
+        void dispatch();
+        
+    private:
+        
+        /**
+         * Return uniformly distributed random number in [0,1)
+         */
+        double random();
+        
+        /**
+         * Generate next frame of a slowly changing DC voltage
+         */
+        void next_frame();
+        
+        /**
+         * Emit next data package
+         * \param time monotonic time of emission in ns
+         */
+        void emit(uint64_t time);
+        
+        // timer file descriptor
+        int tfd;
+        
+        // rates
+        double frame_rate;
+        double report_rate;
+        
+        // noise and disconnects
+        double noise;
+        double disconnect_interval;
+        double disconnect_duration;
+        
+        // state of the random number generator
+        uint64_t rng;
+        
+        // current frame, its displayed count and position of the next byte
+        char frame[14];
+        int count;
+        int byte;
+        
+        // data packages until the next frame starts
+        int gap;
+        
+        // monotonic time of the disconnect and the return in s (0 = none)
+        double t_lost;
+        double t_return;
+        
+        // flag whether data is retrieved
+        bool running;
+};
+#endif
@@ -0,0 +1,167 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ch9325_stream.hh"
+#include <stdexcept>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/stat.h>
+
+
+/**
+ * Open file
+ */
+CH9325_Stream::CH9325_Stream(const std::string& path) : sfd(-1), running(false),
+    regular(false)
+{
+    id = path;
+    if(!open()) {
+        throw std::runtime_error("Opening stream failed");
+    }
+}
+
+
+/**
+ * Close file
+ */
+CH9325_Stream::~CH9325_Stream()
+{
+    close();
+}
+
+
+/**
+ * Start data retrieval
+ */
+void CH9325_Stream::start()
+{
+    restart();
+    running = (sfd >= 0);
+}
+
+
+/**
+ * Stop data retrieval
+ */
+void CH9325_Stream::finish()
+{
+    running = false;
+}
+
+
+/**
+ * Return whether data is retrieved
+ */
+bool CH9325_Stream::active() const
+{
+    return running;
+}
+
+
+/**
+ * Close file
+ */
+void CH9325_Stream::close()
+{
+    running = false;
+    if(sfd >= 0) {
+        ::close(sfd);
+        sfd = -1;
+    }
+}
+
+
+/**
+ * Reopen file
+ */
+bool CH9325_Stream::reopen()
+{
+    close();
+    return open();
+}
+
+
+/**
+ * Return whether file can provide data again
+ */
+bool CH9325_Stream::recoverable() const
+{
+    return !regular;
+}
+
+
+/**
+ * Return file descriptor
+ */
+int CH9325_Stream::fd() const
+{
+    return sfd;
+}
+
+
+/**
+ * Read available bytes
+ */
+void CH9325_Stream::dispatch()
+{
+    unsigned char buf[256];
+    unsigned char report[8] = {0xf1, 0, 0, 0, 0, 0, 0, 0};
+    while(running) {
+        ssize_t n = read(sfd, buf, sizeof(buf));
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if(n <= 0) {
+            // end of file or error
+            running = false;
+            return;
+        }
+        uint64_t t = now();
+        for(ssize_t i = 0; i < n; ++i) {
+            report[1] = buf[i];
+            handle_report(report, t);
+        }
+    }
+}
+
+
+/**
+ * Open file and configure terminal in raw mode
+ */
+bool CH9325_Stream::open()
+{
+    sfd = ::open(id.c_str(), O_RDONLY|O_NONBLOCK|O_NOCTTY|O_CLOEXEC);
+    if(sfd < 0) {
+        return false;
+    }
+    struct stat st;
+    regular = (fstat(sfd, &st) == 0 && S_ISREG(st.st_mode));
+    if(isatty(sfd)) {
+        termios tio;
+        if(tcgetattr(sfd, &tio) == 0) {
+            cfmakeraw(&tio);
+            tcsetattr(sfd, TCSANOW, &tio);
+        }
+    }
+    return true;
+}
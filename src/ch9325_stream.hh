@@ -0,0 +1,71 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Adapter reading the raw serial byte stream of the multimeter from a file,
+ * e.g. a pty, a FIFO or a recorded stream. Each byte is delivered like a
+ * single byte data package of the WCH CH9325.
+ */
+#ifndef CH9325_STREAM_HH
+#define CH9325_STREAM_HH
+
+#include "ch9325_adapter.hh"
+
+
+/**
+ * This class represents a byte stream adapter. The file is opened without
+ * blocking and polled by the event loop.
+ */
+class CH9325_Stream : public CH9325_Adapter
+{
+    public:
+        
+        /**
+         * Open file
+         * \param path path of the file
+         */
+        CH9325_Stream(const std::string& path);
+        ~CH9325_Stream();
+        
+        void start();
+        void finish();
+        bool active() const;
+        void close();
+        bool reopen();
+        bool recoverable() const;
+        int fd() const;
+        void dispatch();
+        
+    private:
+        
+        /**
+         * Open file
+         * \return whether file was opened
+         */
+        bool open();
+        
+        // file descriptor
+        int sfd;
+        
+        // flag whether data is retrieved
+        bool running;
+        
+        // flag whether the file is a regular file, which ends at its end
+        bool regular;
+};
+#endif
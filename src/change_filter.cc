@@ -0,0 +1,137 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "change_filter.hh"
+#include <cmath>
+#include <string.h>
+
+
+/**
+ * Create filter
+ */
+Change_Filter::Change_Filter(change_mode_t mode, double deadband,
+    double heartbeat) : mode(mode), deadband(deadband),
+    heartbeat((uint64_t)(heartbeat*1e9)), n_passed(0), n_suppressed(0)
+{
+}
+
+
+/**
+ * Check whether frame differs
+ */
+bool Change_Filter::changed(const State& s, const char* frame,
+    const Reading& r) const
+{
+    if(mode == CHANGE_RAW) {
+        return memcmp(s.frame, frame, 14) != 0;
+    }
+    const Reading& l = s.reading;
+    if(r.unit != l.unit || r.prefix != l.prefix || r.power != l.power
+        || r.minmax != l.minmax || r.flags != l.flags) {
+        return true;
+    }
+    
+    // overflow readings are equal, if the flags are equal
+    if(std::isinf(r.value) || std::isinf(l.value)) {
+        return false;
+    }
+    double limit = deadband;
+    if(mode == CHANGE_RELATIVE) {
+        limit *= std::fabs(l.value);
+    }
+    return std::fabs(r.value - l.value) > limit;
+}
+
+
+/**
+ * Check whether frame is logged
+ */
+bool Change_Filter::pass(const char* device, const char* frame,
+    const Reading& r, uint64_t time)
+{
+    size_t i = 0;
+    while(i < states.size() && states[i].device != device) {
+        i++;
+    }
+    if(i == states.size()) {
+        states.push_back(State());
+        states[i].device = device;
+    }
+    else if(!changed(states[i], frame, r)
+        && (heartbeat == 0 || time - states[i].time < heartbeat)) {
+        State& s = states[i];
+        s.holding = true;
+        memcpy(s.held, frame, 14);
+        s.t_held = time;
+        n_suppressed++;
+        return false;
+    }
+    State& s = states[i];
+    memcpy(s.frame, frame, 14);
+    s.reading = r;
+    s.time = time;
+    s.holding = false;
+    n_passed++;
+    return true;
+}
+
+
+/**
+ * Retrieve last suppressed frame and forget adapter
+ */
+bool Change_Filter::flush(const char* device, char* frame,
+    uint64_t& time)
+{
+    for(size_t i = 0; i < states.size(); ++i) {
+        if(states[i].device != device) {
+            continue;
+        }
+        bool holding = states[i].holding;
+        if(holding) {
+            memcpy(frame, states[i].held, 14);
+            time = states[i].t_held;
+        }
+        states.erase(states.begin() + i);
+        return holding;
+    }
+    return false;
+}
+
+
+size_t Change_Filter::size() const
+{
+    return states.size();
+}
+
+
+const std::string& Change_Filter::device(size_t i) const
+{
+    return states[i].device;
+}
+
+
+uint64_t Change_Filter::passed() const
+{
+    return n_passed;
+}
+
+
+uint64_t Change_Filter::suppressed() const
+{
+    return n_suppressed;
+}
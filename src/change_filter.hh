@@ -0,0 +1,138 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Change detection in front of the log file
+ */
+#ifndef CHANGE_FILTER_HH
+#define CHANGE_FILTER_HH
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "fs9922_dmm3.hh"
+
+
+enum change_mode_t
+{
+    // log frames, whose raw data differs from the last logged frame
+    CHANGE_RAW = 0,
+    
+    // log readings, whose value differs by more than the deadband from the
+    // last logged value
+    CHANGE_ABSOLUTE = 1,
+    
+    // log readings, whose value differs by more than the deadband times the
+    // last logged value
+    CHANGE_RELATIVE = 2
+};
+
+
+/**
+ * This class decides per adapter, whether a frame is logged. A frame is
+ * logged, if it differs from the last logged frame, if the unit, prefix,
+ * power or flags changed or if the heartbeat interval elapsed. Each logged
+ * value holds until the next logged frame of the adapter. The last
+ * suppressed frame is retrieved via `flush()` to mark the end of a run of
+ * readings, e.g. before a gap or at exit, so that the log stays
+ * reconstructable.
+ */
+class Change_Filter
+{
+    public:
+        
+        /**
+         * Create filter
+         * \param mode comparison of the frames
+         * \param deadband absolute deadband or fraction of the last value
+         * \param heartbeat maximum time between two logged frames in s
+         *                  (0 = none)
+         */
+        Change_Filter(change_mode_t mode, double deadband=0,
+            double heartbeat=60);
+        
+        /**
+         * Check whether frame is logged
+         * \param device path of the adapter
+         * \param frame data frame
+         * \param r decoded reading of the frame
+         * \param time time of the frame in ns
+         */
+        bool pass(const char* device, const char* frame,
+            const Reading& r, uint64_t time);
+        
+        /**
+         * Retrieve the last suppressed frame of an adapter and forget the
+         * adapter, so that its next frame is logged
+         * \param device path of the adapter
+         * \param frame destination of the frame (14 bytes)
+         * \param time destination of the time of the frame
+         * \return false if no frame was suppressed since the last logged one
+         */
+        bool flush(const char* device, char* frame, uint64_t& time);
+        
+        /**
+         * Return number of adapters with state
+         */
+        size_t size() const;
+        
+        /**
+         * Return path of an adapter with state
+         */
+        const std::string& device(size_t i) const;
+        
+        /**
+         * Return number of logged and suppressed frames
+         */
+        uint64_t passed() const;
+        uint64_t suppressed() const;
+        
+    private:
+        
+        /**
+         * State of an adapter
+         */
+        struct State
+        {
+            std::string device;
+            
+            // last logged frame
+            char frame[14];
+            Reading reading;
+            uint64_t time;
+            
+            // last suppressed frame
+            bool holding;
+            char held[14];
+            uint64_t t_held;
+        };
+        
+        /**
+         * Return whether the frame differs from the last logged frame
+         */
+        bool changed(const State& s, const char* frame,
+            const Reading& r) const;
+        
+        change_mode_t mode;
+        double deadband;
+        uint64_t heartbeat;
+        std::vector<State> states;
+        uint64_t n_passed;
+        uint64_t n_suppressed;
+};
+#endif
@@ -0,0 +1,534 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "column_file.hh"
+#include <stdexcept>
+#include <cmath>
+#include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char MAGIC[8] = {'U', 'T', '6', '1', 'B', 'C', 'O', 'L'};
+static const char BLOCK_MAGIC[4] = {'B', 'L', 'K', '1'};
+
+static_assert(sizeof(Column_Block) == 64, "invalid block header size");
+static_assert(sizeof(Column_Index) == 40, "invalid index entry size");
+
+
+/**
+ * Append unsigned LEB128 varint
+ */
+static void put_varint(std::string& s, uint64_t v)
+{
+    while(v >= 0x80) {
+        s += (char)(v | 0x80);
+        v >>= 7;
+    }
+    s += (char)v;
+}
+
+
+/**
+ * Read unsigned LEB128 varint
+ */
+static uint64_t get_varint(const unsigned char*& p, const unsigned char* end)
+{
+    uint64_t v = 0;
+    for(int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char b = *p++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if((b & 0x80) == 0) {
+            return v;
+        }
+    }
+    throw std::runtime_error("Corrupted column");
+}
+
+
+static uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+
+static int64_t unzigzag(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+
+/**
+ * Return signed count of the sign and digits of a frame
+ * \return false if the bytes are no sign followed by 4 digits
+ */
+static bool frame_count(const char* frame, int64_t& v)
+{
+    if(frame[0] != '+' && frame[0] != '-') {
+        return false;
+    }
+    int64_t count = 0;
+    for(int i = 1; i < 5; ++i) {
+        unsigned int digit = (unsigned char)frame[i] - '0';
+        if(digit > 9) {
+            return false;
+        }
+        count = count*10 + digit;
+    }
+    v = (frame[0] == '-') ? -count-1 : count;
+    return true;
+}
+
+
+/**
+ * Set sign and digits of a frame from the signed count
+ */
+static void count_frame(int64_t v, char* frame)
+{
+    frame[0] = (v < 0) ? '-' : '+';
+    int64_t count = (v < 0) ? -v-1 : v;
+    if(count > 9999) {
+        throw std::runtime_error("Corrupted column");
+    }
+    for(int i = 4; i > 0; --i) {
+        frame[i] = '0' + count%10;
+        count /= 10;
+    }
+}
+
+
+/**
+ * Copy mode bytes of a frame
+ */
+static void frame_mode(const char* frame, char* mode)
+{
+    memcpy(mode, frame+5, 6);
+    mode[6] = frame[12];
+    mode[7] = frame[13];
+}
+
+
+size_t Column_Block::payload() const
+{
+    return (size_t)size[0] + size[1] + size[2] + size[3];
+}
+
+
+/**
+ * Write header
+ */
+Column_Writer::Column_Writer(Log_Writer& out, size_t records, double span,
+    int64_t start) : out(out), index(0), records(records),
+    span((uint64_t)(span*1e9)), start(start), written(sizeof(Capture_Header))
+{
+    if(start == 0) {
+        timespec t;
+        clock_gettime(CLOCK_REALTIME, &t);
+        this->start = (int64_t)t.tv_sec*1000000000 + t.tv_nsec;
+    }
+    Capture_Header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.version = 2;
+    h.record_size = records;
+    h.start_sec = this->start/1000000000;
+    h.start_nsec = this->start%1000000000;
+    out.write((const char*)&h, sizeof(h));
+    memset(&block, 0, sizeof(block));
+}
+
+
+/**
+ * Write last block
+ */
+Column_Writer::~Column_Writer()
+{
+    flush();
+}
+
+
+/**
+ * Add record
+ */
+void Column_Writer::write(uint64_t time, const char* frame, const Reading& r)
+{
+    if(block.count > 0 && (block.count >= records
+        || time - block.t_first >= span)) {
+        flush();
+    }
+    
+    // time
+    if(block.count == 0) {
+        block.t_first = time;
+        block.min = NAN;
+        block.max = NAN;
+        d_prev = 0;
+        v_prev = 0;
+        bar_run = 0;
+        mode_run = 0;
+    }
+    else {
+        int64_t d = (int64_t)(time - t_prev);
+        put_varint(cols[0], zigzag(d - d_prev));
+        d_prev = d;
+    }
+    t_prev = time;
+    block.t_last = time;
+    
+    // value
+    int64_t v;
+    if(frame_count(frame, v)) {
+        put_varint(cols[1], zigzag(v - v_prev) << 1);
+        v_prev = v;
+    }
+    else {
+        put_varint(cols[1], 1);
+        cols[1].append(frame, 5);
+    }
+    if(!std::isinf(r.value_unscaled)) {
+        if(!(r.value_unscaled >= block.min)) {
+            block.min = r.value_unscaled;
+        }
+        if(!(r.value_unscaled <= block.max)) {
+            block.max = r.value_unscaled;
+        }
+    }
+    
+    // bargraph and mode
+    if(bar_run > 0 && frame[11] != bar) {
+        put_varint(cols[2], bar_run);
+        cols[2] += bar;
+        bar_run = 0;
+    }
+    bar = frame[11];
+    bar_run++;
+    char m[8];
+    frame_mode(frame, m);
+    if(mode_run > 0 && memcmp(m, mode, 8) != 0) {
+        put_varint(cols[3], mode_run);
+        cols[3].append(mode, 8);
+        mode_run = 0;
+    }
+    memcpy(mode, m, 8);
+    mode_run++;
+    
+    block.count++;
+}
+
+
+/**
+ * Write block and marker block
+ */
+void Column_Writer::mark(uint64_t time, bool connected)
+{
+    flush();
+    block.state = connected ? COLUMN_RECONNECTED : COLUMN_LOST;
+    block.t_first = time;
+    block.t_last = time;
+    block.min = NAN;
+    block.max = NAN;
+    bar_run = 0;
+    mode_run = 0;
+    flush();
+}
+
+
+/**
+ * Write block after its time span
+ */
+void Column_Writer::expire(uint64_t time)
+{
+    if(block.count > 0 && time >= block.t_first + span) {
+        flush();
+    }
+}
+
+
+/**
+ * Close pending runs
+ */
+void Column_Writer::end_runs()
+{
+    if(bar_run > 0) {
+        put_varint(cols[2], bar_run);
+        cols[2] += bar;
+        bar_run = 0;
+    }
+    if(mode_run > 0) {
+        put_varint(cols[3], mode_run);
+        cols[3].append(mode, 8);
+        mode_run = 0;
+    }
+}
+
+
+/**
+ * Write block
+ */
+void Column_Writer::flush()
+{
+    if(block.count == 0 && block.state == 0) {
+        return;
+    }
+    end_runs();
+    memcpy(block.magic, BLOCK_MAGIC, sizeof(BLOCK_MAGIC));
+    buf.clear();
+    for(int i = 0; i < 4; ++i) {
+        block.size[i] = cols[i].size();
+        buf += cols[i];
+        cols[i].clear();
+    }
+    block.checksum = crc32((const unsigned char*)buf.data(), buf.size());
+    block.header_checksum = crc32((const unsigned char*)&block,
+        offsetof(Column_Block, header_checksum));
+    buf.insert(0, (const char*)&block, sizeof(block));
+    if(!out.write(buf)) {
+        // the block is lost, the index refers to the written blocks only
+        memset(&block, 0, sizeof(block));
+        return;
+    }
+    if(index != 0) {
+        Column_Index e;
+        e.t_first = start + block.t_first;
+        e.t_last = start + block.t_last;
+        e.offset = written;
+        e.size = buf.size();
+        e.count = block.count;
+        e.min = block.min;
+        e.max = block.max;
+        index->write((const char*)&e, sizeof(e));
+    }
+    written += buf.size();
+    memset(&block, 0, sizeof(block));
+}
+
+
+/**
+ * Set index file
+ */
+void Column_Writer::set_index(Log_Writer* index)
+{
+    this->index = index;
+}
+
+
+/**
+ * Return number of written bytes
+ */
+uint64_t Column_Writer::size() const
+{
+    return written;
+}
+
+
+/**
+ * Map file and locate blocks
+ */
+Column_Reader::Column_Reader(const std::string& path) : map(0), map_size(0)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        throw std::runtime_error("Opening capture file " + path + " failed");
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Capture_Header)) {
+        close(fd);
+        throw std::runtime_error("Invalid capture file " + path);
+    }
+    map_size = st.st_size;
+    void* p = mmap(0, map_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED) {
+        throw std::runtime_error("Mapping capture file " + path + " failed");
+    }
+    map = (const char*)p;
+    
+    const Capture_Header& h = header();
+    if(memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0
+        || (h.version != 1 && h.version != 2)) {
+        munmap((void*)map, map_size);
+        throw std::runtime_error("Invalid capture file " + path);
+    }
+    
+    // headers are verified here, columns when they are decoded
+    size_t pos = sizeof(Capture_Header);
+    while(pos + sizeof(Column_Block) <= map_size) {
+        const Column_Block& b = *(const Column_Block*)(map + pos);
+        if(memcmp(b.magic, BLOCK_MAGIC, sizeof(BLOCK_MAGIC)) != 0
+            || b.header_checksum != crc32((const unsigned char*)&b,
+            offsetof(Column_Block, header_checksum))
+            || pos + sizeof(b) + b.payload() > map_size) {
+            break;
+        }
+        offsets.push_back(pos);
+        pos += sizeof(b) + b.payload();
+    }
+}
+
+
+/**
+ * Unmap file
+ */
+Column_Reader::~Column_Reader()
+{
+    munmap((void*)map, map_size);
+}
+
+
+/**
+ * Check magic
+ */
+bool Column_Reader::probe(const std::string& path)
+{
+    char magic[8];
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        return false;
+    }
+    bool r = (read(fd, magic, sizeof(magic)) == sizeof(magic)
+        && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0);
+    close(fd);
+    return r;
+}
+
+
+/**
+ * Return file header
+ */
+const Capture_Header& Column_Reader::header() const
+{
+    return *(const Capture_Header*)map;
+}
+
+
+/**
+ * Return number of blocks
+ */
+size_t Column_Reader::size() const
+{
+    return offsets.size();
+}
+
+
+/**
+ * Return block header
+ */
+const Column_Block& Column_Reader::block(size_t i) const
+{
+    return *(const Column_Block*)(map + offsets[i]);
+}
+
+
+/**
+ * Decode records of a block
+ */
+void Column_Reader::decode(size_t i, std::vector<Column_Row>& rows) const
+{
+    const Column_Block& b = block(i);
+    decode((const char*)&b, map_size - offsets[i], rows);
+}
+
+
+/**
+ * Decode records of a block in memory
+ */
+void Column_Reader::decode(const char* data, size_t size,
+    std::vector<Column_Row>& rows)
+{
+    const Column_Block& b = *(const Column_Block*)data;
+    if(size < sizeof(b) || memcmp(b.magic, BLOCK_MAGIC, sizeof(BLOCK_MAGIC))
+        != 0 || size - sizeof(b) < b.payload()) {
+        throw std::runtime_error("Corrupted block");
+    }
+    const unsigned char* p = (const unsigned char*)data + sizeof(b);
+    if(crc32(p, b.payload()) != b.checksum) {
+        throw std::runtime_error("Corrupted block");
+    }
+    const unsigned char* col[4];
+    const unsigned char* end[4];
+    for(int k = 0; k < 4; ++k) {
+        col[k] = p;
+        p += b.size[k];
+        end[k] = p;
+    }
+    
+    size_t first = rows.size();
+    if(b.state != 0) {
+        Column_Row row;
+        memset(&row, 0, sizeof(row));
+        row.time = b.t_first;
+        row.state = b.state;
+        rows.push_back(row);
+        return;
+    }
+    rows.resize(first + b.count);
+    uint64_t t = b.t_first;
+    int64_t d = 0;
+    int64_t v = 0;
+    uint64_t bar_run = 0;
+    uint64_t mode_run = 0;
+    char bar = 0;
+    char mode[8] = {0};
+    for(uint32_t n = 0; n < b.count; ++n) {
+        Column_Row& row = rows[first+n];
+        row.state = 0;
+        if(n > 0) {
+            d += unzigzag(get_varint(col[0], end[0]));
+            t += d;
+        }
+        row.time = t;
+        
+        uint64_t x = get_varint(col[1], end[1]);
+        if(x & 1) {
+            if(end[1] - col[1] < 5) {
+                throw std::runtime_error("Corrupted column");
+            }
+            memcpy(row.frame, col[1], 5);
+            col[1] += 5;
+        }
+        else {
+            v += unzigzag(x >> 1);
+            count_frame(v, row.frame);
+        }
+        
+        if(bar_run == 0) {
+            bar_run = get_varint(col[2], end[2]);
+            if(col[2] == end[2] || bar_run == 0) {
+                throw std::runtime_error("Corrupted column");
+            }
+            bar = *col[2]++;
+        }
+        row.frame[11] = bar;
+        bar_run--;
+        
+        if(mode_run == 0) {
+            mode_run = get_varint(col[3], end[3]);
+            if(end[3] - col[3] < 8 || mode_run == 0) {
+                throw std::runtime_error("Corrupted column");
+            }
+            memcpy(mode, col[3], 8);
+            col[3] += 8;
+        }
+        memcpy(row.frame+5, mode, 6);
+        row.frame[12] = mode[6];
+        row.frame[13] = mode[7];
+        mode_run--;
+    }
+}
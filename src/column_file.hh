@@ -0,0 +1,306 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Compressed columnar capture file format
+ * 
+ * -------
+ * Layout:
+ * 
+ * The file starts with the header of the binary capture format (see
+ * capture_file.hh) with the magic "UT61BCOL" and the maximum number of
+ * records per block as record size. It is followed by blocks, each
+ * consisting of a 64 byte block header and the columns of its records.
+ * Blocks are decoded independently of each other. All values are stored in
+ * host byte order.
+ * 
+ * block header:
+ *   0  char[4]   magic "BLK1"
+ *   4  uint32    number of records
+ *   8  uint64    monotonic time of the first record since start in ns
+ *  16  uint64    monotonic time of the last record since start in ns
+ *  24  float     minimum unscaled value (NAN if all readings overflow)
+ *  28  float     maximum unscaled value
+ *  32  uint32[4] size of the time, value, bargraph and mode column
+ *  48  uint32    CRC-32 of the columns
+ *  52  uint32    state of a marker block (0 = block of records)
+ *  56  uint32    reserved (0)
+ *  60  uint32    CRC-32 of bytes 0-59
+ * 
+ * columns (varint = LEB128, zigzag = signed mapped to unsigned):
+ *   time      zigzag varint delta-of-delta of the times from the second
+ *             record on (the delta before the first record is 0)
+ *   value     the sign and 4 digits of the frame (bytes 0-4) as zigzag
+ *             varint of the difference of the signed count to the previous
+ *             one shifted left by 1, where "-0000" counts as -1, "-0001" as
+ *             -2 and so on; other bytes (overflow) as varint 1 followed by
+ *             the 5 raw bytes
+ *   bargraph  runs of varint length and frame byte 11
+ *   mode      runs of varint length and frame bytes 5-10, 12 and 13
+ *             (decimal point, status bytes and line end)
+ * 
+ * The raw frames are restored exactly, so that a steady reading costs about
+ * 2 bytes per record.
+ * 
+ * A lost or reconnected adapter ends the current block and is recorded by a
+ * marker block without records and columns, whose state is
+ * COLUMN_RECONNECTED or COLUMN_LOST and whose first and last time are the
+ * time of the event. A gap of the records after a lost adapter is thus
+ * distinguishable from a steady reading. Marker blocks are added in version
+ * 2 of the file header.
+ * 
+ * A sparse index of the blocks can be written to a separate file, which
+ * consists of 40 byte entries, one per block:
+ *   0  int64     wall-clock time of the first record in ns since epoch
+ *   8  int64     wall-clock time of the last record in ns since epoch
+ *  16  uint64    offset of the block in the capture file
+ *  24  uint32    size of the block including its header
+ *  28  uint32    number of records
+ *  32  float     minimum unscaled value
+ *  36  float     maximum unscaled value
+ */
+#ifndef COLUMN_FILE_HH
+#define COLUMN_FILE_HH
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "capture_file.hh"
+
+
+// states of a marker block
+const uint32_t COLUMN_RECONNECTED = 1;
+const uint32_t COLUMN_LOST = 2;
+
+
+/**
+ * Block header
+ */
+struct Column_Block
+{
+    char magic[4];
+    uint32_t count;
+    uint64_t t_first;
+    uint64_t t_last;
+    float min;
+    float max;
+    uint32_t size[4];
+    uint32_t checksum;
+    uint32_t state;
+    uint32_t reserved;
+    uint32_t header_checksum;
+    
+    /**
+     * Return total size of the columns
+     */
+    size_t payload() const;
+};
+
+
+/**
+ * Entry of the sparse block index
+ */
+struct Column_Index
+{
+    int64_t t_first;
+    int64_t t_last;
+    uint64_t offset;
+    uint32_t size;
+    uint32_t count;
+    float min;
+    float max;
+};
+
+
+/**
+ * Decoded record
+ */
+struct Column_Row
+{
+    // monotonic time since start of capture in ns
+    uint64_t time;
+    
+    // raw frame
+    char frame[14];
+    
+    // state of a marker block (0 = record of a frame)
+    uint32_t state;
+};
+
+
+/**
+ * This class writes captured frames in the compressed columnar format. The
+ * records are collected in memory and written block-wise.
+ */
+class Column_Writer
+{
+    public:
+        
+        /**
+         * Write header
+         * \param out log file the capture is written to
+         * \param records maximum number of records per block
+         * \param span maximum time span of a block in s, bounds the data
+         *             lost on a crash
+         * \param start wall-clock start time of the capture in ns since
+         *              epoch (0 = now)
+         */
+        Column_Writer(Log_Writer& out, size_t records=4096, double span=600,
+            int64_t start=0);
+        
+        /**
+         * Write last block
+         */
+        ~Column_Writer();
+        
+        /**
+         * Add record of a single frame
+         * \param time monotonic time since start of capture in ns
+         * \param frame raw frame data
+         * \param r decoded frame
+         */
+        void write(uint64_t time, const char* frame, const Reading& r);
+        
+        /**
+         * Write collected records as block followed by a marker block of a
+         * lost or reconnected adapter
+         * \param time monotonic time since start of capture in ns
+         * \param connected whether the adapter was reconnected or lost
+         */
+        void mark(uint64_t time, bool connected);
+        
+        /**
+         * Write collected records as block, if the maximum time span of the
+         * block has passed, so that a block is not held in memory while no
+         * frames arrive
+         * \param time current monotonic time since start of capture in ns
+         */
+        void expire(uint64_t time);
+        
+        /**
+         * Write collected records as block
+         */
+        void flush();
+        
+        /**
+         * Write an index entry for each block
+         * \param index index file (0 = none)
+         */
+        void set_index(Log_Writer* index);
+        
+        /**
+         * Return number of bytes written, without the collected records
+         */
+        uint64_t size() const;
+        
+    private:
+        
+        /**
+         * Close pending runs of the run-length encoded columns
+         */
+        void end_runs();
+        
+        Log_Writer& out;
+        Log_Writer* index;
+        size_t records;
+        uint64_t span;
+        int64_t start;
+        uint64_t written;
+        
+        // header and columns of the current block
+        Column_Block block;
+        std::string cols[4];
+        
+        // state of the encoders
+        uint64_t t_prev;
+        int64_t d_prev;
+        int64_t v_prev;
+        char bar;
+        uint64_t bar_run;
+        char mode[8];
+        uint64_t mode_run;
+        
+        // buffer of a complete block
+        std::string buf;
+};
+
+
+/**
+ * This class reads a compressed columnar capture file by mapping it into
+ * memory. Blocks are located by their headers, a torn block at the end of
+ * the file is ignored.
+ */
+class Column_Reader
+{
+    public:
+        
+        /**
+         * Map file and locate blocks
+         * \param path path of the file
+         */
+        Column_Reader(const std::string& path);
+        ~Column_Reader();
+        
+        /**
+         * Return whether the file is a compressed columnar capture file
+         */
+        static bool probe(const std::string& path);
+        
+        /**
+         * Return file header
+         */
+        const Capture_Header& header() const;
+        
+        /**
+         * Return number of blocks
+         */
+        size_t size() const;
+        
+        /**
+         * Return block header, e.g. to skip blocks outside a time range
+         * \param i index of block
+         */
+        const Column_Block& block(size_t i) const;
+        
+        /**
+         * Decode records of a block, a marker block yields a single row
+         * holding its state
+         * \param i index of block
+         * \param rows vector the records are appended to
+         */
+        void decode(size_t i, std::vector<Column_Row>& rows) const;
+        
+        /**
+         * Decode records of a block, e.g. located via the index
+         * \param data block header followed by the columns
+         * \param size size of the data
+         * \param rows vector the records are appended to
+         */
+        static void decode(const char* data, size_t size,
+            std::vector<Column_Row>& rows);
+        
+    private:
+        
+        // mapped file and its size
+        const char* map;
+        size_t map_size;
+        
+        // offsets of the blocks
+        std::vector<size_t> offsets;
+};
+#endif
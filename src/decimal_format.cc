@@ -0,0 +1,89 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "decimal_format.hh"
+#include <math.h>
+#include <string.h>
+
+
+/**
+ * Write count*10^exponent
+ */
+size_t format_decimal(char* buf, int64_t count, int exponent)
+{
+    if(exponent < -18) {
+        exponent = -18;
+    }
+    else if(exponent > 18) {
+        exponent = 18;
+    }
+    char* p = buf;
+    uint64_t v = (uint64_t)count;
+    if(count < 0) {
+        *p++ = '-';
+        v = -v;
+    }
+    
+    // digits in reverse order, at least one before the decimal point
+    char digits[24];
+    int n = 0;
+    do {
+        digits[n++] = '0' + v%10;
+        v /= 10;
+    } while(v != 0);
+    int decimals = (exponent < 0) ? -exponent : 0;
+    while(n <= decimals) {
+        digits[n++] = '0';
+    }
+    while(n > decimals) {
+        *p++ = digits[--n];
+    }
+    if(decimals > 0) {
+        *p++ = '.';
+        while(n > 0) {
+            *p++ = digits[--n];
+        }
+    }
+    for(int i = 0; i < exponent && count != 0; ++i) {
+        *p++ = '0';
+    }
+    *p = 0;
+    return p - buf;
+}
+
+
+/**
+ * Write number with fixed decimals
+ */
+size_t format_fixed(char* buf, double v, int decimals)
+{
+    static const double SCALE[10] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+        1e8, 1e9};
+    if(decimals < 0) {
+        decimals = 0;
+    }
+    else if(decimals > 9) {
+        decimals = 9;
+    }
+    if(!isfinite(v)) {
+        const char* s = isnan(v) ? "nan" : ((v < 0) ? "-inf" : "inf");
+        strcpy(buf, s);
+        return strlen(s);
+    }
+    return format_decimal(buf, llround(v*SCALE[decimals]), -decimals);
+}
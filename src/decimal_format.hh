@@ -0,0 +1,52 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Exact formatting of decimal fixed-point numbers into a caller buffer
+ * without locale, iostream or heap allocations
+ */
+#ifndef DECIMAL_FORMAT_HH
+#define DECIMAL_FORMAT_HH
+
+#include <stddef.h>
+#include <stdint.h>
+
+// maximum length of a formatted number including the terminating null
+const size_t DECIMAL_MAX = 48;
+
+
+/**
+ * Write count*10^exponent with all digits of count, e.g. 1230 and -2 as
+ * "12.30", -5 and -3 as "-0.005" and 12 and 3 as "12000"
+ * \param buf destination of at least DECIMAL_MAX bytes, null terminated
+ * \param count signed digits
+ * \param exponent decimal exponent (-18 to 18)
+ * \return length of the number
+ */
+size_t format_decimal(char* buf, int64_t count, int exponent);
+
+/**
+ * Write floating point number with a fixed number of decimals, rounded to
+ * the nearest, e.g. a time of 1.5 with 6 decimals as "1.500000"
+ * \param buf destination of at least DECIMAL_MAX bytes, null terminated
+ * \param v number (absolute value below 9e12 for 6 decimals)
+ * \param decimals number of decimals (0 to 9)
+ * \return length of the number
+ */
+size_t format_fixed(char* buf, double v, int decimals);
+#endif
@@ -0,0 +1,356 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "encoder.hh"
+#include "capture_file.hh"
+#include "decimal_format.hh"
+#include <stdexcept>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+
+// flags and their names in the text, CSV and JSON formats
+static const reading_flag_t FLAGS[9] = {FLAG_OVERFLOW, FLAG_HOLD,
+    FLAG_RELATIVE, FLAG_BARGRAPH, FLAG_AUTORANGE, FLAG_AUTOPOWEROFF,
+    FLAG_LOWBATTERY, FLAG_DIODE, FLAG_BEEP};
+static const char* FLAG_NAMES[9] = {"OVERFLOW", "HOLD", "REL", "BAR", "AUTO",
+    "APO", "BAT", "DIODE", "BEEP"};
+
+// maximum number of bytes of the device copied into an encoded reading
+static const size_t DEVICE_MAX = 128;
+
+
+/**
+ * Append string
+ */
+static char* append(char* p, const char* s, size_t len)
+{
+    memcpy(p, s, len);
+    return p + len;
+}
+
+
+/**
+ * Append label
+ */
+static char* append(char* p, const Label& l)
+{
+    return append(p, l.str, l.len);
+}
+
+
+/**
+ * Append time in ns as s with the given decimals
+ */
+static char* append_time(char* p, int64_t time, int decimals)
+{
+    static const int64_t DIV[10] = {1000000000, 100000000, 10000000,
+        1000000, 100000, 10000, 1000, 100, 10, 1};
+    int64_t d = DIV[decimals];
+    return p + format_decimal(p, (time + d/2)/d, -decimals);
+}
+
+
+/**
+ * Append comment line of a lost or reconnected adapter
+ */
+static size_t append_state_comment(char* buf, const char* device,
+    int64_t time, bool connected)
+{
+    char* p = append(buf, "# ", 2);
+    p = append_time(p, time, 6);
+    p = append(p, " device ", 8);
+    p = append(p, device, strnlen(device, DEVICE_MAX));
+    p = connected ? append(p, " reconnected\n", 13) : append(p, " lost\n", 6);
+    return p - buf;
+}
+
+
+/**
+ * Append device as JSON string with escaped quotes, backslashes and control
+ * characters
+ */
+static char* append_json_device(char* p, const char* device)
+{
+    *p++ = '"';
+    size_t n = strnlen(device, DEVICE_MAX);
+    for(size_t i = 0; i < n; ++i) {
+        unsigned char c = device[i];
+        if(c == '"' || c == '\\') {
+            *p++ = '\\';
+            *p++ = c;
+        }
+        else if(c < 0x20) {
+            p += snprintf(p, 7, "\\u%04x", c);
+        }
+        else {
+            *p++ = c;
+        }
+    }
+    *p++ = '"';
+    return p;
+}
+
+
+Encoder::~Encoder()
+{
+}
+
+
+size_t Encoder::header(char*) const
+{
+    return 0;
+}
+
+
+size_t Encoder::state(char*, const char*, int64_t, bool) const
+{
+    return 0;
+}
+
+
+/**
+ * Create encoder
+ */
+Encoder* Encoder::create(const std::string& format, bool device)
+{
+    if(format == "text") {
+        return new Text_Encoder(device);
+    }
+    if(format == "csv") {
+        return new Csv_Encoder();
+    }
+    if(format == "json") {
+        return new Json_Encoder();
+    }
+    throw std::runtime_error("Unknown output format " + format);
+}
+
+
+Text_Encoder::Text_Encoder(bool device) : device(device)
+{
+}
+
+
+/**
+ * Write column names
+ */
+size_t Text_Encoder::header(char* buf) const
+{
+    static const char H[] = "# time[s] value_unscaled value prefix unit "
+        "power min/max hold rel auto apo bat diode beep";
+    char* p = append(buf, H, sizeof(H)-1);
+    if(device) {
+        p = append(p, " device", 7);
+    }
+    *p++ = '\n';
+    return p - buf;
+}
+
+
+/**
+ * Write line
+ */
+size_t Text_Encoder::encode(char* buf, const char* device,
+    int64_t time, const char*, const Reading& r) const
+{
+    char* p = append_time(buf, time, 6);
+    *p++ = ' ';
+    p += capture_text_values(p, r);
+    if(this->device) {
+        p = append(p, device, strnlen(device, DEVICE_MAX));
+        *p++ = ' ';
+    }
+    *p++ = '\n';
+    return p - buf;
+}
+
+
+/**
+ * Write comment line, the preceding blank line interrupts the plotted line
+ * in gnuplot
+ */
+size_t Text_Encoder::state(char* buf, const char* device, int64_t time,
+    bool connected) const
+{
+    buf[0] = '\n';
+    return 1 + append_state_comment(buf + 1, device, time, connected);
+}
+
+
+/**
+ * Write column names
+ */
+size_t Csv_Encoder::header(char* buf) const
+{
+    static const char H[] = "time,device,value_unscaled,value,prefix,unit,"
+        "power,minmax,hold,rel,auto,apo,bat,diode,beep\n";
+    append(buf, H, sizeof(H)-1);
+    return sizeof(H)-1;
+}
+
+
+/**
+ * Write row
+ */
+size_t Csv_Encoder::encode(char* buf, const char* device,
+    int64_t time, const char*, const Reading& r) const
+{
+    char* p = append_time(buf, time, 6);
+    
+    // device quoted with doubled quotes
+    *p++ = ',';
+    *p++ = '"';
+    size_t n = strnlen(device, DEVICE_MAX);
+    for(size_t i = 0; i < n; ++i) {
+        if(device[i] == '"') {
+            *p++ = '"';
+        }
+        *p++ = device[i];
+    }
+    *p++ = '"';
+    *p++ = ',';
+    if(r.has(FLAG_OVERFLOW)) {
+        p = append(p, "inf,inf,", 8);
+    }
+    else {
+        p += format_decimal(p, r.count, r.exponent);
+        *p++ = ',';
+        p += format_decimal(p, r.count, r.decimal);
+        *p++ = ',';
+    }
+    p = append(p, FS9922_DMM3::unit_prefix_label((unit_prefix_t)r.prefix));
+    *p++ = ',';
+    p = append(p, FS9922_DMM3::unit_label((unit_t)r.unit));
+    *p++ = ',';
+    p = append(p, FS9922_DMM3::power_label((power_t)r.power));
+    *p++ = ',';
+    p = append(p, FS9922_DMM3::minmax_label((minmax_t)r.minmax));
+    static const reading_flag_t COLUMNS[7] = {FLAG_HOLD, FLAG_RELATIVE,
+        FLAG_AUTORANGE, FLAG_AUTOPOWEROFF, FLAG_LOWBATTERY, FLAG_DIODE,
+        FLAG_BEEP};
+    for(int i = 0; i < 7; ++i) {
+        *p++ = ',';
+        *p++ = r.has(COLUMNS[i]) ? '1' : '0';
+    }
+    *p++ = '\n';
+    return p - buf;
+}
+
+
+/**
+ * Write comment row, which CSV readers skip with a comment character of '#'
+ */
+size_t Csv_Encoder::state(char* buf, const char* device, int64_t time,
+    bool connected) const
+{
+    return append_state_comment(buf, device, time, connected);
+}
+
+
+/**
+ * Write object
+ */
+size_t Json_Encoder::encode(char* buf, const char* device,
+    int64_t time, const char*, const Reading& r) const
+{
+    char* p = append(buf, "{\"device\":", 10);
+    p = append_json_device(p, device);
+    p = append(p, ",\"time\":", 8);
+    p = append_time(p, time, 9);
+    if(r.has(FLAG_OVERFLOW)) {
+        p = append(p, ",\"value\":null,\"value_unscaled\":null", 35);
+    }
+    else {
+        p = append(p, ",\"value\":", 9);
+        p += format_decimal(p, r.count, r.decimal);
+        p = append(p, ",\"value_unscaled\":", 18);
+        p += format_decimal(p, r.count, r.exponent);
+    }
+    p = append(p, ",\"prefix\":\"", 11);
+    p = append(p, FS9922_DMM3::unit_prefix_label((unit_prefix_t)r.prefix));
+    p = append(p, "\",\"unit\":\"", 10);
+    p = append(p, FS9922_DMM3::unit_label((unit_t)r.unit));
+    p = append(p, "\",\"power\":\"", 11);
+    p = append(p, FS9922_DMM3::power_label((power_t)r.power));
+    p = append(p, "\",\"minmax\":\"", 12);
+    p = append(p, FS9922_DMM3::minmax_label((minmax_t)r.minmax));
+    p = append(p, "\",\"flags\":[", 11);
+    const char* sep = "\"";
+    for(int i = 0; i < 9; ++i) {
+        if(r.has(FLAGS[i])) {
+            p = append(p, sep, strlen(sep));
+            p = append(p, FLAG_NAMES[i], strlen(FLAG_NAMES[i]));
+            *p++ = '"';
+            sep = ",\"";
+        }
+    }
+    p = append(p, "]}\n", 3);
+    return p - buf;
+}
+
+
+/**
+ * Write event object of a lost or reconnected adapter
+ */
+size_t Json_Encoder::state(char* buf, const char* device, int64_t time,
+    bool connected) const
+{
+    char* p = append(buf, "{\"device\":", 10);
+    p = append_json_device(p, device);
+    p = append(p, ",\"time\":", 8);
+    p = append_time(p, time, 9);
+    static const char R[] = ",\"event\":\"reconnected\"}\n";
+    static const char L[] = ",\"event\":\"lost\"}\n";
+    p = connected ? append(p, R, sizeof(R)-1) : append(p, L, sizeof(L)-1);
+    return p - buf;
+}
+
+
+/**
+ * Write record
+ */
+size_t Binary_Encoder::encode(char* buf, const char* device,
+    int64_t time, const char* frame, const Reading& r) const
+{
+    Shm_Record rec;
+    record(rec, device, time, frame, r);
+    memcpy(buf, &rec, sizeof(rec));
+    return sizeof(rec);
+}
+
+
+/**
+ * Fill record
+ */
+void Binary_Encoder::record(Shm_Record& rec, const char* device,
+    int64_t time, const char* frame, const Reading& r)
+{
+    memset(&rec, 0, sizeof(rec));
+    rec.time = time;
+    rec.value = r.value;
+    rec.value_unscaled = r.value_unscaled;
+    rec.unit = r.unit;
+    rec.prefix = r.prefix;
+    rec.flags = r.flags;
+    rec.power = r.power;
+    rec.minmax = r.minmax;
+    memcpy(rec.frame, frame, 14);
+    strncpy(rec.device, device, sizeof(rec.device)-1);
+}
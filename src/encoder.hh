@@ -0,0 +1,156 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Output encoders of readings
+ * 
+ * The encoders write into a caller buffer and use static label tables, so
+ * that encoding a reading does not allocate memory.
+ */
+#ifndef ENCODER_HH
+#define ENCODER_HH
+
+#include <string>
+#include <stdint.h>
+#include <stddef.h>
+#include "fs9922_dmm3.hh"
+#include "shm_ring.hh"
+
+// minimum size of the buffer of `Encoder::header()` and `Encoder::encode()`
+const size_t ENCODER_MAX = 2048;
+
+
+/**
+ * Interface of an output format
+ */
+class Encoder
+{
+    public:
+        virtual ~Encoder();
+        
+        /**
+         * Write header of the output, e.g. the column names
+         * \param buf destination of at least ENCODER_MAX bytes
+         * \return length of the header (0 = none)
+         */
+        virtual size_t header(char* buf) const;
+        
+        /**
+         * Write a single reading including its line break
+         * \param buf destination of at least ENCODER_MAX bytes
+         * \param device null terminated path of the adapter
+         * \param time time in ns
+         * \param frame raw frame
+         * \param r decoded frame
+         * \return length of the encoded reading
+         */
+        virtual size_t encode(char* buf, const char* device,
+            int64_t time, const char* frame, const Reading& r) const = 0;
+        
+        /**
+         * Write a lost or reconnected adapter, so that a gap of the readings
+         * is distinguishable from a steady reading
+         * \param buf destination of at least ENCODER_MAX bytes
+         * \param device null terminated path of the adapter
+         * \param time time in ns
+         * \param connected whether the adapter was reconnected or lost
+         * \return length of the encoded event (0 = none)
+         */
+        virtual size_t state(char* buf, const char* device, int64_t time,
+            bool connected) const;
+        
+        /**
+         * Create encoder
+         * \param format "text", "csv" or "json"
+         * \param device whether the text format contains the device
+         */
+        static Encoder* create(const std::string& format, bool device=true);
+};
+
+
+/**
+ * Space separated text log format (see capture_file.hh)
+ */
+class Text_Encoder : public Encoder
+{
+    public:
+        
+        /**
+         * \param device whether the device is appended to each line
+         */
+        Text_Encoder(bool device);
+        size_t header(char* buf) const;
+        size_t encode(char* buf, const char* device, int64_t time,
+            const char* frame, const Reading& r) const;
+        size_t state(char* buf, const char* device, int64_t time,
+            bool connected) const;
+        
+    private:
+        bool device;
+};
+
+
+/**
+ * Comma separated values with a header row (RFC 4180)
+ */
+class Csv_Encoder : public Encoder
+{
+    public:
+        size_t header(char* buf) const;
+        size_t encode(char* buf, const char* device, int64_t time,
+            const char* frame, const Reading& r) const;
+        size_t state(char* buf, const char* device, int64_t time,
+            bool connected) const;
+};
+
+
+/**
+ * One JSON object per line, overflow values are null
+ */
+class Json_Encoder : public Encoder
+{
+    public:
+        size_t encode(char* buf, const char* device, int64_t time,
+            const char* frame, const Reading& r) const;
+        size_t state(char* buf, const char* device, int64_t time,
+            bool connected) const;
+};
+
+
+/**
+ * Binary records of the shared memory ring (see Shm_Record in shm_ring.hh),
+ * which are sent to subscribers. Log files use the capture format instead.
+ */
+class Binary_Encoder : public Encoder
+{
+    public:
+        size_t encode(char* buf, const char* device, int64_t time,
+            const char* frame, const Reading& r) const;
+        
+        /**
+         * Fill record of a single frame
+         * \param rec record
+         * \param device null terminated path of the adapter
+         * \param time wall-clock time in ns since epoch
+         * \param frame raw frame data
+         * \param r decoded frame
+         */
+        static void record(Shm_Record& rec, const char* device, int64_t time,
+            const char* frame, const Reading& r);
+};
+#endif
@@ -0,0 +1,94 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "frame_sync.hh"
+#include "fs9922_dmm3.hh"
+
+
+/**
+ * Create synchronizer
+ */
+Frame_Sync::Frame_Sync() : pos(0), fill(0), accepted_cnt(0), rejected_cnt(0),
+    skipped_cnt(0) { }
+
+
+/**
+ * Process byte
+ */
+const char* Frame_Sync::push(char c)
+{
+    // oldest byte leaves the window
+    if(fill == 14) {
+        skipped_cnt.fetch_add(1, std::memory_order_relaxed);
+    }
+    else {
+        fill++;
+    }
+    buf[pos] = c;
+    buf[pos+14] = c;
+    pos = (pos == 13) ? 0 : pos+1;
+    
+    const char* frame = buf+pos;
+    if(fill < 14 || frame[12] != 0x0d || frame[13] != 0x0a) {
+        return 0;
+    }
+    if(!FS9922_DMM3::valid(frame)) {
+        rejected_cnt.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
+    accepted_cnt.fetch_add(1, std::memory_order_relaxed);
+    fill = 0;
+    return frame;
+}
+
+
+/**
+ * Discard buffered bytes
+ */
+void Frame_Sync::reset()
+{
+    skipped_cnt.fetch_add(fill, std::memory_order_relaxed);
+    fill = 0;
+}
+
+
+/**
+ * Return number of accepted frames
+ */
+uint64_t Frame_Sync::accepted() const
+{
+    return accepted_cnt.load(std::memory_order_relaxed);
+}
+
+
+/**
+ * Return number of rejected frames
+ */
+uint64_t Frame_Sync::rejected() const
+{
+    return rejected_cnt.load(std::memory_order_relaxed);
+}
+
+
+/**
+ * Return number of skipped bytes
+ */
+uint64_t Frame_Sync::skipped() const
+{
+    return skipped_cnt.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,87 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Streaming synchronizer, which extracts valid 14 byte FS9922-DMM3 frames from
+ * a byte stream
+ */
+#ifndef FRAME_SYNC_HH
+#define FRAME_SYNC_HH
+
+#include <stdint.h>
+#include <atomic>
+
+
+/**
+ * This class keeps the last 14 received bytes in a window. Whenever the window
+ * ends with CR/LF, it is checked with `FS9922_DMM3::valid()`. A valid frame is
+ * returned and the window is emptied, otherwise the window slides on by one
+ * byte. Each byte is processed in constant time.
+ */
+class Frame_Sync
+{
+    public:
+        Frame_Sync();
+        
+        /**
+         * Process a single byte
+         * \param c received byte
+         * \return pointer to the completed valid frame, which stays valid
+         *         until the next call, or 0
+         */
+        const char* push(char c);
+        
+        /**
+         * Discard buffered bytes, e.g. after the stream was interrupted
+         */
+        void reset();
+        
+        /**
+         * Return number of accepted frames
+         */
+        uint64_t accepted() const;
+        
+        /**
+         * Return number of rejected frames, which ended with CR/LF but
+         * failed validation
+         */
+        uint64_t rejected() const;
+        
+        /**
+         * Return number of bytes, which were skipped while synchronizing
+         */
+        uint64_t skipped() const;
+        
+    private:
+        
+        // window of the last 14 bytes, each byte is stored twice at index i
+        // and i+14, so that the window always starts contiguous at `pos`
+        char buf[28];
+        
+        // index of the oldest byte
+        int pos;
+        
+        // number of bytes in the window
+        int fill;
+        
+        // statistics, which can be read from other threads
+        std::atomic<uint64_t> accepted_cnt;
+        std::atomic<uint64_t> rejected_cnt;
+        std::atomic<uint64_t> skipped_cnt;
+};
+#endif
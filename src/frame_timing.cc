@@ -0,0 +1,116 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include "frame_timing.hh"
+
+
+/**
+ * Create timing without frames
+ */
+Frame_Timing::Frame_Timing() : last(0), count(0), pos(0), expected(0),
+    deviation(0), drops(0)
+{
+}
+
+
+/**
+ * Record frame
+ */
+void Frame_Timing::record(uint64_t time)
+{
+    if(last == 0 || time < last) {
+        last = time;
+        return;
+    }
+    uint64_t d = time - last;
+    last = time;
+    hist.record(d);
+    
+    uint64_t e = expected.load(std::memory_order_relaxed);
+    if(e != 0) {
+        if(2*d > 3*e) {
+            // gap of missing frames, which does not change the jitter
+            drops.fetch_add((d + e/2)/e - 1, std::memory_order_relaxed);
+        }
+        else {
+            // moving average with weight 1/16 like the RTP interarrival
+            // jitter
+            int64_t dev = (d > e) ? d - e : e - d;
+            int64_t j = deviation.load(std::memory_order_relaxed);
+            deviation.store(j + (dev - j)/16, std::memory_order_relaxed);
+        }
+    }
+    
+    // median of the recent intervals, which follows a lasting change of the
+    // interval in either direction but ignores isolated gaps and bursts
+    window[pos] = d;
+    pos = (pos + 1) % TIMING_WINDOW;
+    if(count < TIMING_WINDOW) {
+        count++;
+    }
+    uint64_t sorted[TIMING_WINDOW];
+    std::copy(window, window + count, sorted);
+    std::nth_element(sorted, sorted + count/2, sorted + count);
+    expected.store(sorted[count/2], std::memory_order_relaxed);
+}
+
+
+/**
+ * Forget last frame
+ */
+void Frame_Timing::restart()
+{
+    last = 0;
+}
+
+
+/**
+ * Return interval histogram
+ */
+const Latency_Histogram& Frame_Timing::intervals() const
+{
+    return hist;
+}
+
+
+/**
+ * Return regular interval
+ */
+uint64_t Frame_Timing::interval() const
+{
+    return expected.load(std::memory_order_relaxed);
+}
+
+
+/**
+ * Return jitter
+ */
+uint64_t Frame_Timing::jitter() const
+{
+    return deviation.load(std::memory_order_relaxed);
+}
+
+
+/**
+ * Return number of dropped frames
+ */
+uint64_t Frame_Timing::dropped() const
+{
+    return drops.load(std::memory_order_relaxed);
+}
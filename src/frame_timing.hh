@@ -0,0 +1,100 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Tracking of the intervals between the frames of a single adapter
+ */
+#ifndef FRAME_TIMING_HH
+#define FRAME_TIMING_HH
+
+#include <atomic>
+#include <stdint.h>
+#include "latency_histogram.hh"
+
+// number of recent intervals to estimate the regular interval from
+static const unsigned int TIMING_WINDOW = 15;
+
+
+/**
+ * This class records the intervals between consecutive frames, estimates the
+ * regular interval of the multimeter and its jitter and counts dropped frames.
+ * An interval of more than 1.5 times the regular interval is considered a gap
+ * of dropped frames. The regular interval is the median of the last intervals
+ * including gaps, so that a wrong estimate recovers once most of the recent
+ * intervals disagree with it. The statistics can be queried from any thread.
+ */
+class Frame_Timing
+{
+    public:
+        Frame_Timing();
+        
+        /**
+         * Record reception of a frame
+         * \param time monotonic reception time in ns
+         */
+        void record(uint64_t time);
+        
+        /**
+         * Forget the last frame, e.g. after reconnecting, so that the
+         * interruption is not counted as dropped frames
+         */
+        void restart();
+        
+        /**
+         * Return histogram of the intervals
+         */
+        const Latency_Histogram& intervals() const;
+        
+        /**
+         * Return estimated regular interval in ns
+         */
+        uint64_t interval() const;
+        
+        /**
+         * Return mean deviation of the intervals from the regular interval
+         * in ns
+         */
+        uint64_t jitter() const;
+        
+        /**
+         * Return number of dropped frames
+         */
+        uint64_t dropped() const;
+        
+    private:
+        
+        // reception time of the last frame (0 = none)
+        uint64_t last;
+        
+        // histogram of the intervals
+        Latency_Histogram hist;
+        
+        // ring of the recent intervals in ns
+        uint64_t window[TIMING_WINDOW];
+        unsigned int count;
+        unsigned int pos;
+        
+        // median of the recent intervals and exponential moving average of
+        // the jitter in ns
+        std::atomic<uint64_t> expected;
+        std::atomic<uint64_t> deviation;
+        
+        // number of dropped frames
+        std::atomic<uint64_t> drops;
+};
+#endif
@@ -0,0 +1,370 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fs9922_batch.hh"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FS9922_BATCH_X86
+#include <immintrin.h>
+#endif
+
+
+/**
+ * Decode frames
+ */
+size_t FS9922_Batch::decode(const char* frames, size_t n,
+    const Reading_Columns& out, batch_kernel_t kernel)
+{
+    if(kernel == KERNEL_AUTO || !supported(kernel)) {
+        kernel = best_kernel();
+    }
+    switch(kernel) {
+        case KERNEL_AVX2:
+            return decode_avx2(frames, n, out);
+        case KERNEL_SSSE3:
+            return decode_ssse3(frames, n, out);
+        default:
+            return decode_scalar(frames, 0, n, out);
+    }
+}
+
+
+/**
+ * Return fastest supported kernel
+ */
+batch_kernel_t FS9922_Batch::best_kernel()
+{
+    if(supported(KERNEL_AVX2)) {
+        return KERNEL_AVX2;
+    }
+    if(supported(KERNEL_SSSE3)) {
+        return KERNEL_SSSE3;
+    }
+    return KERNEL_SCALAR;
+}
+
+
+/**
+ * Return whether kernel is supported
+ */
+bool FS9922_Batch::supported(batch_kernel_t kernel)
+{
+    switch(kernel) {
+        case KERNEL_SCALAR:
+            return true;
+#ifdef FS9922_BATCH_X86
+        case KERNEL_SSSE3:
+            return __builtin_cpu_supports("ssse3");
+        case KERNEL_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+
+/**
+ * Return name of kernel
+ */
+const char* FS9922_Batch::kernel2str(batch_kernel_t kernel)
+{
+    switch(kernel) {
+        case KERNEL_SCALAR:
+            return "scalar";
+        case KERNEL_SSSE3:
+            return "ssse3";
+        case KERNEL_AVX2:
+            return "avx2";
+        default:
+            return "auto";
+    }
+}
+
+
+/**
+ * Write valid frame
+ */
+inline void FS9922_Batch::store(const Reading_Columns& out, size_t i,
+    int count, uint16_t flags, const uint8_t* d)
+{
+    if(out.value != 0) {
+        out.value[i] = (flags & FLAG_OVERFLOW) ? INFINITY
+            : (float)(count*FS9922_DMM3::POW10[FS9922_DMM3::DECIMAL[d[6] & 0x7]+12]);
+    }
+    if(out.unit != 0) {
+        out.unit[i] = (d[9] & 0x2) ? (uint16_t)UNIT_DUTY : d[10];
+    }
+    if(out.prefix != 0) {
+        out.prefix[i] = (d[8] & 0x2) ? (uint16_t)PREFIX_NANO
+            : FS9922_DMM3::PREFIX[d[9] >> 4];
+    }
+    if(out.flags != 0) {
+        out.flags[i] = flags;
+    }
+    if(out.reject != 0) {
+        out.reject[i] = 0;
+    }
+}
+
+
+/**
+ * Write rejected frame
+ */
+inline void FS9922_Batch::reject(const Reading_Columns& out, size_t i)
+{
+    if(out.value != 0) {
+        out.value[i] = NAN;
+    }
+    if(out.unit != 0) {
+        out.unit[i] = 0;
+    }
+    if(out.prefix != 0) {
+        out.prefix[i] = 0;
+    }
+    if(out.flags != 0) {
+        out.flags[i] = 0;
+    }
+    if(out.reject != 0) {
+        out.reject[i] = 1;
+    }
+}
+
+
+/**
+ * Decode frames with the scalar kernel
+ */
+size_t FS9922_Batch::decode_scalar(const char* frames, size_t first,
+    size_t n, const Reading_Columns& out)
+{
+    size_t rejected = 0;
+    Reading r;
+    for(size_t i = first; i < n; ++i) {
+        const char* data = frames + 14*i;
+        if(!FS9922_DMM3::valid(data)) {
+            reject(out, i);
+            rejected++;
+            continue;
+        }
+        FS9922_DMM3::decode(data, r);
+        store(out, i, r.count, r.flags, (const uint8_t*)data);
+    }
+    return rejected;
+}
+
+
+#ifdef FS9922_BATCH_X86
+
+// Vector constants of the SIMD kernels in the order of _mm_set_epi8(), i.e.
+// starting with byte 15. Each frame is loaded as 16 bytes, the last two bytes
+// belong to the next frame and are ignored.
+
+// bytes compared for equality: sign, space, decimal position and CR/LF; a
+// byte is valid if it matches in any of the vectors
+#define EXPECT_A 0, 0, 0x0a, 0x0d, 0, 0, 0, 0, 0, 0x30, 0x20, 0, 0, 0, 0, '+'
+#define EXPECT_B 0, 0, 0x0a, 0x0d, 0, 0, 0, 0, 0, 0x31, 0x20, 0, 0, 0, 0, '-'
+#define EXPECT_C 0, 0, 0x0a, 0x0d, 0, 0, 0, 0, 0, 0x32, 0x20, 0, 0, 0, 0, '+'
+#define EXPECT_D 0, 0, 0x0a, 0x0d, 0, 0, 0, 0, 0, 0x34, 0x20, 0, 0, 0, 0, '-'
+#define EXPECT_MASK ((1 << 0) | (1 << 5) | (1 << 6) | (1 << 12) | (1 << 13))
+
+// reserved bits of bytes 7, 8 and 9
+#define RESERVED 0, 0, 0, 0, 0, 0, 0x01, (char)0xc1, (char)0xc0, 0, 0, 0, 0, 0, 0, 0
+
+// gathers digits 1-4 and weights for combining them (WEIGHTS_B in the order
+// of _mm_set_epi16())
+#define DIGITS -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 4, 3, 2, 1
+#define WEIGHTS_A 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 10, 1, 10
+#define WEIGHTS_B 0, 0, 0, 0, 0, 0, 1, 100
+
+// gathers the flag bytes in the bit order of reading_flag_t, the flags are set
+// if all bits of FLAG_BITS are set after xoring with FLAG_XOR; byte 1 maps to
+// FLAG_OVERFLOW if it equals "?"
+#define FLAG_BYTES -1, -1, -1, -1, -1, -1, -1, 9, 9, 8, 8, 7, 7, 7, 7, 1
+#define FLAG_BITS 1, 1, 1, 1, 1, 1, 1, 0x08, 0x04, 0x04, 0x08, 0x20, 0x01, 0x04, \
+    0x02, (char)0xff
+#define FLAG_XOR 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, (char)('?' ^ 0xff)
+
+
+/**
+ * Check and decode a single frame loaded into a vector
+ * \return whether frame is valid
+ */
+__attribute__((target("ssse3")))
+static inline bool decode_vector(__m128i v, int& count, uint16_t& flags)
+{
+    const __m128i ascii0 = _mm_set1_epi8('0');
+    
+    // sign, space, decimal position and CR/LF
+    __m128i eq = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set_epi8(EXPECT_A)),
+            _mm_cmpeq_epi8(v, _mm_set_epi8(EXPECT_B))),
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set_epi8(EXPECT_C)),
+            _mm_cmpeq_epi8(v, _mm_set_epi8(EXPECT_D))));
+    
+    // reserved flag bits
+    __m128i res = _mm_cmpeq_epi8(_mm_and_si128(v, _mm_set_epi8(RESERVED)),
+        _mm_setzero_si128());
+    
+    // digits 0-9, or 0-? after an overflow marker
+    __m128i d = _mm_sub_epi8(v, ascii0);
+    __m128i digit = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+    __m128i wide = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(15)), d);
+    
+    // flags
+    __m128i f = _mm_xor_si128(_mm_shuffle_epi8(v, _mm_set_epi8(FLAG_BYTES)),
+        _mm_set_epi8(FLAG_XOR));
+    __m128i bits = _mm_set_epi8(FLAG_BITS);
+    flags = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(f, bits), bits))
+        & 0x1ff;
+    
+    int m_eq = _mm_movemask_epi8(eq);
+    int m_res = _mm_movemask_epi8(res);
+    int m_digit = (flags & FLAG_OVERFLOW) ? (_mm_movemask_epi8(wide) | 0x2)
+        : _mm_movemask_epi8(digit);
+    
+    // combine digits d1*1000 + d2*100 + d3*10 + d4
+    __m128i x = _mm_maddubs_epi16(_mm_shuffle_epi8(d, _mm_set_epi8(DIGITS)),
+        _mm_set_epi8(WEIGHTS_A));
+    x = _mm_madd_epi16(x, _mm_set_epi16(WEIGHTS_B));
+    count = _mm_cvtsi128_si32(x);
+    
+    return (m_eq & EXPECT_MASK) == EXPECT_MASK && (m_digit & 0x1e) == 0x1e
+        && m_res == 0xffff;
+}
+
+
+/**
+ * Decode frames with the SSSE3 kernel
+ */
+__attribute__((target("ssse3")))
+size_t FS9922_Batch::decode_ssse3(const char* frames, size_t n,
+    const Reading_Columns& out)
+{
+    size_t rejected = 0;
+    size_t i = 0;
+    
+    // the last frame is decoded by the scalar kernel to avoid reading beyond
+    // the end of the array
+    for(; i+1 < n; ++i) {
+        const uint8_t* d = (const uint8_t*)(frames + 14*i);
+        int count;
+        uint16_t flags;
+        __m128i v = _mm_loadu_si128((const __m128i*)d);
+        if(!decode_vector(v, count, flags) || (d[10] & (d[10]-1))) {
+            reject(out, i);
+            rejected++;
+            continue;
+        }
+        store(out, i, (d[0] == '-') ? -count : count, flags, d);
+    }
+    return rejected + decode_scalar(frames, i, n, out);
+}
+
+
+/**
+ * Decode frames with the AVX2 kernel, which checks two frames at once
+ */
+__attribute__((target("avx2")))
+size_t FS9922_Batch::decode_avx2(const char* frames, size_t n,
+    const Reading_Columns& out)
+{
+    size_t rejected = 0;
+    size_t i = 0;
+    
+    const __m256i ascii0 = _mm256_set1_epi8('0');
+    const __m256i expect_a = _mm256_broadcastsi128_si256(_mm_set_epi8(EXPECT_A));
+    const __m256i expect_b = _mm256_broadcastsi128_si256(_mm_set_epi8(EXPECT_B));
+    const __m256i expect_c = _mm256_broadcastsi128_si256(_mm_set_epi8(EXPECT_C));
+    const __m256i expect_d = _mm256_broadcastsi128_si256(_mm_set_epi8(EXPECT_D));
+    const __m256i reserved = _mm256_broadcastsi128_si256(_mm_set_epi8(RESERVED));
+    const __m256i digits = _mm256_broadcastsi128_si256(_mm_set_epi8(DIGITS));
+    const __m256i weights_a = _mm256_broadcastsi128_si256(_mm_set_epi8(WEIGHTS_A));
+    const __m256i weights_b = _mm256_broadcastsi128_si256(_mm_set_epi16(WEIGHTS_B));
+    const __m256i flag_bytes = _mm256_broadcastsi128_si256(_mm_set_epi8(FLAG_BYTES));
+    const __m256i flag_bits = _mm256_broadcastsi128_si256(_mm_set_epi8(FLAG_BITS));
+    const __m256i flag_xor = _mm256_broadcastsi128_si256(_mm_set_epi8(FLAG_XOR));
+    
+    // the last frame is decoded by the scalar kernel to avoid reading beyond
+    // the end of the array
+    for(; i+2 < n; i += 2) {
+        const uint8_t* d = (const uint8_t*)(frames + 14*i);
+        __m256i v = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)d)),
+            _mm_loadu_si128((const __m128i*)(d+14)), 1);
+        
+        __m256i eq = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, expect_a),
+                _mm256_cmpeq_epi8(v, expect_b)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, expect_c),
+                _mm256_cmpeq_epi8(v, expect_d)));
+        __m256i res = _mm256_cmpeq_epi8(_mm256_and_si256(v, reserved),
+            _mm256_setzero_si256());
+        __m256i dv = _mm256_sub_epi8(v, ascii0);
+        __m256i digit = _mm256_cmpeq_epi8(
+            _mm256_min_epu8(dv, _mm256_set1_epi8(9)), dv);
+        __m256i wide = _mm256_cmpeq_epi8(
+            _mm256_min_epu8(dv, _mm256_set1_epi8(15)), dv);
+        __m256i f = _mm256_xor_si256(_mm256_shuffle_epi8(v, flag_bytes),
+            flag_xor);
+        uint32_t m_flags = _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_and_si256(f, flag_bits), flag_bits));
+        uint32_t m_eq = _mm256_movemask_epi8(eq);
+        uint32_t m_res = _mm256_movemask_epi8(res);
+        uint32_t m_digit = _mm256_movemask_epi8(digit);
+        uint32_t m_wide = _mm256_movemask_epi8(wide);
+        __m256i x = _mm256_maddubs_epi16(_mm256_shuffle_epi8(dv, digits),
+            weights_a);
+        x = _mm256_madd_epi16(x, weights_b);
+        int counts[2] = {
+            _mm_cvtsi128_si32(_mm256_castsi256_si128(x)),
+            _mm_cvtsi128_si32(_mm256_extracti128_si256(x, 1))
+        };
+        
+        for(int k = 0; k < 2; ++k) {
+            const uint8_t* dk = d + 14*k;
+            uint16_t flags = (m_flags >> 16*k) & 0x1ff;
+            uint32_t m = (flags & FLAG_OVERFLOW) ? (((m_wide >> 16*k) | 0x2))
+                : (m_digit >> 16*k);
+            if(((m_eq >> 16*k) & EXPECT_MASK) != EXPECT_MASK
+                || (m & 0x1e) != 0x1e || ((m_res >> 16*k) & 0xffff) != 0xffff
+                || (dk[10] & (dk[10]-1))) {
+                reject(out, i+k);
+                rejected++;
+                continue;
+            }
+            store(out, i+k, (dk[0] == '-') ? -counts[k] : counts[k], flags, dk);
+        }
+    }
+    return rejected + decode_scalar(frames, i, n, out);
+}
+
+#else
+
+size_t FS9922_Batch::decode_ssse3(const char* frames, size_t n,
+    const Reading_Columns& out)
+{
+    return decode_scalar(frames, 0, n, out);
+}
+
+size_t FS9922_Batch::decode_avx2(const char* frames, size_t n,
+    const Reading_Columns& out)
+{
+    return decode_scalar(frames, 0, n, out);
+}
+
+#endif
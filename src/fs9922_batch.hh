@@ -0,0 +1,127 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Batch decoder for contiguous arrays of raw 14 byte FS9922-DMM3 frames, e.g.
+ * for re-processing archived captures. The decoded values are written as
+ * structure of arrays. SSSE3 and AVX2 kernels are selected at runtime if the
+ * CPU supports them, otherwise a scalar kernel is used.
+ */
+#ifndef FS9922_BATCH_HH
+#define FS9922_BATCH_HH
+
+#include <stdint.h>
+#include <stddef.h>
+#include "fs9922_dmm3.hh"
+
+enum batch_kernel_t
+{
+    KERNEL_AUTO = 0,
+    KERNEL_SCALAR = 1,
+    KERNEL_SSSE3 = 2,
+    KERNEL_AVX2 = 3
+};
+
+
+/**
+ * Output columns of the batch decoder, each with space for one element per
+ * frame. Unused columns can be set to 0.
+ */
+struct Reading_Columns
+{
+    // value in the unit `unit` scaled with `prefix` (NAN if rejected)
+    float* value;
+    
+    // unit_t
+    uint16_t* unit;
+    
+    // unit_prefix_t
+    uint16_t* prefix;
+    
+    // combination of reading_flag_t
+    uint16_t* flags;
+    
+    // 1 if the frame failed validation, otherwise 0
+    uint8_t* reject;
+};
+
+
+/**
+ * This class provides the batch decoder
+ */
+class FS9922_Batch
+{
+    public:
+        
+        /**
+         * Decode frames
+         * \param frames contiguous array of raw 14 byte frames
+         * \param n number of frames
+         * \param out output columns
+         * \param kernel kernel to use, KERNEL_AUTO selects the fastest one
+         *               supported by the CPU
+         * \return number of rejected frames
+         */
+        static size_t decode(const char* frames, size_t n,
+            const Reading_Columns& out, batch_kernel_t kernel=KERNEL_AUTO);
+        
+        /**
+         * Return fastest kernel supported by the CPU
+         */
+        static batch_kernel_t best_kernel();
+        
+        /**
+         * Return whether kernel is supported by the CPU
+         */
+        static bool supported(batch_kernel_t kernel);
+        
+        /**
+         * Return name of kernel
+         */
+        static const char* kernel2str(batch_kernel_t kernel);
+        
+    private:
+        
+        /**
+         * Decode frames starting at index `first` with the respective kernel
+         * \return number of rejected frames
+         */
+        static size_t decode_scalar(const char* frames, size_t first,
+            size_t n, const Reading_Columns& out);
+        static size_t decode_ssse3(const char* frames, size_t n,
+            const Reading_Columns& out);
+        static size_t decode_avx2(const char* frames, size_t n,
+            const Reading_Columns& out);
+        
+        /**
+         * Write valid frame into the output columns
+         * \param i index of frame
+         * \param count signed displayed digits
+         * \param flags combination of reading_flag_t
+         * \param d raw frame data
+         */
+        static void store(const Reading_Columns& out, size_t i, int count,
+            uint16_t flags, const uint8_t* d);
+        
+        /**
+         * Write rejected frame into the output columns
+         * \param i index of frame
+         */
+        static void reject(const Reading_Columns& out, size_t i);
+};
+#endif
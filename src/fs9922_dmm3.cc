@@ -51,6 +51,29 @@ enum byte9_t
 };
 
 
+// bits of bytes 7, 8 and 9, which are not used
+static const uint8_t RESERVED7 = 0xc0;
+static const uint8_t RESERVED8 = 0xc1;
+static const uint8_t RESERVED9 = 0x01;
+
+const int8_t FS9922_DMM3::DECIMAL[8] = {0, -3, -2, 0, -1, 0, 0, 0};
+
+const uint16_t FS9922_DMM3::PREFIX[16] = {
+    0, PREFIX_MEGA, PREFIX_KILO, 0, PREFIX_MILLI, 0, 0, 0,
+    PREFIX_MICRO, 0, 0, 0, 0, 0, 0, 0
+};
+
+const int8_t FS9922_DMM3::PREFIX_EXP[16] = {
+    0, 6, 3, 0, -3, 0, 0, 0,
+    -6, 0, 0, 0, 0, 0, 0, 0
+};
+
+const double FS9922_DMM3::POW10[19] = {
+    1e-12, 1e-11, 1e-10, 1e-9, 1e-8, 1e-7, 1e-6, 1e-5, 1e-4, 1e-3,
+    1e-2, 1e-1, 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6
+};
+
+
 /**
  * Create frame
  */
@@ -58,23 +81,116 @@ FS9922_DMM3::FS9922_DMM3(const char* data) : data(data) { }
 
 
 /**
- * Return value
+ * Decode frame
  */
-float FS9922_DMM3::value()
+Reading FS9922_DMM3::reading() const
+{
+    Reading r;
+    decode(data, r);
+    return r;
+}
+
+
+/**
+ * Decode raw frame
+ */
+void FS9922_DMM3::decode(const char* data, Reading& r)
 {
-    if(overflow()) {
-        return INFINITY;
+    const uint8_t* d = (const uint8_t*)data;
+    
+    // digits, invalid digits count as zero
+    int count = 0;
+    for(int i = 1; i < 5; ++i) {
+        unsigned int digit = d[i] - '0';
+        count = count*10 + ((digit < 10) ? digit : 0);
     }
-    float v = atof(data);
-    switch(data[6]) {
-        case 0x31:
-            return v*1e-3;
-        case 0x32:
-            return v*1e-2;
-        case 0x34:
-            return v*1e-1;
+    r.count = (d[0] == '-') ? -count : count;
+    r.decimal = DECIMAL[d[6] & 0x7];
+    r.bargraph = ((d[11] & 0x80) ? -1 : 1)*(d[11] & 0x7f);
+    
+    // unit prefix and unit
+    int exponent = PREFIX_EXP[d[9] >> 4];
+    r.prefix = PREFIX[d[9] >> 4];
+    if(d[8] & B8_NANO) {
+        r.prefix = PREFIX_NANO;
+        exponent = -9;
+    }
+    r.unit = (d[9] & B9_PERCENT) ? (uint16_t)UNIT_DUTY : d[10];
+    r.exponent = r.decimal + exponent;
+    
+    // flags
+    r.flags = ((d[1] == '?') ? FLAG_OVERFLOW : 0)
+        | ((d[7] & B7_HOLD) ? FLAG_HOLD : 0)
+        | ((d[7] & B7_REL) ? FLAG_RELATIVE : 0)
+        | ((d[7] & B7_BPN) ? FLAG_BARGRAPH : 0)
+        | ((d[7] & B7_AUTO) ? FLAG_AUTORANGE : 0)
+        | ((d[8] & B8_APO) ? FLAG_AUTOPOWEROFF : 0)
+        | ((d[8] & B8_BAT) ? FLAG_LOWBATTERY : 0)
+        | ((d[9] & B9_DIODE) ? FLAG_DIODE : 0)
+        | ((d[9] & B9_BEEP) ? FLAG_BEEP : 0);
+    r.power = (d[7] & B7_DC) ? POWER_DC : ((d[7] & B7_AC) ? POWER_AC : POWER_NONE);
+    r.minmax = (d[8] & B8_MAX) ? MINMAX_MAX
+        : ((d[8] & B8_MIN) ? MINMAX_MIN : MINMAX_NONE);
+    
+    // value
+    if(r.flags & FLAG_OVERFLOW) {
+        r.value = INFINITY;
+        r.value_unscaled = INFINITY;
+    }
+    else {
+        r.value = r.count*POW10[r.decimal+12];
+        r.value_unscaled = r.count*POW10[r.decimal+exponent+12];
     }
-    return v;
+}
+
+
+/**
+ * Return whether frame is valid
+ */
+bool FS9922_DMM3::valid(const char* data)
+{
+    const uint8_t* d = (const uint8_t*)data;
+    
+    // sign
+    if(d[0] != '+' && d[0] != '-') {
+        return false;
+    }
+    
+    // digits 0-9, on overflow "?" followed by 0x30-0x3f
+    unsigned int max = 9;
+    int first = 1;
+    if(d[1] == '?') {
+        max = 15;
+        first = 2;
+    }
+    for(int i = first; i < 5; ++i) {
+        if((unsigned int)(d[i] - '0') > max) {
+            return false;
+        }
+    }
+    
+    // space and decimal position 0x30, 0x31, 0x32 or 0x34
+    if(d[5] != ' ' || (d[6] & 0xf8) != 0x30 || !((0x17 >> (d[6] & 0x7)) & 1)) {
+        return false;
+    }
+    
+    // reserved flag bits and at most one unit
+    if((d[7] & RESERVED7) || (d[8] & RESERVED8) || (d[9] & RESERVED9)
+        || (d[10] & (d[10]-1))) {
+        return false;
+    }
+    return (d[12] == 0x0d && d[13] == 0x0a);
+}
+
+
+/**
+ * Return value
+ */
+float FS9922_DMM3::value()
+{
+    Reading r;
+    decode(data, r);
+    return r.value;
 }
 
 
@@ -83,20 +199,31 @@ float FS9922_DMM3::value()
  */
 float FS9922_DMM3::value_unscaled()
 {
-    float v = value();
-    switch(unit_prefix()) {
-        case PREFIX_MEGA:
-            return v*1e6;
-        case PREFIX_KILO:
-            return v*1e3;
-        case PREFIX_MILLI:
-            return v*1e-3;
-        case PREFIX_MICRO:
-            return v*1e-6;
-        case PREFIX_NANO:
-            return v*1e-9;
-    }
-    return v;
+    Reading r;
+    decode(data, r);
+    return r.value_unscaled;
+}
+
+
+/**
+ * Return displayed digits
+ */
+int FS9922_DMM3::count()
+{
+    Reading r;
+    decode(data, r);
+    return r.count;
+}
+
+
+/**
+ * Return decimal exponent of unscaled value
+ */
+int FS9922_DMM3::exponent()
+{
+    Reading r;
+    decode(data, r);
+    return r.exponent;
 }
 
 
@@ -228,7 +355,7 @@ unit_prefix_t FS9922_DMM3::unit_prefix()
     if(data[8] & B8_NANO) {
         return PREFIX_NANO;
     }
-    return (unit_prefix_t)((uint8_t)data[9]);
+    return (unit_prefix_t)((uint8_t)data[9] & 0xf0);
 }
 
 
@@ -249,81 +376,117 @@ unit_t FS9922_DMM3::unit()
  */
 std::string FS9922_DMM3::unit2str(unit_t t)
 {
+    const Label& l = unit_label(t);
+    return std::string(l.str, l.len);
+}
+
+
+/**
+ * Return string representation of unit prefix
+ */
+std::string FS9922_DMM3::unit_prefix2str(unit_prefix_t t)
+{
+    const Label& l = unit_prefix_label(t);
+    return std::string(l.str, l.len);
+}
+
+
+/**
+ * Return string representation of power mode
+ */
+std::string FS9922_DMM3::power2str(power_t t)
+{
+    const Label& l = power_label(t);
+    return std::string(l.str, l.len);
+}
+
+
+/**
+ * Return string representation of min/max mode
+ */
+std::string FS9922_DMM3::minmax2str(minmax_t t)
+{
+    const Label& l = minmax_label(t);
+    return std::string(l.str, l.len);
+}
+
+
+// label of a string literal
+#define LABEL(s) {s, sizeof(s)-1}
+
+
+/**
+ * Return static string representation of unit
+ */
+const Label& FS9922_DMM3::unit_label(unit_t t)
+{
+    static const Label LABELS[10] = {LABEL(""), LABEL("°F"), LABEL("°C"),
+        LABEL("F"), LABEL("Hz"), LABEL("hFE"), LABEL("Ω"), LABEL("A"),
+        LABEL("V"), LABEL("%")};
     switch(t) {
         case UNIT_FAHRENHEIT:
-            return "°F";
+            return LABELS[1];
         case UNIT_DEGREE:
-            return "°C";
+            return LABELS[2];
         case UNIT_FARAD:
-            return "F";
+            return LABELS[3];
         case UNIT_HERTZ:
-            return "Hz";
+            return LABELS[4];
         case UNIT_HFE:
-            return "hFE";
+            return LABELS[5];
         case UNIT_OHM:
-            return "Ω";
+            return LABELS[6];
         case UNIT_AMPERE:
-            return "A";
+            return LABELS[7];
         case UNIT_VOLT:
-            return "V";
+            return LABELS[8];
         case UNIT_DUTY:
-            return "%";
+            return LABELS[9];
         default:
-            return "";
+            return LABELS[0];
     }
 }
 
 
 /**
- * Return string representation of unit prefix
+ * Return static string representation of unit prefix
  */
-std::string FS9922_DMM3::unit_prefix2str(unit_prefix_t t)
+const Label& FS9922_DMM3::unit_prefix_label(unit_prefix_t t)
 {
+    static const Label LABELS[6] = {LABEL(""), LABEL("M"), LABEL("k"),
+        LABEL("m"), LABEL("µ"), LABEL("n")};
     switch(t) {
         case PREFIX_MEGA:
-            return "M";
+            return LABELS[1];
         case PREFIX_KILO:
-            return "k";
+            return LABELS[2];
         case PREFIX_MILLI:
-            return "m";
+            return LABELS[3];
         case PREFIX_MICRO:
-            return "µ";
+            return LABELS[4];
         case PREFIX_NANO:
-            return "n";
+            return LABELS[5];
         default:
-            return "";
+            return LABELS[0];
     }
 }
 
 
-
 /**
- * Return string representation of power mode
+ * Return static string representation of power mode
  */
-std::string FS9922_DMM3::power2str(power_t t)
+const Label& FS9922_DMM3::power_label(power_t t)
 {
-    switch(t) {
-        case POWER_AC:
-            return "AC";
-        case POWER_DC:
-            return "DC";
-        default:
-            return "";
-    }
+    static const Label LABELS[3] = {LABEL(""), LABEL("DC"), LABEL("AC")};
+    return LABELS[(t == POWER_DC || t == POWER_AC) ? t : 0];
 }
 
 
 /**
- * Return string representation of min/max mode
+ * Return static string representation of min/max mode
  */
-std::string FS9922_DMM3::minmax2str(minmax_t t)
+const Label& FS9922_DMM3::minmax_label(minmax_t t)
 {
-    switch(t) {
-        case MINMAX_MAX:
-            return "MAX";
-        case MINMAX_MIN:
-            return "MIN";
-        default:
-            return "";
-    }
+    static const Label LABELS[3] = {LABEL(""), LABEL("MIN"), LABEL("MAX")};
+    return LABELS[(t == MINMAX_MIN || t == MINMAX_MAX) ? t : 0];
 }
@@ -26,6 +26,8 @@
 #define FS9922_DMM3_HH
 
 #include <math.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <string>
 
 enum unit_prefix_t
@@ -65,6 +67,82 @@ enum power_t
 };
 
 
+enum reading_flag_t
+{
+    FLAG_OVERFLOW = 0x1,
+    FLAG_HOLD = 0x2,
+    FLAG_RELATIVE = 0x4,
+    FLAG_BARGRAPH = 0x8,
+    FLAG_AUTORANGE = 0x10,
+    FLAG_AUTOPOWEROFF = 0x20,
+    FLAG_LOWBATTERY = 0x40,
+    FLAG_DIODE = 0x80,
+    FLAG_BEEP = 0x100
+};
+
+
+/**
+ * Static string with its length, so that labels are copied without
+ * temporary strings
+ */
+struct Label
+{
+    const char* str;
+    size_t len;
+};
+
+
+/**
+ * Completely decoded data frame. The struct is trivially copyable, so that it
+ * can be passed between processing stages by value.
+ */
+struct Reading
+{
+    // value in the unit `unit` scaled with `prefix` (INFINITY on overflow)
+    float value;
+    
+    // unscaled value in the unit `unit`
+    float value_unscaled;
+    
+    // signed displayed digits, e.g. -1234 for "-1.234"
+    int16_t count;
+    
+    // decimal exponent of the display (0, -1, -2 or -3)
+    int8_t decimal;
+    
+    // value of bargraph
+    int8_t bargraph;
+    
+    // unit_prefix_t (0 = none)
+    uint16_t prefix;
+    
+    // unit_t (0 = none)
+    uint16_t unit;
+    
+    // combination of reading_flag_t
+    uint16_t flags;
+    
+    // power_t
+    uint8_t power;
+    
+    // minmax_t
+    uint8_t minmax;
+    
+    // decimal exponent of the unscaled value, i.e. `decimal` plus the
+    // exponent of `prefix`, so that the exact unscaled value is
+    // count*10^exponent
+    int8_t exponent;
+    
+    /**
+     * Return whether flag is set
+     */
+    bool has(reading_flag_t f) const
+    {
+        return (flags & f) != 0;
+    }
+};
+
+
 /**
  * This class represents a single data frame and provides access methods for the
  * individual frame values
@@ -82,6 +160,26 @@ class FS9922_DMM3
          */
         FS9922_DMM3(const char* data);
         
+        /**
+         * Decode all values of the frame in a single pass
+         */
+        Reading reading() const;
+        
+        /**
+         * Decode all values of a raw frame in a single pass
+         * \param data raw frame data
+         * \param r decoded frame
+         */
+        static void decode(const char* data, Reading& r);
+        
+        /**
+         * Return whether a raw frame is structurally valid: sign, digits (or
+         * overflow), space, decimal position, reserved flag bits, a single
+         * unit and CR/LF at the end
+         * \param data raw frame data
+         */
+        static bool valid(const char* data);
+        
         /**
          * Return value as floating point number in the unit `unit()` scaled
          * with `unit_prefix()`
@@ -94,6 +192,17 @@ class FS9922_DMM3
          */
         float value_unscaled();
         
+        /**
+         * Return signed displayed digits, e.g. -1234 for "-1.234"
+         */
+        int count();
+        
+        /**
+         * Return decimal exponent of the unscaled value, so that the exact
+         * value is `count()`*10^`exponent()`
+         */
+        int exponent();
+        
         
         /**
          * Return whether overflow occurs
@@ -173,5 +282,28 @@ class FS9922_DMM3
         static std::string unit_prefix2str(unit_prefix_t t);
         static std::string power2str(power_t t);
         static std::string minmax2str(minmax_t t);
+        
+        /**
+         * Return static string representation of constants
+         */
+        static const Label& unit_label(unit_t t);
+        static const Label& unit_prefix_label(unit_prefix_t t);
+        static const Label& power_label(power_t t);
+        static const Label& minmax_label(minmax_t t);
+        
+    private:
+        
+        friend class FS9922_Batch;
+        
+        // decimal exponent of the display indexed by the lower 3 bits of
+        // byte 6
+        static const int8_t DECIMAL[8];
+        
+        // unit prefix and its exponent indexed by the upper 4 bits of byte 9
+        static const uint16_t PREFIX[16];
+        static const int8_t PREFIX_EXP[16];
+        
+        // powers of ten indexed by exponent+12
+        static const double POW10[19];
 };
 #endif
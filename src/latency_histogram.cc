@@ -0,0 +1,144 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "latency_histogram.hh"
+
+
+/**
+ * Create empty histogram
+ */
+Latency_Histogram::Latency_Histogram() : total(0), sum(0),
+    lowest(UINT64_MAX), highest(0)
+{
+    for(int i = 0; i < BUCKETS; ++i) {
+        counts[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+
+/**
+ * Record value
+ */
+void Latency_Histogram::record(uint64_t ns)
+{
+    counts[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(ns, std::memory_order_relaxed);
+    
+    uint64_t v = lowest.load(std::memory_order_relaxed);
+    while(ns < v && !lowest.compare_exchange_weak(v, ns,
+        std::memory_order_relaxed)) {
+    }
+    v = highest.load(std::memory_order_relaxed);
+    while(ns > v && !highest.compare_exchange_weak(v, ns,
+        std::memory_order_relaxed)) {
+    }
+}
+
+
+/**
+ * Return number of values
+ */
+uint64_t Latency_Histogram::count() const
+{
+    return total.load(std::memory_order_relaxed);
+}
+
+
+/**
+ * Return minimum
+ */
+uint64_t Latency_Histogram::min() const
+{
+    return (count() == 0) ? 0 : lowest.load(std::memory_order_relaxed);
+}
+
+
+/**
+ * Return maximum
+ */
+uint64_t Latency_Histogram::max() const
+{
+    return highest.load(std::memory_order_relaxed);
+}
+
+
+/**
+ * Return mean
+ */
+double Latency_Histogram::mean() const
+{
+    uint64_t n = count();
+    return (n == 0) ? 0 : (double)sum.load(std::memory_order_relaxed)/n;
+}
+
+
+/**
+ * Return percentile
+ */
+uint64_t Latency_Histogram::percentile(double p) const
+{
+    uint64_t n = count();
+    if(n == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(p/100*n + 0.5);
+    rank = (rank < 1) ? 1 : rank;
+    uint64_t seen = 0;
+    for(int i = 0; i < BUCKETS; ++i) {
+        seen += counts[i].load(std::memory_order_relaxed);
+        if(seen >= rank) {
+            uint64_t v = upper(i);
+            return (v < max()) ? v : max();
+        }
+    }
+    return max();
+}
+
+
+/**
+ * Return bucket of a value
+ */
+int Latency_Histogram::bucket(uint64_t ns)
+{
+    if(ns < (2ULL << SUB_BITS)) {
+        return (int)ns;
+    }
+    int msb = 63 - __builtin_clzll(ns);
+    if(msb > MAX_BITS) {
+        return BUCKETS-1;
+    }
+    
+    // the SUB_BITS+1 most significant bits select the bucket
+    int shift = msb - SUB_BITS;
+    return (shift << SUB_BITS) + (int)(ns >> shift);
+}
+
+
+/**
+ * Return largest value of a bucket
+ */
+uint64_t Latency_Histogram::upper(int i)
+{
+    if(i < (2 << SUB_BITS)) {
+        return i;
+    }
+    int shift = (i >> SUB_BITS) - 1;
+    uint64_t sub = i - (shift << SUB_BITS);
+    return ((sub+1) << shift) - 1;
+}
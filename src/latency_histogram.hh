@@ -0,0 +1,93 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Histogram of latencies in ns with logarithmic buckets of constant relative
+ * precision (HDR histogram), which can be recorded and queried concurrently
+ */
+#ifndef LATENCY_HISTOGRAM_HH
+#define LATENCY_HISTOGRAM_HH
+
+#include <atomic>
+#include <stdint.h>
+
+
+/**
+ * This class counts values in buckets, whose width is 1/64 of their lower
+ * bound (below 128 ns the width is 1 ns). Values above about 18 min are
+ * counted in the last bucket. Recording is lock-free and wait-free except for
+ * the updates of minimum and maximum.
+ */
+class Latency_Histogram
+{
+    public:
+        Latency_Histogram();
+        
+        /**
+         * Record value
+         * \param ns value in ns
+         */
+        void record(uint64_t ns);
+        
+        /**
+         * Return number of recorded values
+         */
+        uint64_t count() const;
+        
+        /**
+         * Return minimum, maximum and mean of recorded values in ns
+         */
+        uint64_t min() const;
+        uint64_t max() const;
+        double mean() const;
+        
+        /**
+         * Return value below or equal to which the given percentage of
+         * recorded values lies, precise to the bucket width
+         * \param p percentage between 0 and 100
+         */
+        uint64_t percentile(double p) const;
+        
+    private:
+        
+        // number of sub-buckets per power of two is 2^SUB_BITS
+        static const int SUB_BITS = 6;
+        
+        // largest recorded power of two
+        static const int MAX_BITS = 40;
+        
+        // number of buckets
+        static const int BUCKETS = (MAX_BITS-SUB_BITS+2) << SUB_BITS;
+        
+        /**
+         * Return bucket of a value
+         */
+        static int bucket(uint64_t ns);
+        
+        /**
+         * Return largest value of a bucket
+         */
+        static uint64_t upper(int i);
+        
+        std::atomic<uint64_t> counts[BUCKETS];
+        std::atomic<uint64_t> total;
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> lowest;
+        std::atomic<uint64_t> highest;
+};
+#endif
@@ -0,0 +1,193 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "live_plot.hh"
+#include <stdexcept>
+#include <cmath>
+
+
+/**
+ * Create series
+ */
+Plot_Series::Plot_Series(double window, size_t resolution) : window(window),
+    resolution((resolution < 2) ? 2 : resolution), origin(0),
+    span(window/this->resolution)
+{
+    if(span <= 0) {
+        span = 0.1;
+    }
+}
+
+
+/**
+ * Add reading
+ */
+void Plot_Series::add(double time, double value)
+{
+    Plot_Point p = {time, value};
+    recent.push_back(p);
+    while(recent.front().time < time - window) {
+        archive(recent.front());
+        recent.pop_front();
+    }
+}
+
+
+/**
+ * Move reading into bucket
+ */
+void Plot_Series::archive(const Plot_Point& p)
+{
+    if(buckets.empty()) {
+        origin = p.time;
+    }
+    double offset = (p.time > origin) ? p.time - origin : 0;
+    size_t slot = (size_t)(offset/span);
+    
+    // merge pairs of buckets until the reading fits
+    while(slot >= resolution) {
+        size_t n = 0;
+        for(size_t i = 0; i < buckets.size(); ++i) {
+            Bucket b = buckets[i];
+            b.slot /= 2;
+            if(n > 0 && buckets[n-1].slot == b.slot) {
+                Bucket& m = buckets[n-1];
+                if(b.min.value < m.min.value) {
+                    m.min = b.min;
+                }
+                if(b.max.value > m.max.value) {
+                    m.max = b.max;
+                }
+            }
+            else {
+                buckets[n++] = b;
+            }
+        }
+        buckets.resize(n);
+        span *= 2;
+        slot = (size_t)(offset/span);
+    }
+    
+    if(!buckets.empty() && buckets.back().slot == slot) {
+        Bucket& b = buckets.back();
+        if(p.value < b.min.value) {
+            b.min = p;
+        }
+        if(p.value > b.max.value) {
+            b.max = p;
+        }
+    }
+    else {
+        Bucket b = {slot, p, p};
+        buckets.push_back(b);
+    }
+}
+
+
+/**
+ * Append points to plot
+ */
+void Plot_Series::points(std::vector<Plot_Point>& out) const
+{
+    for(size_t i = 0; i < buckets.size(); ++i) {
+        const Bucket& b = buckets[i];
+        const Plot_Point& first = (b.min.time <= b.max.time) ? b.min : b.max;
+        const Plot_Point& second = (b.min.time <= b.max.time) ? b.max : b.min;
+        out.push_back(first);
+        if(second.time != first.time) {
+            out.push_back(second);
+        }
+    }
+    out.insert(out.end(), recent.begin(), recent.end());
+}
+
+
+/**
+ * Start gnuplot
+ */
+Live_Plot::Live_Plot(double interval) : interval(interval), last(-INFINITY),
+    changed(false)
+{
+    gp = popen("gnuplot -persist", "w");
+    if(gp == 0) {
+        throw std::runtime_error("Starting gnuplot failed");
+    }
+    fprintf(gp, "set xlabel 'Time in [s]'\n");
+    fflush(gp);
+}
+
+
+/**
+ * Close gnuplot
+ */
+Live_Plot::~Live_Plot()
+{
+    refresh(INFINITY);
+    pclose(gp);
+}
+
+
+/**
+ * Add reading
+ */
+void Live_Plot::add(const std::string& name, double time, double value,
+    const std::string& unit)
+{
+    size_t i = 0;
+    while(i < names.size() && names[i] != name) {
+        i++;
+    }
+    if(i == names.size()) {
+        names.push_back(name);
+        units.push_back(unit);
+        series.push_back(Plot_Series());
+    }
+    units[i] = unit;
+    series[i].add(time, value);
+    changed = true;
+}
+
+
+/**
+ * Redraw plot
+ */
+void Live_Plot::refresh(double time)
+{
+    if(!changed || time - last < interval) {
+        return;
+    }
+    last = time;
+    changed = false;
+    
+    // inline data, so that gnuplot never reads the log file
+    fprintf(gp, "plot");
+    for(size_t i = 0; i < series.size(); ++i) {
+        fprintf(gp, "%s '-' with lines title '%s [%s]'", (i > 0) ? "," : "",
+            names[i].c_str(), units[i].c_str());
+    }
+    fprintf(gp, "\n");
+    for(size_t i = 0; i < series.size(); ++i) {
+        buf.clear();
+        series[i].points(buf);
+        for(size_t k = 0; k < buf.size(); ++k) {
+            fprintf(gp, "%.6f %.7g\n", buf[k].time, buf[k].value);
+        }
+        fprintf(gp, "e\n");
+    }
+    fflush(gp);
+}
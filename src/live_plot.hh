@@ -0,0 +1,151 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Incremental live plot via gnuplot. Each series keeps the most recent
+ * readings at full resolution and reduces older readings to the minimum and
+ * maximum of a bounded number of time buckets, whose width doubles whenever
+ * the capture outgrows them. Thus memory and the cost of a redraw stay
+ * constant regardless of the duration of the capture.
+ */
+#ifndef LIVE_PLOT_HH
+#define LIVE_PLOT_HH
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <stdio.h>
+
+
+/**
+ * Point of a plot
+ */
+struct Plot_Point
+{
+    double time;
+    double value;
+};
+
+
+/**
+ * This class holds the decimated data of a single series
+ */
+class Plot_Series
+{
+    public:
+        
+        /**
+         * Create series
+         * \param window time span of the most recent readings kept at full
+         *               resolution in s
+         * \param resolution maximum number of buckets of older readings
+         */
+        Plot_Series(double window=60, size_t resolution=500);
+        
+        /**
+         * Add reading
+         * \param time time of the reading in s (increasing)
+         * \param value value of the reading
+         */
+        void add(double time, double value);
+        
+        /**
+         * Append points to plot in chronological order, at most two per
+         * bucket followed by the most recent readings
+         */
+        void points(std::vector<Plot_Point>& out) const;
+        
+    private:
+        
+        /**
+         * Bucket of older readings
+         */
+        struct Bucket
+        {
+            size_t slot;
+            Plot_Point min;
+            Plot_Point max;
+        };
+        
+        /**
+         * Move reading into the bucket covering its time
+         */
+        void archive(const Plot_Point& p);
+        
+        double window;
+        size_t resolution;
+        
+        // most recent readings
+        std::deque<Plot_Point> recent;
+        
+        // buckets of older readings, bucket slot i covers the time range
+        // [origin + i*span, origin + (i+1)*span)
+        std::vector<Bucket> buckets;
+        double origin;
+        double span;
+};
+
+
+/**
+ * This class feeds gnuplot with the series of one or several adapters
+ */
+class Live_Plot
+{
+    public:
+        
+        /**
+         * Start gnuplot
+         * \param interval minimum time between two redraws in s
+         */
+        Live_Plot(double interval=1);
+        
+        /**
+         * Close gnuplot, the window of the last plot stays open
+         */
+        ~Live_Plot();
+        
+        /**
+         * Add reading
+         * \param name name of the series
+         * \param time time of the reading in s
+         * \param value value of the reading
+         * \param unit unit of the reading shown in the title
+         */
+        void add(const std::string& name, double time, double value,
+            const std::string& unit);
+        
+        /**
+         * Redraw plot, if the interval since the last redraw elapsed
+         * \param time current time in s
+         */
+        void refresh(double time);
+        
+    private:
+        FILE* gp;
+        double interval;
+        double last;
+        bool changed;
+        
+        std::vector<std::string> names;
+        std::vector<std::string> units;
+        std::vector<Plot_Series> series;
+        
+        // buffer of the points of a redraw
+        std::vector<Plot_Point> buf;
+};
+#endif
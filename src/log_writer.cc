@@ -0,0 +1,256 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "log_writer.hh"
+#include <stdexcept>
+#include <iostream>
+#include <chrono>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+
+/**
+ * Return monotonic time in s
+ */
+static double now()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+
+/**
+ * Return monotonic time in ns
+ */
+static uint64_t now_ns()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec*1000000000 + t.tv_nsec;
+}
+
+
+/**
+ * Create log file and start writer thread
+ */
+Log_Writer::Log_Writer(const std::string& path, fsync_t sync,
+    int sync_interval, size_t flush_size, int flush_interval,
+    size_t queue_limit) :
+    sync(sync), sync_interval(sync_interval), flush_size(flush_size),
+    flush_interval(flush_interval), queue_limit(queue_limit), latency(0),
+    stopping(false)
+{
+    fd = open(path.c_str(), O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+    if(fd < 0) {
+        throw std::runtime_error("Opening log file " + path + " failed: "
+            + strerror(errno));
+    }
+    
+    // written data has to reach the file before it can be synced
+    if(sync == FSYNC_INTERVAL && sync_interval < flush_interval) {
+        this->flush_interval = sync_interval;
+    }
+    memset(&st, 0, sizeof(st));
+    queue.reserve(2*flush_size);
+    thread = std::thread(&Log_Writer::run, this);
+}
+
+
+/**
+ * Close log file
+ */
+Log_Writer::~Log_Writer()
+{
+    close();
+}
+
+
+/**
+ * Write remaining data and close log file
+ */
+void Log_Writer::close()
+{
+    if(!thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cond.notify_one();
+    thread.join();
+    ::close(fd);
+    fd = -1;
+}
+
+
+/**
+ * Queue data
+ */
+bool Log_Writer::write(const char* data, size_t len, uint64_t origin)
+{
+    bool notify;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(stopping) {
+            return false;
+        }
+        if(queue.size() + len > queue_limit) {
+            st.dropped += len;
+            return false;
+        }
+        queue.append(data, len);
+        if(origin != 0 && latency != 0) {
+            origins.push_back(origin);
+        }
+        if(queue.size() > st.queue_max) {
+            st.queue_max = queue.size();
+        }
+        notify = (queue.size() >= flush_size || sync == FSYNC_RECORD);
+    }
+    if(notify) {
+        cond.notify_one();
+    }
+    return true;
+}
+
+
+/**
+ * Queue data
+ */
+bool Log_Writer::write(const std::string& data, uint64_t origin)
+{
+    return write(data.data(), data.size(), origin);
+}
+
+
+/**
+ * Set latency histogram
+ */
+void Log_Writer::set_latency_histogram(Latency_Histogram* hist)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    latency = hist;
+}
+
+
+/**
+ * Return number of queued bytes
+ */
+size_t Log_Writer::queued()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return queue.size();
+}
+
+
+/**
+ * Return statistics
+ */
+Log_Stats Log_Writer::stats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return st;
+}
+
+
+/**
+ * Writer thread
+ */
+void Log_Writer::run()
+{
+    std::string batch;
+    batch.reserve(2*flush_size);
+    std::vector<uint64_t> batch_origins;
+    double t_sync = now();
+    
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true) {
+        
+        // wait for enough data, the flush interval or stopping
+        cond.wait_for(lock, std::chrono::milliseconds(flush_interval),
+            [this] {
+                return stopping || queue.size() >= flush_size
+                    || (sync == FSYNC_RECORD && !queue.empty());
+            }
+        );
+        if(queue.empty()) {
+            if(stopping) {
+                break;
+            }
+            continue;
+        }
+        
+        // take over queued data and write it without holding the lock
+        batch.swap(queue);
+        batch_origins.swap(origins);
+        Latency_Histogram* hist = latency;
+        lock.unlock();
+        
+        double t_begin = now();
+        bool failed = false;
+        size_t n = 0;
+        while(n < batch.size()) {
+            ssize_t r = ::write(fd, batch.data()+n, batch.size()-n);
+            if(r < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                std::cerr << "Writing log file failed: " << strerror(errno);
+                std::cerr << "\n";
+                failed = true;
+                break;
+            }
+            n += r;
+        }
+        bool synced = false;
+        if(sync == FSYNC_RECORD
+            || (sync == FSYNC_INTERVAL && (t_begin-t_sync)*1e3 >= sync_interval)) {
+            fsync(fd);
+            t_sync = now();
+            synced = true;
+        }
+        double duration = now() - t_begin;
+        uint64_t t_written = now_ns();
+        for(size_t i = 0; hist != 0 && i < batch_origins.size(); ++i) {
+            uint64_t t = batch_origins[i];
+            hist->record((t_written > t) ? t_written - t : 0);
+        }
+        batch_origins.clear();
+        
+        lock.lock();
+        st.writes++;
+        st.bytes += n;
+        st.fsyncs += synced;
+        st.errors += failed;
+        st.latency_sum += duration;
+        if(duration > st.latency_max) {
+            st.latency_max = duration;
+        }
+        batch.clear();
+    }
+    
+    // make remaining data durable
+    if(sync != FSYNC_NEVER) {
+        fsync(fd);
+    }
+}
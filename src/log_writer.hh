@@ -0,0 +1,172 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Asynchronous log file writer, which collects written data in a buffer and
+ * writes it in large batches from a background thread (group commit). Disk
+ * stalls thereby do not delay the capturing thread. The buffer is bounded;
+ * data, which does not fit while the disk stalls, is dropped and counted.
+ */
+#ifndef LOG_WRITER_HH
+#define LOG_WRITER_HH
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include "latency_histogram.hh"
+
+enum fsync_t
+{
+    FSYNC_NEVER = 0,
+    FSYNC_INTERVAL = 1,
+    FSYNC_RECORD = 2
+};
+
+
+/**
+ * Statistics of the log writer
+ */
+struct Log_Stats
+{
+    // number of write batches, written bytes and fsync calls
+    uint64_t writes;
+    uint64_t bytes;
+    uint64_t fsyncs;
+    
+    // number of failed writes
+    uint64_t errors;
+    
+    // maximum and summed duration of a batch (write and fsync) in s
+    double latency_max;
+    double latency_sum;
+    
+    // maximum number of queued bytes
+    size_t queue_max;
+    
+    // number of bytes dropped, because the queue was full
+    uint64_t dropped;
+};
+
+
+/**
+ * This class represents a log file, which is written by a background thread
+ */
+class Log_Writer
+{
+    public:
+        
+        /**
+         * Create log file and start writer thread
+         * \param path path of the log file
+         * \param sync fsync policy: never, every `sync_interval` ms or after
+         *             every record
+         * \param sync_interval minimum time between two fsync calls in ms
+         * \param flush_size number of buffered bytes, which triggers writing
+         * \param flush_interval maximum time data is buffered in ms
+         * \param queue_limit maximum number of queued bytes
+         */
+        Log_Writer(const std::string& path, fsync_t sync=FSYNC_NEVER,
+            int sync_interval=1000, size_t flush_size=65536,
+            int flush_interval=1000, size_t queue_limit=64 << 20);
+        
+        /**
+         * Close log file
+         */
+        ~Log_Writer();
+        
+        /**
+         * Write remaining data, stop writer thread and close log file. Data
+         * queued afterwards is discarded.
+         */
+        void close();
+        
+        /**
+         * Queue data for writing. Data, which exceeds the queue limit, is
+         * dropped as a whole instead of blocking the caller.
+         * \param data data
+         * \param len length of data in bytes
+         * \param origin monotonic time in ns the data originates from, the
+         *               time until the data is written is recorded in the
+         *               latency histogram (0 = not recorded)
+         * \return false if the data was dropped
+         */
+        bool write(const char* data, size_t len, uint64_t origin=0);
+        bool write(const std::string& data, uint64_t origin=0);
+        
+        /**
+         * Set histogram, which records the time from the origin of queued
+         * data until it is written (and synced)
+         * \param hist histogram or 0
+         */
+        void set_latency_histogram(Latency_Histogram* hist);
+        
+        /**
+         * Return number of queued bytes
+         */
+        size_t queued();
+        
+        /**
+         * Return statistics
+         */
+        Log_Stats stats();
+        
+    private:
+        
+        /**
+         * Writer thread
+         */
+        void run();
+        
+        // file descriptor of the log file
+        int fd;
+        
+        // fsync policy
+        fsync_t sync;
+        int sync_interval;
+        
+        // flush thresholds
+        size_t flush_size;
+        int flush_interval;
+        
+        // maximum number of queued bytes
+        size_t queue_limit;
+        
+        // buffer of queued data
+        std::string queue;
+        
+        // origin times of queued data and histogram of their latencies
+        std::vector<uint64_t> origins;
+        Latency_Histogram* latency;
+        
+        // statistics
+        Log_Stats st;
+        
+        // flag whether writer thread has to stop
+        bool stopping;
+        
+        // guards `queue`, `st` and `stopping`
+        std::mutex mutex;
+        std::condition_variable cond;
+        
+        // writer thread
+        std::thread thread;
+};
+#endif
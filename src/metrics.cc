@@ -0,0 +1,319 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "metrics.hh"
+#include <sstream>
+#include <string.h>
+
+
+/**
+ * Create counter
+ */
+Metric_Counter::Metric_Counter() : v(0)
+{
+}
+
+
+/**
+ * Increase counter
+ */
+void Metric_Counter::add(uint64_t n)
+{
+    v.fetch_add(n, std::memory_order_relaxed);
+}
+
+
+/**
+ * Return value
+ */
+uint64_t Metric_Counter::value() const
+{
+    return v.load(std::memory_order_relaxed);
+}
+
+
+/**
+ * Create gauge
+ */
+Metric_Gauge::Metric_Gauge() : bits(0)
+{
+}
+
+
+/**
+ * Set value
+ */
+void Metric_Gauge::set(double value)
+{
+    uint64_t b;
+    memcpy(&b, &value, sizeof(b));
+    bits.store(b, std::memory_order_relaxed);
+}
+
+
+/**
+ * Return value
+ */
+double Metric_Gauge::value() const
+{
+    uint64_t b = bits.load(std::memory_order_relaxed);
+    double value;
+    memcpy(&value, &b, sizeof(value));
+    return value;
+}
+
+
+/**
+ * Return registry
+ */
+Metrics_Registry& Metrics_Registry::instance()
+{
+    static Metrics_Registry registry;
+    return registry;
+}
+
+
+/**
+ * Create empty registry
+ */
+Metrics_Registry::Metrics_Registry()
+{
+}
+
+
+/**
+ * Delete metrics
+ */
+Metrics_Registry::~Metrics_Registry()
+{
+    for(size_t i = 0; i < metrics.size(); ++i) {
+        delete metrics[i]->counter;
+        delete metrics[i]->gauge;
+        delete metrics[i];
+    }
+}
+
+
+/**
+ * Return counter
+ */
+Metric_Counter& Metrics_Registry::counter(const std::string& name,
+    const std::string& help, const std::string& labels)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Metric* m = find(name, labels);
+    if(m == 0 || m->counter == 0) {
+        m = new Metric;
+        m->name = name;
+        m->help = help;
+        m->labels = labels;
+        m->type = METRIC_COUNTER;
+        m->counter = new Metric_Counter;
+        m->gauge = 0;
+        m->probe = 0;
+        m->arg = 0;
+        metrics.push_back(m);
+    }
+    return *m->counter;
+}
+
+
+/**
+ * Return gauge
+ */
+Metric_Gauge& Metrics_Registry::gauge(const std::string& name,
+    const std::string& help, const std::string& labels)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Metric* m = find(name, labels);
+    if(m == 0 || m->gauge == 0) {
+        m = new Metric;
+        m->name = name;
+        m->help = help;
+        m->labels = labels;
+        m->type = METRIC_GAUGE;
+        m->counter = 0;
+        m->gauge = new Metric_Gauge;
+        m->probe = 0;
+        m->arg = 0;
+        metrics.push_back(m);
+    }
+    return *m->gauge;
+}
+
+
+/**
+ * Add probe
+ */
+void Metrics_Registry::probe(const std::string& name, const std::string& help,
+    const std::string& labels, metric_type_t type,
+    double (*probe)(const void*), const void* arg)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Metric* m = new Metric;
+    m->name = name;
+    m->help = help;
+    m->labels = labels;
+    m->type = type;
+    m->counter = 0;
+    m->gauge = 0;
+    m->probe = probe;
+    m->arg = arg;
+    metrics.push_back(m);
+}
+
+
+/**
+ * Add latency histogram
+ */
+void Metrics_Registry::summary(const std::string& name,
+    const std::string& help, const std::string& labels,
+    const Latency_Histogram* hist)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Metric* m = new Metric;
+    m->name = name;
+    m->help = help;
+    m->labels = labels;
+    m->type = METRIC_SUMMARY;
+    m->counter = 0;
+    m->gauge = 0;
+    m->probe = 0;
+    m->arg = hist;
+    metrics.push_back(m);
+}
+
+
+/**
+ * Remove probes of an object
+ */
+void Metrics_Registry::remove(const void* arg)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t n = 0;
+    for(size_t i = 0; i < metrics.size(); ++i) {
+        if(metrics[i]->arg == arg && metrics[i]->counter == 0
+            && metrics[i]->gauge == 0) {
+            delete metrics[i];
+            continue;
+        }
+        metrics[n++] = metrics[i];
+    }
+    metrics.resize(n);
+}
+
+
+/**
+ * Return metrics in the Prometheus text format
+ */
+std::string Metrics_Registry::exposition()
+{
+    static const char* TYPES[3] = {"counter", "gauge", "summary"};
+    static const double QUANTILES[4] = {0.5, 0.9, 0.99, 0.999};
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ostringstream os;
+    os.precision(15);
+    std::vector<bool> done(metrics.size(), false);
+    for(size_t i = 0; i < metrics.size(); ++i) {
+        if(done[i]) {
+            continue;
+        }
+        
+        // all series of a metric follow a single header
+        const Metric& first = *metrics[i];
+        os << "# HELP " << first.name << " " << first.help << "\n";
+        os << "# TYPE " << first.name << " " << TYPES[first.type] << "\n";
+        for(size_t k = i; k < metrics.size(); ++k) {
+            const Metric& m = *metrics[k];
+            if(done[k] || m.name != first.name) {
+                continue;
+            }
+            done[k] = true;
+            std::string sep = m.labels.empty() ? "" : ",";
+            if(m.type == METRIC_SUMMARY) {
+                const Latency_Histogram* h = (const Latency_Histogram*)m.arg;
+                for(int q = 0; q < 4; ++q) {
+                    os << m.name << "{" << m.labels << sep << "quantile=\"";
+                    os << QUANTILES[q] << "\"} ";
+                    os << h->percentile(100*QUANTILES[q])*1e-9 << "\n";
+                }
+                std::string labels = m.labels.empty() ? ""
+                    : "{" + m.labels + "}";
+                os << m.name << "_sum" << labels << " ";
+                os << h->mean()*h->count()*1e-9 << "\n";
+                os << m.name << "_count" << labels << " " << h->count() << "\n";
+                continue;
+            }
+            os << m.name;
+            if(!m.labels.empty()) {
+                os << "{" << m.labels << "}";
+            }
+            os << " ";
+            if(m.counter != 0) {
+                os << m.counter->value();
+            }
+            else if(m.gauge != 0) {
+                os << m.gauge->value();
+            }
+            else {
+                os << m.probe(m.arg);
+            }
+            os << "\n";
+        }
+    }
+    return os.str();
+}
+
+
+/**
+ * Return label pair
+ */
+std::string Metrics_Registry::label(const std::string& name,
+    const std::string& value)
+{
+    std::string s = name + "=\"";
+    for(size_t i = 0; i < value.size(); ++i) {
+        if(value[i] == '\\' || value[i] == '"') {
+            s += '\\';
+            s += value[i];
+        }
+        else if(value[i] == '\n') {
+            s += "\\n";
+        }
+        else {
+            s += value[i];
+        }
+    }
+    return s + "\"";
+}
+
+
+/**
+ * Return metric
+ */
+Metrics_Registry::Metric* Metrics_Registry::find(const std::string& name,
+    const std::string& labels)
+{
+    for(size_t i = 0; i < metrics.size(); ++i) {
+        if(metrics[i]->name == name && metrics[i]->labels == labels) {
+            return metrics[i];
+        }
+    }
+    return 0;
+}
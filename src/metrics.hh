@@ -0,0 +1,197 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Registry of runtime metrics, which are exported in the Prometheus text
+ * format (see metrics_exporter.hh)
+ */
+#ifndef METRICS_HH
+#define METRICS_HH
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <stdint.h>
+#include "latency_histogram.hh"
+
+
+enum metric_type_t
+{
+    METRIC_COUNTER = 0,
+    METRIC_GAUGE = 1,
+    METRIC_SUMMARY = 2
+};
+
+
+/**
+ * Monotonically increasing counter, which is updated with relaxed atomics
+ */
+class Metric_Counter
+{
+    public:
+        Metric_Counter();
+        
+        /**
+         * Increase counter
+         * \param n increment
+         */
+        void add(uint64_t n=1);
+        
+        /**
+         * Return value
+         */
+        uint64_t value() const;
+        
+    private:
+        std::atomic<uint64_t> v;
+};
+
+
+/**
+ * Gauge holding the last set value, which is updated with relaxed atomics
+ */
+class Metric_Gauge
+{
+    public:
+        Metric_Gauge();
+        
+        /**
+         * Set value
+         */
+        void set(double value);
+        
+        /**
+         * Return value
+         */
+        double value() const;
+        
+    private:
+        
+        // bit pattern of the double value
+        std::atomic<uint64_t> bits;
+};
+
+
+/**
+ * This class owns the counters and gauges of the program and references
+ * further values, which are read by a probe function (e.g. statistics of
+ * other classes) or taken from a latency histogram when exporting. Counters
+ * and gauges are created once and kept until exit, so that the hot paths only
+ * update atomics.
+ */
+class Metrics_Registry
+{
+    public:
+        
+        /**
+         * Return registry of the program
+         */
+        static Metrics_Registry& instance();
+        
+        /**
+         * Return counter, which is created on first use
+         * \param name metric name
+         * \param help description
+         * \param labels label pairs, e.g. `device="1-2"` (see `label()`)
+         */
+        Metric_Counter& counter(const std::string& name,
+            const std::string& help, const std::string& labels="");
+        
+        /**
+         * Return gauge, which is created on first use
+         * \param name metric name
+         * \param help description
+         * \param labels label pairs
+         */
+        Metric_Gauge& gauge(const std::string& name, const std::string& help,
+            const std::string& labels="");
+        
+        /**
+         * Add value, which is read by calling a function when exporting
+         * \param name metric name
+         * \param help description
+         * \param labels label pairs
+         * \param type counter or gauge
+         * \param probe function returning the current value
+         * \param arg argument passed to the probe function
+         */
+        void probe(const std::string& name, const std::string& help,
+            const std::string& labels, metric_type_t type,
+            double (*probe)(const void*), const void* arg);
+        
+        /**
+         * Add latency histogram, which is exported as summary in s
+         * \param name metric name
+         * \param help description
+         * \param labels label pairs
+         * \param hist histogram
+         */
+        void summary(const std::string& name, const std::string& help,
+            const std::string& labels, const Latency_Histogram* hist);
+        
+        /**
+         * Remove probes and summaries referencing an object
+         * \param arg argument of the probe function or histogram
+         */
+        void remove(const void* arg);
+        
+        /**
+         * Return all metrics in the Prometheus text format
+         */
+        std::string exposition();
+        
+        /**
+         * Return label pair with escaped value
+         * \param name label name
+         * \param value label value
+         */
+        static std::string label(const std::string& name,
+            const std::string& value);
+        
+    private:
+        Metrics_Registry();
+        ~Metrics_Registry();
+        
+        /**
+         * A single time series
+         */
+        struct Metric
+        {
+            std::string name;
+            std::string help;
+            std::string labels;
+            metric_type_t type;
+            Metric_Counter* counter;
+            Metric_Gauge* gauge;
+            double (*probe)(const void*);
+            const void* arg;
+        };
+        
+        /**
+         * Return existing metric or 0
+         */
+        Metric* find(const std::string& name, const std::string& labels);
+        
+        // registered metrics in order of registration
+        std::vector<Metric*> metrics;
+        
+        // guards `metrics`
+        std::mutex mutex;
+};
+#endif
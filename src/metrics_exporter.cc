@@ -0,0 +1,187 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "metrics_exporter.hh"
+#include "socket_listen.hh"
+#include <stdexcept>
+#include <iostream>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <time.h>
+
+
+/**
+ * Return monotonic time in ms
+ */
+static int64_t now_ms()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (int64_t)t.tv_sec*1000 + t.tv_nsec/1000000;
+}
+
+
+/**
+ * Start exporting
+ */
+Metrics_Exporter::Metrics_Exporter(Metrics_Registry& registry,
+    const std::string& address, const std::string& file, int interval) :
+    registry(registry), sfd(-1), file(file), interval(interval)
+{
+    if(!address.empty()) {
+        sfd = socket_listen(address, socket_path);
+    }
+    if(pipe(wake) != 0) {
+        if(sfd >= 0) {
+            close(sfd);
+        }
+        throw std::runtime_error("Creating pipe failed");
+    }
+    thread = std::thread(&Metrics_Exporter::run, this);
+}
+
+
+/**
+ * Stop exporting
+ */
+Metrics_Exporter::~Metrics_Exporter()
+{
+    char c = 0;
+    if(write(wake[1], &c, 1) != 1) {
+        std::cerr << "Stopping metrics exporter failed\n";
+    }
+    thread.join();
+    close(wake[0]);
+    close(wake[1]);
+    if(sfd >= 0) {
+        close(sfd);
+    }
+    if(!socket_path.empty()) {
+        unlink(socket_path.c_str());
+    }
+    if(!file.empty()) {
+        write_file();
+    }
+}
+
+
+/**
+ * Answer client
+ */
+void Metrics_Exporter::serve(int fd)
+{
+    // wait shortly for a request, clients of the plain format send nothing
+    char req[1024];
+    ssize_t n = 0;
+    pollfd p = {fd, POLLIN, 0};
+    if(poll(&p, 1, 100) == 1) {
+        n = read(fd, req, sizeof(req));
+    }
+    std::string body = registry.exposition();
+    std::string msg;
+    if(n >= 4 && strncmp(req, "GET ", 4) == 0) {
+        char header[160];
+        snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: %zu\r\nConnection: close\r\n\r\n", body.size());
+        msg = header;
+    }
+    msg += body;
+    
+    // a client, which does not read, blocks the exporter at most 1 s
+    timeval tv = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    size_t done = 0;
+    while(done < msg.size()) {
+        ssize_t r = send(fd, msg.data()+done, msg.size()-done, MSG_NOSIGNAL);
+        if(r <= 0) {
+            break;
+        }
+        done += r;
+    }
+    close(fd);
+}
+
+
+/**
+ * Write stats file
+ */
+void Metrics_Exporter::write_file()
+{
+    std::string tmp = file + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+    if(fd < 0) {
+        return;
+    }
+    std::string body = registry.exposition();
+    size_t done = 0;
+    while(done < body.size()) {
+        ssize_t r = write(fd, body.data()+done, body.size()-done);
+        if(r < 0 && errno == EINTR) {
+            continue;
+        }
+        if(r <= 0) {
+            break;
+        }
+        done += r;
+    }
+    close(fd);
+    if(done != body.size() || rename(tmp.c_str(), file.c_str()) != 0) {
+        unlink(tmp.c_str());
+    }
+}
+
+
+/**
+ * Exporter thread
+ */
+void Metrics_Exporter::run()
+{
+    pollfd fds[2] = {{wake[0], POLLIN, 0}, {sfd, POLLIN, 0}};
+    int nfds = (sfd >= 0) ? 2 : 1;
+    int64_t t_next = 0;
+    while(true) {
+        int timeout = -1;
+        if(!file.empty()) {
+            int64_t t = now_ms();
+            if(t >= t_next) {
+                write_file();
+                t_next = t + interval;
+            }
+            timeout = t_next - t;
+        }
+        int r = poll(fds, nfds, timeout);
+        if(r < 0 && errno != EINTR) {
+            break;
+        }
+        if(fds[0].revents != 0) {
+            break;
+        }
+        if(nfds == 2 && (fds[1].revents & POLLIN) != 0) {
+            int fd = accept4(sfd, 0, 0, SOCK_CLOEXEC);
+            if(fd >= 0) {
+                serve(fd);
+            }
+        }
+    }
+}
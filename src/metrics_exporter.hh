@@ -0,0 +1,92 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Export of the metrics registry for monitoring systems
+ */
+#ifndef METRICS_EXPORTER_HH
+#define METRICS_EXPORTER_HH
+
+#include <string>
+#include <thread>
+#include "metrics.hh"
+
+
+/**
+ * This class serves the metrics in the Prometheus text format from a
+ * background thread. Clients connect either to a Unix socket or a TCP port
+ * and send an HTTP GET request (e.g. `curl --unix-socket <path> http://x/`),
+ * or send nothing and read the plain text. Additionally, a stats file is
+ * rewritten periodically by writing a temporary file and renaming it, so that
+ * readers always see a complete file.
+ */
+class Metrics_Exporter
+{
+    public:
+        
+        /**
+         * Start exporting
+         * \param registry exported registry
+         * \param address path of a Unix socket (contains '/'), TCP port on
+         *                the loopback interface or `host:port` ("" = none)
+         * \param file path of the stats file ("" = none)
+         * \param interval time between rewrites of the stats file in ms
+         */
+        Metrics_Exporter(Metrics_Registry& registry,
+            const std::string& address, const std::string& file="",
+            int interval=1000);
+        
+        /**
+         * Stop exporting, write stats file a last time and remove the socket
+         */
+        ~Metrics_Exporter();
+        
+    private:
+        
+        /**
+         * Answer a single client
+         */
+        void serve(int fd);
+        
+        /**
+         * Write stats file atomically
+         */
+        void write_file();
+        
+        /**
+         * Exporter thread
+         */
+        void run();
+        
+        Metrics_Registry& registry;
+        
+        // listening socket (-1 = none) and path of a Unix socket
+        int sfd;
+        std::string socket_path;
+        
+        // stats file and time between rewrites in ms
+        std::string file;
+        int interval;
+        
+        // pipe waking the exporter thread for stopping
+        int wake[2];
+        
+        // exporter thread
+        std::thread thread;
+};
+#endif
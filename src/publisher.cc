@@ -0,0 +1,308 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "publisher.hh"
+#include "socket_listen.hh"
+#include <stdexcept>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+/**
+ * Start publisher
+ */
+Publisher::Publisher(const std::vector<std::string>& addresses,
+    size_t buffer) : buffer(buffer), efd(-1), wake(-1), stopping(false)
+{
+    Metrics_Registry& reg = Metrics_Registry::instance();
+    m_published = &reg.counter("ut61b_published_total",
+        "Readings sent to subscribers");
+    m_bytes = &reg.counter("ut61b_published_bytes_total",
+        "Bytes queued for subscribers");
+    m_dropped = &reg.counter("ut61b_subscribers_dropped_total",
+        "Subscribers disconnected for not reading fast enough");
+    m_subscribers = &reg.gauge("ut61b_subscribers", "Connected subscribers");
+    
+    efd = epoll_create1(EPOLL_CLOEXEC);
+    wake = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+    if(efd < 0 || wake < 0) {
+        throw std::runtime_error("Creating epoll instance failed");
+    }
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = 0;
+    epoll_ctl(efd, EPOLL_CTL_ADD, wake, &ev);
+    
+    try {
+        for(size_t i = 0; i < addresses.size(); ++i) {
+            Listener l;
+            std::string address = addresses[i];
+            l.format = PUBLISH_JSON;
+            if(address.compare(0, 5, "json:") == 0) {
+                address = address.substr(5);
+            }
+            else if(address.compare(0, 4, "bin:") == 0) {
+                l.format = PUBLISH_BINARY;
+                address = address.substr(4);
+            }
+            l.fd = socket_listen(address, l.path);
+            listeners.push_back(l);
+        }
+    } catch(std::exception&) {
+        for(size_t i = 0; i < listeners.size(); ++i) {
+            close(listeners[i].fd);
+        }
+        close(efd);
+        close(wake);
+        throw;
+    }
+    
+    // listeners are identified by their index + 1, subscribers by pointer
+    for(size_t i = 0; i < listeners.size(); ++i) {
+        ev.events = EPOLLIN;
+        ev.data.u64 = i+1;
+        epoll_ctl(efd, EPOLL_CTL_ADD, listeners[i].fd, &ev);
+    }
+    thread = std::thread(&Publisher::run, this);
+}
+
+
+/**
+ * Stop publisher
+ */
+Publisher::~Publisher()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    uint64_t one = 1;
+    if(write(wake, &one, sizeof(one)) != sizeof(one)) {
+        // thread wakes up anyway within its poll interval
+    }
+    thread.join();
+    for(size_t i = 0; i < subs.size(); ++i) {
+        close(subs[i]->fd);
+        delete subs[i];
+    }
+    for(size_t i = 0; i < listeners.size(); ++i) {
+        close(listeners[i].fd);
+        if(!listeners[i].path.empty()) {
+            unlink(listeners[i].path.c_str());
+        }
+    }
+    close(efd);
+    close(wake);
+}
+
+
+/**
+ * Return number of subscribers
+ */
+size_t Publisher::subscribers()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return subs.size();
+}
+
+
+/**
+ * Send reading to all subscribers
+ */
+void Publisher::publish(const char* device, int64_t time,
+    const char* frame, const Reading& r)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if(subs.empty()) {
+        return;
+    }
+    
+    // encode lazily, only formats with subscribers
+    char buf[2][ENCODER_MAX];
+    size_t len[2] = {0, 0};
+    for(size_t i = 0; i < subs.size(); ++i) {
+        Subscriber* s = subs[i];
+        int f = (s->format == PUBLISH_JSON) ? 0 : 1;
+        if(len[f] == 0) {
+            const Encoder& e = (f == 0) ? (const Encoder&)json
+                : (const Encoder&)binary;
+            len[f] = e.encode(buf[f], device, time, frame, r);
+        }
+        
+        // slow subscribers are dropped by the publisher thread
+        size_t n = len[f];
+        if(s->overrun || s->out.size() + n > buffer) {
+            s->overrun = true;
+            continue;
+        }
+        s->out.append(buf[f], n);
+        m_bytes->add(n);
+    }
+    m_published->add();
+    uint64_t one = 1;
+    if(write(wake, &one, sizeof(one)) != sizeof(one)) {
+        // counter is already signalled
+    }
+}
+
+
+/**
+ * Accept subscriber
+ */
+void Publisher::accept(const Listener& l)
+{
+    int fd = accept4(l.fd, 0, 0, SOCK_NONBLOCK|SOCK_CLOEXEC);
+    if(fd < 0) {
+        return;
+    }
+    Subscriber* s = new Subscriber;
+    s->fd = fd;
+    s->format = l.format;
+    s->waiting = false;
+    s->overrun = false;
+    s->out.reserve(buffer);
+    
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN|EPOLLRDHUP;
+    ev.data.ptr = s;
+    epoll_ctl(efd, EPOLL_CTL_ADD, fd, &ev);
+    subs.push_back(s);
+    m_subscribers->set(subs.size());
+}
+
+
+/**
+ * Send buffered data
+ */
+bool Publisher::flush(Subscriber* s)
+{
+    size_t done = 0;
+    while(done < s->out.size()) {
+        ssize_t r = send(s->fd, s->out.data()+done, s->out.size()-done,
+            MSG_NOSIGNAL|MSG_DONTWAIT);
+        if(r < 0 && errno == EINTR) {
+            continue;
+        }
+        if(r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if(r <= 0) {
+            return false;
+        }
+        done += r;
+    }
+    s->out.erase(0, done);
+    
+    // wait for writability only while data is pending
+    bool waiting = !s->out.empty();
+    if(waiting != s->waiting) {
+        epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN|EPOLLRDHUP|(waiting ? (uint32_t)EPOLLOUT : 0);
+        ev.data.ptr = s;
+        epoll_ctl(efd, EPOLL_CTL_MOD, s->fd, &ev);
+        s->waiting = waiting;
+    }
+    return true;
+}
+
+
+/**
+ * Disconnect subscriber
+ */
+void Publisher::drop(Subscriber* s)
+{
+    epoll_ctl(efd, EPOLL_CTL_DEL, s->fd, 0);
+    close(s->fd);
+    for(size_t i = 0; i < subs.size(); ++i) {
+        if(subs[i] == s) {
+            subs.erase(subs.begin()+i);
+            break;
+        }
+    }
+    delete s;
+    m_subscribers->set(subs.size());
+}
+
+
+/**
+ * Publisher thread
+ */
+void Publisher::run()
+{
+    epoll_event events[64];
+    std::vector<Subscriber*> gone;
+    while(true) {
+        int n = epoll_wait(efd, events, 64, 1000);
+        if(n < 0 && errno != EINTR) {
+            break;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if(stopping) {
+            break;
+        }
+        gone.clear();
+        for(int i = 0; i < n; ++i) {
+            if(events[i].data.ptr == 0) {
+                uint64_t cnt;
+                if(read(wake, &cnt, sizeof(cnt)) < 0) {
+                    // already reset
+                }
+                continue;
+            }
+            if(events[i].data.u64 <= listeners.size()) {
+                accept(listeners[events[i].data.u64-1]);
+                continue;
+            }
+            
+            // subscribers only send to close the connection
+            Subscriber* s = (Subscriber*)events[i].data.ptr;
+            if(events[i].events & (EPOLLIN|EPOLLRDHUP|EPOLLHUP|EPOLLERR)) {
+                char buf[256];
+                ssize_t r = recv(s->fd, buf, sizeof(buf), MSG_DONTWAIT);
+                if(r == 0 || (r < 0 && errno != EAGAIN && errno != EINTR)) {
+                    gone.push_back(s);
+                }
+            }
+        }
+        for(size_t i = 0; i < gone.size(); ++i) {
+            drop(gone[i]);
+        }
+        
+        // send pending data, drop subscribers whose buffer ran full
+        for(size_t i = 0; i < subs.size(); ) {
+            Subscriber* s = subs[i];
+            if(s->overrun) {
+                m_dropped->add();
+                drop(s);
+                continue;
+            }
+            if(!flush(s)) {
+                drop(s);
+                continue;
+            }
+            ++i;
+        }
+    }
+}
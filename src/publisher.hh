@@ -0,0 +1,168 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Publisher streaming decoded readings to network and local subscribers
+ */
+#ifndef PUBLISHER_HH
+#define PUBLISHER_HH
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <stdint.h>
+#include "fs9922_dmm3.hh"
+#include "metrics.hh"
+#include "encoder.hh"
+
+
+enum publish_format_t
+{
+    PUBLISH_JSON = 0,
+    PUBLISH_BINARY = 1
+};
+
+
+/**
+ * This class accepts subscribers on several listening sockets and sends
+ * every published reading to all of them, either as line of JSON (one
+ * object per line) or as binary record (see Shm_Record in shm_ring.hh), depending on the
+ * socket. All sockets
+ * are serviced by an epoll loop in a background thread. Each subscriber has a
+ * bounded send buffer; a subscriber, which does not read fast enough to keep
+ * its buffer below the bound, is disconnected instead of delaying capturing
+ * or the other subscribers.
+ */
+class Publisher
+{
+    public:
+        
+        /**
+         * Start publisher
+         * \param addresses listening addresses: Unix socket path, TCP port
+         *                  on the loopback interface or `host:port`, each
+         *                  optionally prefixed by "json:" (default) or "bin:"
+         * \param buffer maximum number of buffered bytes per subscriber
+         */
+        Publisher(const std::vector<std::string>& addresses,
+            size_t buffer=65536);
+        
+        /**
+         * Disconnect subscribers and close listening sockets
+         */
+        ~Publisher();
+        
+        /**
+         * Send reading to all subscribers without blocking
+         * \param device path of the adapter
+         * \param time wall-clock time in ns since epoch
+         * \param frame raw frame
+         * \param r decoded frame
+         */
+        void publish(const char* device, int64_t time,
+            const char* frame, const Reading& r);
+        
+        /**
+         * Return number of connected subscribers
+         */
+        size_t subscribers();
+        
+    private:
+        
+        /**
+         * Listening socket
+         */
+        struct Listener
+        {
+            int fd;
+            publish_format_t format;
+            
+            // path of a Unix socket
+            std::string path;
+        };
+        
+        /**
+         * Connected subscriber
+         */
+        struct Subscriber
+        {
+            int fd;
+            publish_format_t format;
+            
+            // unsent data and whether writability is awaited
+            std::string out;
+            bool waiting;
+            
+            // flag whether a reading did not fit into the buffer
+            bool overrun;
+        };
+        
+        /**
+         * Accept new subscriber
+         */
+        void accept(const Listener& l);
+        
+        /**
+         * Send buffered data, return false if the subscriber is gone
+         */
+        bool flush(Subscriber* s);
+        
+        /**
+         * Disconnect subscriber
+         */
+        void drop(Subscriber* s);
+        
+        /**
+         * Publisher thread
+         */
+        void run();
+        
+        // listening sockets
+        std::vector<Listener> listeners;
+        
+        // connected subscribers
+        std::vector<Subscriber*> subs;
+        
+        // maximum number of buffered bytes per subscriber
+        size_t buffer;
+        
+        // epoll instance and eventfd waking the publisher thread
+        int efd;
+        int wake;
+        
+        // flag whether the thread has to stop
+        bool stopping;
+        
+        // guards `subs` and `stopping`
+        std::mutex mutex;
+        
+        // publisher thread
+        std::thread thread;
+        
+        // encoders of the formats
+        Json_Encoder json;
+        Binary_Encoder binary;
+        
+        // metrics
+        Metric_Counter* m_published;
+        Metric_Counter* m_bytes;
+        Metric_Counter* m_dropped;
+        Metric_Gauge* m_subscribers;
+};
+#endif
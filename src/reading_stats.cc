@@ -0,0 +1,242 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "reading_stats.hh"
+#include <cmath>
+#include <algorithm>
+#include <stdio.h>
+
+
+Running_Stats::Running_Stats() : n(0), vmin(NAN), vmax(NAN), vmean(0), m2(0),
+    sq(0)
+{
+}
+
+
+/**
+ * Add value
+ */
+void Running_Stats::add(double v)
+{
+    n++;
+    if(n == 1 || v < vmin) {
+        vmin = v;
+    }
+    if(n == 1 || v > vmax) {
+        vmax = v;
+    }
+    double d = v - vmean;
+    vmean += d/n;
+    m2 += d*(v - vmean);
+    sq += v*v;
+}
+
+
+uint64_t Running_Stats::count() const
+{
+    return n;
+}
+
+
+double Running_Stats::min() const
+{
+    return vmin;
+}
+
+
+double Running_Stats::max() const
+{
+    return vmax;
+}
+
+
+double Running_Stats::mean() const
+{
+    return (n > 0) ? vmean : NAN;
+}
+
+
+double Running_Stats::variance() const
+{
+    return (n > 1) ? m2/(n-1) : 0;
+}
+
+
+double Running_Stats::stddev() const
+{
+    return std::sqrt(variance());
+}
+
+
+double Running_Stats::rms() const
+{
+    return (n > 0) ? std::sqrt(sq/n) : NAN;
+}
+
+
+/**
+ * Create window
+ */
+Window_Stats::Window_Stats(double window) : window(window), sum(0), sq(0)
+{
+}
+
+
+/**
+ * Add value
+ */
+void Window_Stats::add(double time, double v)
+{
+    Sample s = {time, v};
+    values.push_back(s);
+    sum += v;
+    sq += v*v;
+    while(!mins.empty() && mins.back().value >= v) {
+        mins.pop_back();
+    }
+    mins.push_back(s);
+    while(!maxs.empty() && maxs.back().value <= v) {
+        maxs.pop_back();
+    }
+    maxs.push_back(s);
+    
+    // expire old values
+    while(values.front().time <= time - window) {
+        double old = values.front().value;
+        sum -= old;
+        sq -= old*old;
+        values.pop_front();
+        if(mins.front().time <= time - window) {
+            mins.pop_front();
+        }
+        if(maxs.front().time <= time - window) {
+            maxs.pop_front();
+        }
+    }
+    
+    // avoid drift of the sums, when the window starts anew
+    if(values.size() == 1) {
+        sum = v;
+        sq = v*v;
+    }
+}
+
+
+double Window_Stats::length() const
+{
+    return window;
+}
+
+
+size_t Window_Stats::count() const
+{
+    return values.size();
+}
+
+
+double Window_Stats::min() const
+{
+    return mins.empty() ? NAN : mins.front().value;
+}
+
+
+double Window_Stats::max() const
+{
+    return maxs.empty() ? NAN : maxs.front().value;
+}
+
+
+double Window_Stats::mean() const
+{
+    return values.empty() ? NAN : sum/values.size();
+}
+
+
+double Window_Stats::rms() const
+{
+    return values.empty() ? NAN
+        : std::sqrt(std::max(sq, 0.0)/values.size());
+}
+
+
+/**
+ * Create statistics
+ */
+Reading_Stats::Reading_Stats(double window) : window(window), last(0)
+{
+}
+
+
+/**
+ * Add reading
+ */
+const Mode_Stats* Reading_Stats::add(const char* device, double time,
+    const Reading& r)
+{
+    if(r.has(FLAG_OVERFLOW) || std::isinf(r.value)) {
+        return 0;
+    }
+    std::string mode = FS9922_DMM3::unit_prefix2str((unit_prefix_t)r.prefix)
+        + FS9922_DMM3::unit2str((unit_t)r.unit);
+    std::string power = FS9922_DMM3::power2str((power_t)r.power);
+    if(!power.empty()) {
+        mode += " " + power;
+    }
+    
+    // consecutive readings mostly share the mode
+    if(last >= modes.size() || modes[last].device != device
+        || modes[last].mode != mode) {
+        last = 0;
+        while(last < modes.size() && (modes[last].device != device
+            || modes[last].mode != mode)) {
+            last++;
+        }
+        if(last == modes.size()) {
+            Mode_Stats m;
+            m.device = device;
+            m.mode = mode;
+            m.window = Window_Stats(window);
+            modes.push_back(m);
+        }
+    }
+    Mode_Stats& m = modes[last];
+    m.total.add(r.value);
+    m.window.add(time, r.value);
+    return &m;
+}
+
+
+/**
+ * Write summary
+ */
+void Reading_Stats::summary(std::ostream& os) const
+{
+    if(modes.empty()) {
+        return;
+    }
+    os << "Statistics:\n";
+    for(size_t i = 0; i < modes.size(); ++i) {
+        const Mode_Stats& m = modes[i];
+        char s[256];
+        snprintf(s, sizeof(s), "  %s %s: %llu readings, min %g, max %g, "
+            "mean %g, stddev %g, rms %g\n", m.device.c_str(), m.mode.c_str(),
+            (unsigned long long)m.total.count(), m.total.min(),
+            m.total.max(), m.total.mean(), m.total.stddev(), m.total.rms());
+        os << s;
+    }
+}
@@ -0,0 +1,178 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Streaming statistics of the readings per adapter and measurement mode
+ */
+#ifndef READING_STATS_HH
+#define READING_STATS_HH
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <ostream>
+#include <stdint.h>
+#include "fs9922_dmm3.hh"
+
+
+/**
+ * This class accumulates count, minimum, maximum, mean, variance (Welford's
+ * algorithm) and root mean square of all values in constant time and space
+ */
+class Running_Stats
+{
+    public:
+        Running_Stats();
+        
+        /**
+         * Add value
+         */
+        void add(double v);
+        
+        uint64_t count() const;
+        double min() const;
+        double max() const;
+        double mean() const;
+        
+        /**
+         * Return sample variance
+         */
+        double variance() const;
+        double stddev() const;
+        double rms() const;
+        
+    private:
+        uint64_t n;
+        double vmin;
+        double vmax;
+        double vmean;
+        
+        // sum of squared deviations from the mean and sum of squares
+        double m2;
+        double sq;
+};
+
+
+/**
+ * This class aggregates the values of the last seconds. Minimum and maximum
+ * are kept in monotonic deques, so that each value costs amortized constant
+ * time.
+ */
+class Window_Stats
+{
+    public:
+        
+        /**
+         * Create window
+         * \param window length of the window in s
+         */
+        Window_Stats(double window=60);
+        
+        /**
+         * Add value
+         * \param time time of the value in s (increasing)
+         * \param v value
+         */
+        void add(double time, double v);
+        
+        /**
+         * Return length of the window in s
+         */
+        double length() const;
+        
+        size_t count() const;
+        double min() const;
+        double max() const;
+        double mean() const;
+        double rms() const;
+        
+    private:
+        struct Sample
+        {
+            double time;
+            double value;
+        };
+        
+        double window;
+        
+        // values in the window
+        std::deque<Sample> values;
+        
+        // candidates for minimum and maximum with increasing resp.
+        // decreasing values
+        std::deque<Sample> mins;
+        std::deque<Sample> maxs;
+        
+        // sums of the values and squares in the window
+        double sum;
+        double sq;
+};
+
+
+/**
+ * Statistics of a single measurement mode of an adapter
+ */
+struct Mode_Stats
+{
+    std::string device;
+    
+    // unit with prefix and power, e.g. "mV AC"
+    std::string mode;
+    
+    Running_Stats total;
+    Window_Stats window;
+};
+
+
+/**
+ * This class dispatches readings to the statistics of their adapter and
+ * measurement mode. Readings with overflow are not counted.
+ */
+class Reading_Stats
+{
+    public:
+        
+        /**
+         * Create statistics
+         * \param window length of the sliding window in s
+         */
+        Reading_Stats(double window=60);
+        
+        /**
+         * Add reading
+         * \param device path of the adapter
+         * \param time time of the reading in s
+         * \param r reading
+         * \return statistics of the mode of the reading or 0 on overflow
+         */
+        const Mode_Stats* add(const char* device, double time,
+            const Reading& r);
+        
+        /**
+         * Write summary of all modes
+         */
+        void summary(std::ostream& os) const;
+        
+    private:
+        double window;
+        std::vector<Mode_Stats> modes;
+        
+        // index of the mode of the last reading
+        size_t last;
+};
+#endif
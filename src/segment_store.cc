@@ -0,0 +1,465 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "segment_store.hh"
+#include <stdexcept>
+#include <algorithm>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+
+/**
+ * Create directory, if it does not exist
+ */
+static void make_dir(const std::string& path)
+{
+    if(mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) {
+        throw std::runtime_error("Creating directory " + path + " failed: "
+            + strerror(errno));
+    }
+}
+
+
+/**
+ * Return whether string ends with suffix
+ */
+static bool ends_with(const std::string& s, const std::string& suffix)
+{
+    return s.size() >= suffix.size()
+        && s.compare(s.size()-suffix.size(), suffix.size(), suffix) == 0;
+}
+
+
+/**
+ * Return names of the segments in a directory sorted by their start
+ * \param dir directory of an adapter
+ * \param part include segments being written
+ */
+static std::vector<std::string> list_segments(const std::string& dir,
+    bool part)
+{
+    std::vector<std::string> r;
+    DIR* d = opendir(dir.c_str());
+    if(d == 0) {
+        return r;
+    }
+    dirent* e;
+    while((e = readdir(d)) != 0) {
+        std::string name = e->d_name;
+        if(name.size() >= 19 && name.find_first_not_of("0123456789") == 19
+            && (ends_with(name, ".col")
+            || (part && ends_with(name, ".col.part")))) {
+            r.push_back(name);
+        }
+    }
+    closedir(d);
+    std::sort(r.begin(), r.end());
+    return r;
+}
+
+
+/**
+ * Return path of the index of a segment
+ */
+static std::string index_path(const std::string& path)
+{
+    std::string r = path;
+    r.replace(r.rfind(".col"), 4, ".idx");
+    return r;
+}
+
+
+/**
+ * Complete segments left behind by a crash
+ */
+static void complete_segments(const std::string& dir)
+{
+    std::vector<std::string> names = list_segments(dir, true);
+    for(size_t i = 0; i < names.size(); ++i) {
+        if(!ends_with(names[i], ".part")) {
+            continue;
+        }
+        std::string path = dir + "/" + names[i];
+        std::string name = path.substr(0, path.size()-5);
+        rename(index_path(path).c_str(), index_path(name).c_str());
+        rename(path.c_str(), name.c_str());
+    }
+}
+
+
+/**
+ * Open store
+ */
+Segment_Store::Segment_Store(const std::string& dir, double length,
+    uint64_t size, size_t keep, fsync_t sync, int sync_interval) : dir(dir),
+    length((int64_t)(length*1e9)), size(size), keep(keep), sync(sync),
+    sync_interval(sync_interval), stopping(false)
+{
+    make_dir(dir);
+    thread = std::thread(&Segment_Store::finalise, this);
+}
+
+
+/**
+ * Complete all segments
+ */
+Segment_Store::~Segment_Store()
+{
+    for(size_t i = 0; i < channels.size(); ++i) {
+        close(channels[i]);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cond.notify_one();
+    thread.join();
+}
+
+
+/**
+ * Return name of subdirectory
+ */
+std::string Segment_Store::channel(const std::string& device)
+{
+    std::string r = device;
+    std::replace(r.begin(), r.end(), '/', '_');
+    size_t first = r.find_first_not_of('_');
+    return (first == std::string::npos) ? "_" : r.substr(first);
+}
+
+
+/**
+ * Write record
+ */
+void Segment_Store::write(const char* device, int64_t time,
+    const char* frame, const Reading& r)
+{
+    size_t i = 0;
+    while(i < channels.size() && channels[i].device != device) {
+        i++;
+    }
+    if(i == channels.size()) {
+        Channel c;
+        c.device = device;
+        c.dir = dir + "/" + channel(device);
+        c.start = 0;
+        c.out = 0;
+        c.index = 0;
+        c.col = 0;
+        make_dir(c.dir);
+        complete_segments(c.dir);
+        channels.push_back(c);
+    }
+    Channel& c = channels[i];
+    if(c.col != 0 && (time - c.start >= length || c.col->size() >= size)) {
+        close(c);
+    }
+    if(c.col == 0) {
+        open(c, time);
+    }
+    c.col->write((time > c.start) ? time - c.start : 0, frame, r);
+}
+
+
+/**
+ * Write marker
+ */
+void Segment_Store::mark(const char* device, int64_t time, bool connected)
+{
+    // an adapter without segment has no records a gap could follow
+    for(size_t i = 0; i < channels.size(); ++i) {
+        Channel& c = channels[i];
+        if(c.device == device && c.col != 0) {
+            c.col->mark((time > c.start) ? time - c.start : 0, connected);
+        }
+    }
+}
+
+
+/**
+ * Write expired blocks
+ */
+void Segment_Store::expire(int64_t time)
+{
+    for(size_t i = 0; i < channels.size(); ++i) {
+        Channel& c = channels[i];
+        if(c.col != 0 && time > c.start) {
+            c.col->expire(time - c.start);
+        }
+    }
+}
+
+
+/**
+ * Start segment
+ */
+void Segment_Store::open(Channel& c, int64_t time)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%019lld", (long long)time);
+    c.name = c.dir + "/" + name;
+    c.start = time;
+    c.out = new Log_Writer(c.name + ".col.part", sync, sync_interval);
+    c.index = new Log_Writer(c.name + ".idx.part", sync, sync_interval);
+    
+    // small blocks keep the index fine-grained for range queries
+    c.col = new Column_Writer(*c.out, 4096, 60, time);
+    c.col->set_index(c.index);
+}
+
+
+/**
+ * Hand segment over
+ */
+void Segment_Store::close(Channel& c)
+{
+    if(c.col == 0) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(c);
+    }
+    cond.notify_one();
+    c.col = 0;
+    c.out = 0;
+    c.index = 0;
+}
+
+
+/**
+ * Finaliser thread
+ */
+void Segment_Store::finalise()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true) {
+        cond.wait(lock, [this] { return stopping || !pending.empty(); });
+        if(pending.empty()) {
+            return;
+        }
+        Segment s = pending.front();
+        pending.pop_front();
+        lock.unlock();
+        complete(s);
+        lock.lock();
+    }
+}
+
+
+/**
+ * Complete segment
+ */
+void Segment_Store::complete(Segment& s)
+{
+    delete s.col;
+    s.out->close();
+    s.index->close();
+    delete s.out;
+    delete s.index;
+    
+    // readers find the segment either with or without suffix
+    rename((s.name + ".idx.part").c_str(), (s.name + ".idx").c_str());
+    rename((s.name + ".col.part").c_str(), (s.name + ".col").c_str());
+    expire(s.dir);
+}
+
+
+/**
+ * Remove expired segments
+ */
+void Segment_Store::expire(const std::string& dir)
+{
+    if(keep == 0) {
+        return;
+    }
+    std::vector<std::string> names = list_segments(dir, false);
+    for(size_t i = 0; i + keep < names.size(); ++i) {
+        std::string path = dir + "/" + names[i];
+        unlink(index_path(path).c_str());
+        unlink(path.c_str());
+    }
+}
+
+
+/**
+ * Open store
+ */
+Segment_Query::Segment_Query(const std::string& dir) : dir(dir),
+    n_segments(0), n_blocks(0)
+{
+    struct stat st;
+    if(stat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        throw std::runtime_error("Invalid store " + dir);
+    }
+}
+
+
+/**
+ * Return names of subdirectories
+ */
+std::vector<std::string> Segment_Query::channels() const
+{
+    std::vector<std::string> r;
+    DIR* d = opendir(dir.c_str());
+    if(d == 0) {
+        return r;
+    }
+    dirent* e;
+    while((e = readdir(d)) != 0) {
+        struct stat st;
+        std::string name = e->d_name;
+        if(name[0] != '.' && stat((dir + "/" + name).c_str(), &st) == 0
+            && S_ISDIR(st.st_mode)) {
+            r.push_back(name);
+        }
+    }
+    closedir(d);
+    std::sort(r.begin(), r.end());
+    return r;
+}
+
+
+/**
+ * Read records in a time range
+ */
+void Segment_Query::read(const std::string& channel, int64_t from,
+    int64_t to, void (*callback)(const Column_Row&, void*), void* arg)
+{
+    std::string path = dir + "/" + channel;
+    std::vector<std::string> names = list_segments(path, true);
+    for(size_t i = 0; i < names.size(); ++i) {
+        
+        // the records of a segment precede the start of the next one
+        int64_t start = atoll(names[i].substr(0, 19).c_str());
+        if(start > to) {
+            break;
+        }
+        if(i+1 < names.size()
+            && atoll(names[i+1].substr(0, 19).c_str()) <= from) {
+            continue;
+        }
+        read_segment(path + "/" + names[i], from, to, callback, arg);
+    }
+}
+
+
+/**
+ * Read blocks of a segment
+ */
+void Segment_Query::read_segment(const std::string& path, int64_t from,
+    int64_t to, void (*callback)(const Column_Row&, void*), void* arg)
+{
+    if(!Column_Reader::probe(path)) {
+        return;
+    }
+    n_segments++;
+    
+    // without index, e.g. after a crash, the block headers are scanned
+    std::vector<Column_Index> index;
+    int fd = open(index_path(path).c_str(), O_RDONLY|O_CLOEXEC);
+    if(fd < 0) {
+        try {
+            Column_Reader reader(path);
+            int64_t start = reader.header().start_sec*1000000000
+                + reader.header().start_nsec;
+            for(size_t i = 0; i < reader.size(); ++i) {
+                const Column_Block& b = reader.block(i);
+                if(start + (int64_t)b.t_last < from
+                    || start + (int64_t)b.t_first > to) {
+                    continue;
+                }
+                Column_Index e;
+                e.t_first = start + b.t_first;
+                e.t_last = start + b.t_last;
+                e.offset = (const char*)&b - (const char*)&reader.header();
+                e.size = sizeof(b) + b.payload();
+                index.push_back(e);
+            }
+        } catch(std::exception&) {
+            return;
+        }
+    }
+    else {
+        Column_Index e;
+        while(::read(fd, &e, sizeof(e)) == sizeof(e)) {
+            if(e.t_last >= from && e.t_first <= to) {
+                index.push_back(e);
+            }
+        }
+        ::close(fd);
+    }
+    
+    fd = open(path.c_str(), O_RDONLY|O_CLOEXEC);
+    if(fd < 0) {
+        return;
+    }
+    Capture_Header h;
+    if(pread(fd, &h, sizeof(h), 0) != sizeof(h)) {
+        ::close(fd);
+        return;
+    }
+    int64_t start = h.start_sec*1000000000 + h.start_nsec;
+    for(size_t i = 0; i < index.size(); ++i) {
+        buf.resize(index[i].size);
+        if(pread(fd, &buf[0], buf.size(), index[i].offset)
+            != (ssize_t)buf.size()) {
+            break;
+        }
+        rows.clear();
+        try {
+            Column_Reader::decode(&buf[0], buf.size(), rows);
+        } catch(std::exception&) {
+            continue;
+        }
+        n_blocks++;
+        for(size_t k = 0; k < rows.size(); ++k) {
+            int64_t t = start + (int64_t)rows[k].time;
+            if(t < from || t > to) {
+                continue;
+            }
+            rows[k].time = t;
+            callback(rows[k], arg);
+        }
+    }
+    ::close(fd);
+}
+
+
+/**
+ * Return number of segments read
+ */
+size_t Segment_Query::segments_read() const
+{
+    return n_segments;
+}
+
+
+/**
+ * Return number of blocks read
+ */
+size_t Segment_Query::blocks_read() const
+{
+    return n_blocks;
+}
@@ -0,0 +1,236 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Segmented capture store
+ * 
+ * ------
+ * Layout:
+ * 
+ * The store is a directory with a subdirectory per adapter, named after the
+ * path of the adapter with slashes replaced by underscores. Each
+ * subdirectory holds segments in the compressed columnar format (see
+ * column_file.hh) with their sparse block index:
+ * 
+ *   <dir>/<adapter>/<start>.col   segment
+ *   <dir>/<adapter>/<start>.idx   index of the blocks of the segment
+ * 
+ * where <start> is the wall-clock time of the first record in ns since
+ * epoch as 19 digits, so that the names sort chronologically. Segments are
+ * written with the suffix ".part" appended, which is removed atomically via
+ * rename once the segment is complete. A segment is complete, when it
+ * reaches its maximum time span or size. Complete segments are flushed,
+ * synced and renamed by a background thread, so that rotating a segment
+ * does not delay the writer of the frames.
+ */
+#ifndef SEGMENT_STORE_HH
+#define SEGMENT_STORE_HH
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include "column_file.hh"
+
+
+/**
+ * This class writes the frames of all adapters into rotating segments
+ */
+class Segment_Store
+{
+    public:
+        
+        /**
+         * Open store, segments left behind by a crash are completed
+         * \param dir directory of the store
+         * \param length maximum time span of a segment in s
+         * \param size maximum size of a segment in bytes
+         * \param keep number of complete segments kept per adapter, older
+         *             segments are removed (0 = all)
+         * \param sync fsync policy of the segments
+         * \param sync_interval fsync interval in ms
+         */
+        Segment_Store(const std::string& dir, double length=3600,
+            uint64_t size=64<<20, size_t keep=0, fsync_t sync=FSYNC_NEVER,
+            int sync_interval=1000);
+        
+        /**
+         * Complete all segments and wait until they are finalised
+         */
+        ~Segment_Store();
+        
+        /**
+         * Write record of a single frame
+         * \param device path of the adapter
+         * \param time wall-clock time in ns since epoch
+         * \param frame raw frame data
+         * \param r decoded frame
+         */
+        void write(const char* device, int64_t time, const char* frame,
+            const Reading& r);
+        
+        /**
+         * Write marker of a lost or reconnected adapter into its current
+         * segment
+         * \param device path of the adapter
+         * \param time wall-clock time in ns since epoch
+         * \param connected whether the adapter was reconnected or lost
+         */
+        void mark(const char* device, int64_t time, bool connected);
+        
+        /**
+         * Write the collected records of each segment as block, whose
+         * maximum time span has passed
+         * \param time current wall-clock time in ns since epoch
+         */
+        void expire(int64_t time);
+        
+        /**
+         * Return name of the subdirectory of an adapter
+         */
+        static std::string channel(const std::string& device);
+        
+    private:
+        
+        /**
+         * Files of a segment
+         */
+        struct Segment
+        {
+            std::string dir;
+            std::string name;
+            Log_Writer* out;
+            Log_Writer* index;
+            Column_Writer* col;
+        };
+        
+        /**
+         * Segment being written for an adapter
+         */
+        struct Channel : Segment
+        {
+            std::string device;
+            int64_t start;
+        };
+        
+        /**
+         * Start new segment
+         */
+        void open(Channel& c, int64_t time);
+        
+        /**
+         * Hand segment over to the finaliser
+         */
+        void close(Channel& c);
+        
+        /**
+         * Finaliser thread, which completes segments and removes expired
+         * segments
+         */
+        void finalise();
+        
+        /**
+         * Complete segment
+         */
+        void complete(Segment& s);
+        
+        /**
+         * Remove the oldest complete segments beyond the retention limit
+         */
+        void expire(const std::string& dir);
+        
+        std::string dir;
+        int64_t length;
+        uint64_t size;
+        size_t keep;
+        fsync_t sync;
+        int sync_interval;
+        std::vector<Channel> channels;
+        
+        // segments waiting for the finaliser and flag whether it has to stop
+        std::deque<Segment> pending;
+        bool stopping;
+        
+        // guards `pending` and `stopping`
+        std::mutex mutex;
+        std::condition_variable cond;
+        
+        // finaliser thread
+        std::thread thread;
+};
+
+
+/**
+ * This class reads time ranges from a store. Segments outside the range are
+ * skipped by their names, blocks outside the range by the index, so that
+ * only the blocks overlapping the range are read.
+ */
+class Segment_Query
+{
+    public:
+        
+        /**
+         * Open store
+         * \param dir directory of the store
+         */
+        Segment_Query(const std::string& dir);
+        
+        /**
+         * Return names of the adapter subdirectories
+         */
+        std::vector<std::string> channels() const;
+        
+        /**
+         * Read records of an adapter in a time range
+         * \param channel name of the subdirectory of the adapter
+         * \param from start of the range in ns since epoch
+         * \param to end of the range in ns since epoch
+         * \param callback function called for each record in chronological
+         *                 order, with the time of the record in ns since
+         *                 epoch
+         * \param arg argument passed to the callback
+         */
+        void read(const std::string& channel, int64_t from, int64_t to,
+            void (*callback)(const Column_Row&, void*), void* arg);
+        
+        /**
+         * Return number of segments and blocks read so far
+         */
+        size_t segments_read() const;
+        size_t blocks_read() const;
+        
+    private:
+        
+        /**
+         * Read blocks of a segment in a time range
+         */
+        void read_segment(const std::string& path, int64_t from, int64_t to,
+            void (*callback)(const Column_Row&, void*), void* arg);
+        
+        std::string dir;
+        size_t n_segments;
+        size_t n_blocks;
+        
+        // buffers of a block and its records
+        std::vector<char> buf;
+        std::vector<Column_Row> rows;
+};
+#endif
@@ -0,0 +1,279 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shm_ring.hh"
+#include <stdexcept>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static_assert(sizeof(Shm_Record) == 168, "invalid record size");
+static_assert(sizeof(Shm_Header) == 128, "invalid header size");
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+    "shared memory requires lock-free 64 bit atomics");
+
+static const char MAGIC[8] = {'U', 'T', '6', '1', 'B', 'S', 'H', 'M'};
+
+
+/**
+ * Return name of the shared memory object starting with a slash
+ */
+static std::string shm_name(const std::string& name)
+{
+    return (!name.empty() && name[0] == '/') ? name : "/" + name;
+}
+
+
+/**
+ * Create ring
+ */
+Shm_Ring_Writer::Shm_Ring_Writer(const std::string& name, size_t capacity) :
+    name(shm_name(name))
+{
+    if(capacity == 0 || (capacity & (capacity-1)) != 0) {
+        throw std::runtime_error("Capacity of the ring has to be a power of "
+            "two");
+    }
+    size = sizeof(Shm_Header) + capacity*sizeof(Shm_Slot);
+    
+    // readers still attached to the object of a previous run keep their
+    // mapping of it, truncating it instead would raise SIGBUS in them
+    shm_unlink(this->name.c_str());
+    int fd = shm_open(this->name.c_str(), O_RDWR|O_CREAT|O_EXCL|O_CLOEXEC,
+        0644);
+    if(fd < 0) {
+        throw std::runtime_error("Creating shared memory " + this->name
+            + " failed: " + strerror(errno));
+    }
+    if(ftruncate(fd, size) != 0) {
+        std::string err = strerror(errno);
+        close(fd);
+        shm_unlink(this->name.c_str());
+        throw std::runtime_error("Resizing shared memory failed: " + err);
+    }
+    void* p = mmap(0, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED) {
+        shm_unlink(this->name.c_str());
+        throw std::runtime_error("Mapping shared memory failed");
+    }
+    
+    // the new object is zero filled, the magic is written last, so
+    // that readers never see a partial header
+    hdr = (Shm_Header*)p;
+    slots = (Shm_Slot*)((char*)p + sizeof(Shm_Header));
+    hdr->version = 2;
+    hdr->record_size = sizeof(Shm_Record);
+    hdr->capacity = capacity;
+    hdr->head.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(hdr->magic, MAGIC, sizeof(MAGIC));
+}
+
+
+/**
+ * Remove ring
+ */
+Shm_Ring_Writer::~Shm_Ring_Writer()
+{
+    munmap(hdr, size);
+    shm_unlink(name.c_str());
+}
+
+
+/**
+ * Append record
+ */
+void Shm_Ring_Writer::write(const Shm_Record& r)
+{
+    uint64_t n = hdr->head.load(std::memory_order_relaxed);
+    Shm_Slot& s = slots[n & (hdr->capacity-1)];
+    
+    // odd sequence number marks the slot as being written
+    s.seq.store(2*n+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&s.record, &r, sizeof(r));
+    s.seq.store(2*n+2, std::memory_order_release);
+    hdr->head.store(n+1, std::memory_order_release);
+}
+
+
+/**
+ * Attach to ring
+ */
+Shm_Ring_Reader::Shm_Ring_Reader(const std::string& name) : pos(0),
+    skipped(0)
+{
+    std::string n = shm_name(name);
+    int fd = shm_open(n.c_str(), O_RDONLY|O_CLOEXEC, 0);
+    if(fd < 0) {
+        throw std::runtime_error("Opening shared memory " + n + " failed: "
+            + strerror(errno));
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Shm_Header)) {
+        close(fd);
+        throw std::runtime_error("Invalid shared memory " + n);
+    }
+    size = st.st_size;
+    void* p = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED) {
+        throw std::runtime_error("Mapping shared memory failed");
+    }
+    hdr = (const Shm_Header*)p;
+    slots = (const Shm_Slot*)((const char*)p + sizeof(Shm_Header));
+    if(memcmp(hdr->magic, MAGIC, sizeof(MAGIC)) != 0 || hdr->version != 2
+        || hdr->record_size != sizeof(Shm_Record)
+        || size < sizeof(Shm_Header) + hdr->capacity*sizeof(Shm_Slot)) {
+        munmap(p, size);
+        throw std::runtime_error("Invalid shared memory " + n);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    pos = head();
+}
+
+
+/**
+ * Detach from ring
+ */
+Shm_Ring_Reader::~Shm_Ring_Reader()
+{
+    munmap((void*)hdr, size);
+}
+
+
+/**
+ * Return capacity
+ */
+uint64_t Shm_Ring_Reader::capacity() const
+{
+    return hdr->capacity;
+}
+
+
+/**
+ * Return number of written records
+ */
+uint64_t Shm_Ring_Reader::head() const
+{
+    return hdr->head.load(std::memory_order_acquire);
+}
+
+
+/**
+ * Read record by index
+ */
+shm_read_t Shm_Ring_Reader::read(uint64_t index, Shm_Record& r) const
+{
+    const Shm_Slot& s = slots[index & (hdr->capacity-1)];
+    uint64_t seq = s.seq.load(std::memory_order_acquire);
+    if(seq < 2*index+2) {
+        return SHM_PENDING;
+    }
+    if(seq > 2*index+2) {
+        return SHM_OVERRUN;
+    }
+    memcpy(&r, &s.record, sizeof(r));
+    
+    // the record is valid if the slot was not rewritten while copying
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(s.seq.load(std::memory_order_relaxed) != seq) {
+        return SHM_OVERRUN;
+    }
+    return SHM_OK;
+}
+
+
+/**
+ * Read latest record
+ */
+bool Shm_Ring_Reader::latest(Shm_Record& r) const
+{
+    while(true) {
+        uint64_t h = head();
+        if(h == 0) {
+            return false;
+        }
+        if(read(h-1, r) == SHM_OK) {
+            return true;
+        }
+    }
+}
+
+
+/**
+ * Set index of next record
+ */
+void Shm_Ring_Reader::seek(uint64_t index)
+{
+    pos = index;
+}
+
+
+/**
+ * Set index of next record to oldest record
+ */
+void Shm_Ring_Reader::rewind()
+{
+    uint64_t h = head();
+    pos = (h > hdr->capacity) ? h - hdr->capacity : 0;
+}
+
+
+/**
+ * Read next record
+ */
+bool Shm_Ring_Reader::next(Shm_Record& r)
+{
+    while(true) {
+        shm_read_t res = read(pos, r);
+        if(res == SHM_OK) {
+            pos++;
+            return true;
+        }
+        if(res == SHM_PENDING) {
+            return false;
+        }
+        
+        // continue with the oldest record, which is not overwritten soon
+        uint64_t h = head();
+        uint64_t oldest = h - hdr->capacity + hdr->capacity/8;
+        oldest = (h > hdr->capacity) ? oldest : 0;
+        if(oldest > pos) {
+            skipped += oldest - pos;
+            pos = oldest;
+        }
+        else {
+            skipped++;
+            pos++;
+        }
+    }
+}
+
+
+/**
+ * Return number of skipped records
+ */
+uint64_t Shm_Ring_Reader::lost() const
+{
+    return skipped;
+}
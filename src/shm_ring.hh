@@ -0,0 +1,219 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Ring of readings in named POSIX shared memory
+ * 
+ * A single writer (ut61b_cli with -s) appends fixed-size records to a ring in
+ * shared memory. Any number of readers map the ring read-only and read the
+ * latest record or walk the history without locks and without system calls.
+ * Each slot carries a sequence number, which is odd while the slot is
+ * written and encodes the index of the record it holds (seqlock), so that
+ * readers detect torn reads and records overwritten before they were read.
+ * 
+ * Memory layout: a 128 byte header followed by `capacity` slots of 176 bytes
+ * (sequence number and Shm_Record). The file is built as a small static
+ * library (build/libut61b_shm.a) for other programs.
+ */
+#ifndef SHM_RING_HH
+#define SHM_RING_HH
+
+#include <string>
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+
+
+// maximum length of the path of an adapter including the null terminator
+const size_t SHM_DEVICE_MAX = 128;
+
+
+/**
+ * Single reading (168 bytes)
+ */
+struct Shm_Record
+{
+    // wall-clock time in ns since epoch
+    int64_t time;
+    
+    // scaled and unscaled value
+    float value;
+    float value_unscaled;
+    
+    // unit, unit prefix and flags (see fs9922_dmm3.hh)
+    uint16_t unit;
+    uint16_t prefix;
+    uint16_t flags;
+    uint8_t power;
+    uint8_t minmax;
+    
+    // raw frame
+    char frame[14];
+    uint16_t reserved;
+    
+    // null terminated path of the adapter
+    char device[SHM_DEVICE_MAX];
+};
+
+
+enum shm_read_t
+{
+    // record was read
+    SHM_OK = 0,
+    
+    // record is not written yet
+    SHM_PENDING = 1,
+    
+    // record was overwritten before it could be read
+    SHM_OVERRUN = 2
+};
+
+
+/**
+ * Header of the shared memory ring
+ */
+struct Shm_Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t capacity;
+    
+    // number of records written so far
+    alignas(64) std::atomic<uint64_t> head;
+};
+
+
+/**
+ * Slot of the ring
+ */
+struct Shm_Slot
+{
+    // 2*index+1 while record `index` is written, 2*index+2 afterwards
+    std::atomic<uint64_t> seq;
+    Shm_Record record;
+};
+
+
+/**
+ * This class creates the shared memory ring and appends records
+ */
+class Shm_Ring_Writer
+{
+    public:
+        
+        /**
+         * Create ring
+         * \param name name of the shared memory object, e.g. "/ut61b"
+         * \param capacity number of records (power of two)
+         */
+        Shm_Ring_Writer(const std::string& name, size_t capacity=4096);
+        
+        /**
+         * Unmap and remove ring
+         */
+        ~Shm_Ring_Writer();
+        
+        /**
+         * Append record
+         */
+        void write(const Shm_Record& r);
+        
+    private:
+        std::string name;
+        Shm_Header* hdr;
+        Shm_Slot* slots;
+        size_t size;
+};
+
+
+/**
+ * This class attaches to an existing ring and reads records. Reading does not
+ * modify the shared memory, so readers do not influence each other.
+ */
+class Shm_Ring_Reader
+{
+    public:
+        
+        /**
+         * Attach to ring
+         * \param name name of the shared memory object
+         */
+        Shm_Ring_Reader(const std::string& name);
+        
+        /**
+         * Detach from ring
+         */
+        ~Shm_Ring_Reader();
+        
+        /**
+         * Return capacity of the ring
+         */
+        uint64_t capacity() const;
+        
+        /**
+         * Return number of records written so far
+         */
+        uint64_t head() const;
+        
+        /**
+         * Read record by index
+         * \param index index of the record since creation of the ring
+         * \param r destination of the record
+         */
+        shm_read_t read(uint64_t index, Shm_Record& r) const;
+        
+        /**
+         * Read latest record
+         * \return false if no record was written yet
+         */
+        bool latest(Shm_Record& r) const;
+        
+        /**
+         * Set index of the next record returned by `next()`
+         */
+        void seek(uint64_t index);
+        
+        /**
+         * Set index of the next record to the oldest available record
+         */
+        void rewind();
+        
+        /**
+         * Read next record and advance. Overwritten records are skipped and
+         * counted.
+         * \return false if no further record was written yet
+         */
+        bool next(Shm_Record& r);
+        
+        /**
+         * Return number of records skipped by `next()` because they were
+         * overwritten
+         */
+        uint64_t lost() const;
+        
+    private:
+        const Shm_Header* hdr;
+        const Shm_Slot* slots;
+        size_t size;
+        
+        // index of the next record and number of skipped records
+        uint64_t pos;
+        uint64_t skipped;
+};
+#endif
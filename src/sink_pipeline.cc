@@ -0,0 +1,467 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "sink_pipeline.hh"
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+
+/**
+ * Create sink and start its worker
+ */
+Sink::Sink(const std::string& name, sink_callback_t callback, void* arg,
+    overflow_t policy, size_t capacity, unsigned int sample) :
+    sink_name(name), callback(callback), arg(arg), overflow(policy),
+    sample(sample > 0 ? sample : 1),
+    queue(capacity > 0 ? capacity + SINK_STATE_RESERVE : 0), limit(capacity),
+    head(0), count(0),
+    high_water_mark(0), sampled(0), stopping(false), received_cnt(0),
+    processed_cnt(0), dropped_cnt(0), blocked_cnt(0)
+{
+    if(capacity > 0) {
+        thread = std::thread(&Sink::run, this);
+    }
+}
+
+
+/**
+ * Process remaining records and stop worker
+ */
+Sink::~Sink()
+{
+    stop();
+}
+
+
+/**
+ * Queue record
+ */
+void Sink::push(const Sink_Record& rec)
+{
+    received_cnt.fetch_add(1, std::memory_order_relaxed);
+    if(queue.empty()) {
+        callback(rec, arg);
+        processed_cnt.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    
+    std::unique_lock<std::mutex> lock(mutex);
+    if(stopping) {
+        dropped_cnt.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    size_t n = queue.size();
+    bool frame = (rec.state == 0);
+    if(overflow == OVERFLOW_SAMPLE && frame) {
+        if(2*count < limit) {
+            sampled = 0;
+        }
+        else if(sampled++ % sample != 0) {
+            dropped_cnt.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+    
+    // frames only use the slots up to the capacity, state changes also the
+    // reserved ones and are never dropped
+    size_t max = frame ? limit : n;
+    if(count >= max) {
+        if(overflow == OVERFLOW_BLOCK || !frame) {
+            blocked_cnt.fetch_add(1, std::memory_order_relaxed);
+            not_full.wait(lock, [&]() { return count < max || stopping; });
+            if(stopping) {
+                dropped_cnt.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+        else if(overflow == OVERFLOW_DROP_OLDEST && queue[head].state == 0) {
+            head = (head+1) % n;
+            count--;
+            dropped_cnt.fetch_add(1, std::memory_order_relaxed);
+        }
+        else {
+            dropped_cnt.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+    queue[(head+count) % n] = rec;
+    count++;
+    if(count > high_water_mark) {
+        high_water_mark = count;
+    }
+    lock.unlock();
+    not_empty.notify_one();
+}
+
+
+/**
+ * Process remaining records and stop worker
+ */
+void Sink::stop()
+{
+    if(!thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    not_empty.notify_one();
+    not_full.notify_all();
+    thread.join();
+}
+
+
+/**
+ * Return name, overflow policy and capacity
+ */
+const std::string& Sink::name() const
+{
+    return sink_name;
+}
+
+
+overflow_t Sink::policy() const
+{
+    return overflow;
+}
+
+
+size_t Sink::capacity() const
+{
+    return limit;
+}
+
+
+/**
+ * Return statistics
+ */
+uint64_t Sink::received() const
+{
+    return received_cnt.load(std::memory_order_relaxed);
+}
+
+
+uint64_t Sink::processed() const
+{
+    return processed_cnt.load(std::memory_order_relaxed);
+}
+
+
+uint64_t Sink::dropped() const
+{
+    return dropped_cnt.load(std::memory_order_relaxed);
+}
+
+
+uint64_t Sink::blocked() const
+{
+    return blocked_cnt.load(std::memory_order_relaxed);
+}
+
+
+/**
+ * Return number of queued records
+ */
+size_t Sink::depth()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return count;
+}
+
+
+/**
+ * Return maximum number of queued records
+ */
+size_t Sink::high_water()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return high_water_mark;
+}
+
+
+/**
+ * Worker thread, which takes all queued records at once, so that the
+ * producer is not held up while the records are processed
+ */
+void Sink::run()
+{
+    size_t n = queue.size();
+    std::vector<Sink_Record> batch(n);
+    while(true) {
+        size_t len = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            not_empty.wait(lock, [&]() { return count > 0 || stopping; });
+            if(count == 0) {
+                break;
+            }
+            for(; len < count; ++len) {
+                batch[len] = queue[(head+len) % n];
+            }
+            head = (head+count) % n;
+            count = 0;
+        }
+        not_full.notify_all();
+        for(size_t i = 0; i < len; ++i) {
+            callback(batch[i], arg);
+        }
+        processed_cnt.fetch_add(len, std::memory_order_relaxed);
+    }
+}
+
+
+/**
+ * Create pipeline and start fan-out thread
+ */
+Sink_Pipeline::Sink_Pipeline(bool staged) : wakeup(-1), waiting(false),
+    stopping(false)
+{
+    if(staged) {
+        wakeup = eventfd(0, EFD_CLOEXEC);
+        if(wakeup < 0) {
+            throw std::runtime_error("Creating eventfd failed");
+        }
+        thread = std::thread(&Sink_Pipeline::run, this);
+    }
+}
+
+
+/**
+ * Stop and delete sinks
+ */
+Sink_Pipeline::~Sink_Pipeline()
+{
+    stop();
+    for(size_t i = 0; i < sinks.size(); ++i) {
+        delete sinks[i];
+    }
+    if(wakeup >= 0) {
+        close(wakeup);
+    }
+}
+
+
+/**
+ * Attach sink
+ */
+void Sink_Pipeline::add(Sink* sink)
+{
+    sinks.push_back(sink);
+}
+
+
+/**
+ * Pass record to all sinks
+ */
+void Sink_Pipeline::push(const Sink_Record& rec)
+{
+    if(wakeup < 0) {
+        fan_out(rec);
+        return;
+    }
+    if(stopping.load(std::memory_order_relaxed)) {
+        return;
+    }
+    if(rec.state == 0) {
+        if(!ring.push(rec, SINK_STATE_RESERVE)) {
+            return;
+        }
+    }
+    else {
+        // state changes wait for the fan-out thread in the unlikely case
+        // that even the reserved slots are taken
+        while(ring.size() == ring.capacity()) {
+            usleep(1000);
+        }
+        ring.push(rec);
+    }
+    
+    // wake up the fan-out thread only if it sleeps, the fence orders the
+    // push before reading the flag like the fan-out thread orders setting
+    // the flag before checking the ring
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(waiting.load(std::memory_order_relaxed)
+            && waiting.exchange(false)) {
+        uint64_t one = 1;
+        if(write(wakeup, &one, sizeof(one)) != sizeof(one)) {
+            // counter is already set
+        }
+    }
+}
+
+
+/**
+ * Pass record to all sinks in the calling thread
+ */
+void Sink_Pipeline::fan_out(const Sink_Record& rec)
+{
+    for(size_t i = 0; i < sinks.size(); ++i) {
+        sinks[i]->push(rec);
+    }
+}
+
+
+/**
+ * Fan-out thread, which sleeps on the eventfd while the ring is empty
+ */
+void Sink_Pipeline::run()
+{
+    Sink_Record rec;
+    while(true) {
+        // records pushed before stopping are drained before leaving
+        bool last = stopping;
+        while(ring.pop(rec)) {
+            fan_out(rec);
+        }
+        if(last) {
+            break;
+        }
+        waiting.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(ring.size() > 0 || stopping) {
+            waiting.store(false);
+            continue;
+        }
+        uint64_t cnt;
+        if(read(wakeup, &cnt, sizeof(cnt)) < 0) {
+            // interrupted, the ring is checked again
+        }
+    }
+}
+
+
+/**
+ * Process remaining records of all sinks
+ */
+void Sink_Pipeline::stop()
+{
+    if(thread.joinable()) {
+        stopping = true;
+        uint64_t one = 1;
+        if(write(wakeup, &one, sizeof(one)) != sizeof(one)) {
+            // counter is already set
+        }
+        thread.join();
+    }
+    for(size_t i = 0; i < sinks.size(); ++i) {
+        sinks[i]->stop();
+    }
+}
+
+
+/**
+ * Return whether the pipeline is staged
+ */
+bool Sink_Pipeline::staged() const
+{
+    return wakeup >= 0;
+}
+
+
+/**
+ * Return staging statistics
+ */
+size_t Sink_Pipeline::staging_depth() const
+{
+    return ring.size();
+}
+
+
+size_t Sink_Pipeline::staging_high_water() const
+{
+    return ring.high_water();
+}
+
+
+uint64_t Sink_Pipeline::staging_overflows() const
+{
+    return ring.overflows();
+}
+
+
+/**
+ * Return number of sinks
+ */
+size_t Sink_Pipeline::size() const
+{
+    return sinks.size();
+}
+
+
+/**
+ * Return sink
+ */
+Sink* Sink_Pipeline::sink(size_t i) const
+{
+    return sinks.at(i);
+}
+
+
+/**
+ * Return sink by name
+ */
+Sink* Sink_Pipeline::find(const std::string& name) const
+{
+    for(size_t i = 0; i < sinks.size(); ++i) {
+        if(sinks[i]->name() == name) {
+            return sinks[i];
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * Convert overflow policy from string
+ */
+overflow_t Sink_Pipeline::str2policy(const std::string& str)
+{
+    if(str == "block") {
+        return OVERFLOW_BLOCK;
+    }
+    if(str == "drop-oldest") {
+        return OVERFLOW_DROP_OLDEST;
+    }
+    if(str == "drop-newest") {
+        return OVERFLOW_DROP_NEWEST;
+    }
+    if(str == "sample") {
+        return OVERFLOW_SAMPLE;
+    }
+    throw std::runtime_error("Unknown overflow policy " + str);
+}
+
+
+/**
+ * Convert overflow policy to string
+ */
+std::string Sink_Pipeline::policy2str(overflow_t policy)
+{
+    switch(policy) {
+        case OVERFLOW_BLOCK:
+            return "block";
+        case OVERFLOW_DROP_OLDEST:
+            return "drop-oldest";
+        case OVERFLOW_DROP_NEWEST:
+            return "drop-newest";
+        case OVERFLOW_SAMPLE:
+            return "sample";
+    }
+    return "";
+}
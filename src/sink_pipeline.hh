@@ -0,0 +1,325 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Fan-out of received frames to any number of sinks (log file, live view,
+ * publisher, ...), each with its own worker thread, bounded queue and
+ * overflow policy. The receiving thread hands the frames over to a fan-out
+ * thread via a lock-free ring, so that it never waits for a lock or a sink.
+ */
+#ifndef SINK_PIPELINE_HH
+#define SINK_PIPELINE_HH
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <stdint.h>
+#include "fs9922_dmm3.hh"
+#include "frame_timing.hh"
+#include "spsc_ring.hh"
+
+// maximum length of the path of an adapter including the null terminator,
+// enough for stream paths like /dev/serial/by-id/...
+const size_t SINK_PATH_MAX = 128;
+
+// number of records staged between the receiving and the fan-out thread
+const size_t SINK_STAGING = 1024;
+
+// number of slots of the staging ring and of each queue reserved for state
+// changes, which are never dropped
+const size_t SINK_STATE_RESERVE = 16;
+
+
+enum overflow_t
+{
+    // wait until the sink took a record from its queue, which also holds up
+    // the sinks after it
+    OVERFLOW_BLOCK = 0,
+    
+    // discard the oldest queued record, e.g. for a live view
+    OVERFLOW_DROP_OLDEST = 1,
+    
+    // discard the new record
+    OVERFLOW_DROP_NEWEST = 2,
+    
+    // queue only every n-th frame once the queue is half full, discard the
+    // new record if it is full
+    OVERFLOW_SAMPLE = 3
+};
+
+
+/**
+ * Received frame or state change of an adapter, which is passed to the sinks
+ */
+struct Sink_Record
+{
+    // monotonic reception time of the last data package and of the complete
+    // frame in ns
+    uint64_t t_report;
+    uint64_t t_frame;
+    
+    // frame timing of the adapter
+    const Frame_Timing* timing;
+    
+    // number of the frame since start of capturing
+    uint64_t frame_no;
+    
+    // path of the adapter
+    char path[SINK_PATH_MAX];
+    
+    // raw frame data and decoded reading
+    char data[14];
+    Reading reading;
+    
+    // 0 = frame, 1 = adapter reconnected, -1 = adapter lost
+    int state;
+};
+
+
+/**
+ * Callback, which is called by the worker of a sink for each record
+ */
+typedef void (*sink_callback_t)(const Sink_Record& rec, void* arg);
+
+
+/**
+ * This class represents a sink with a bounded queue of records, which is
+ * drained by a worker thread. If the queue is full, a record is handled
+ * according to the overflow policy, so that a slow sink (e.g. a stalled
+ * network file system or subscriber) never delays the thread pushing the
+ * records or other sinks, unless its policy is to block. State changes are
+ * never dropped: they may use slots reserved beyond the capacity and wait
+ * for a free slot, if even those are taken. A sink with capacity 0 has no
+ * worker and calls the callback directly.
+ */
+class Sink
+{
+    public:
+        
+        /**
+         * Create sink and start its worker
+         * \param name name of the sink, e.g. "log"
+         * \param callback callback called for each record
+         * \param arg argument passed to the callback
+         * \param policy overflow policy
+         * \param capacity maximum number of queued records (0 = no worker)
+         * \param sample ratio of queued frames of OVERFLOW_SAMPLE
+         */
+        Sink(const std::string& name, sink_callback_t callback, void* arg,
+            overflow_t policy=OVERFLOW_BLOCK, size_t capacity=1024,
+            unsigned int sample=4);
+        
+        /**
+         * Process remaining records and stop worker
+         */
+        ~Sink();
+        
+        /**
+         * Queue record according to the overflow policy
+         * \param rec record
+         */
+        void push(const Sink_Record& rec);
+        
+        /**
+         * Process remaining records and stop worker. Records pushed
+         * afterwards are discarded.
+         */
+        void stop();
+        
+        /**
+         * Return name, overflow policy and capacity
+         */
+        const std::string& name() const;
+        overflow_t policy() const;
+        size_t capacity() const;
+        
+        /**
+         * Return number of pushed, processed and discarded records and
+         * number of pushes, which waited for a free slot
+         */
+        uint64_t received() const;
+        uint64_t processed() const;
+        uint64_t dropped() const;
+        uint64_t blocked() const;
+        
+        /**
+         * Return number of queued records and maximum number seen so far
+         */
+        size_t depth();
+        size_t high_water();
+        
+    private:
+        
+        /**
+         * Worker thread
+         */
+        void run();
+        
+        // name
+        std::string sink_name;
+        
+        // callback and its argument
+        sink_callback_t callback;
+        void* arg;
+        
+        // overflow policy and sample ratio
+        overflow_t overflow;
+        unsigned int sample;
+        
+        // ring of queued records including the reserved slots, number of
+        // slots available to frames, index of the oldest record and count
+        std::vector<Sink_Record> queue;
+        size_t limit;
+        size_t head;
+        size_t count;
+        size_t high_water_mark;
+        
+        // number of frames offered while sampling
+        unsigned int sampled;
+        
+        // flag whether worker has to stop
+        bool stopping;
+        
+        // guards the queue and `stopping`
+        std::mutex mutex;
+        std::condition_variable not_empty;
+        std::condition_variable not_full;
+        
+        // statistics
+        std::atomic<uint64_t> received_cnt;
+        std::atomic<uint64_t> processed_cnt;
+        std::atomic<uint64_t> dropped_cnt;
+        std::atomic<uint64_t> blocked_cnt;
+        
+        // worker thread
+        std::thread thread;
+};
+
+
+/**
+ * This class passes each record to all attached sinks. A staged pipeline
+ * passes the records from a single producer thread through a lock-free ring
+ * to a fan-out thread, which pushes them into the queues of the sinks. If
+ * the ring is full, a new frame is discarded, so that a sink blocking the
+ * fan-out thread never blocks the producer. State changes use reserved
+ * slots of the ring and wait for the fan-out thread only if they are taken.
+ */
+class Sink_Pipeline
+{
+    public:
+        
+        /**
+         * Create pipeline
+         * \param staged whether records are passed to the sinks by a
+         *               fan-out thread instead of the caller of push()
+         */
+        Sink_Pipeline(bool staged=false);
+        
+        /**
+         * Stop and delete sinks
+         */
+        ~Sink_Pipeline();
+        
+        /**
+         * Attach sink before the first record is pushed, the pipeline takes
+         * ownership
+         * \param sink sink
+         */
+        void add(Sink* sink);
+        
+        /**
+         * Pass record to all sinks. Only a single thread may push records
+         * into a staged pipeline.
+         * \param rec record
+         */
+        void push(const Sink_Record& rec);
+        
+        /**
+         * Pass remaining staged records to the sinks, stop the fan-out
+         * thread, process remaining records of all sinks and stop their
+         * workers
+         */
+        void stop();
+        
+        /**
+         * Return whether the pipeline is staged
+         */
+        bool staged() const;
+        
+        /**
+         * Return number of staged records, maximum number seen so far and
+         * number of records discarded because the ring was full
+         */
+        size_t staging_depth() const;
+        size_t staging_high_water() const;
+        uint64_t staging_overflows() const;
+        
+        /**
+         * Return number of sinks
+         */
+        size_t size() const;
+        
+        /**
+         * Return sink
+         * \param i index of the sink
+         */
+        Sink* sink(size_t i) const;
+        
+        /**
+         * Return sink by name or 0
+         */
+        Sink* find(const std::string& name) const;
+        
+        /**
+         * Convert overflow policy from and to string ("block", "drop-oldest",
+         * "drop-newest", "sample")
+         */
+        static overflow_t str2policy(const std::string& str);
+        static std::string policy2str(overflow_t policy);
+        
+    private:
+        
+        /**
+         * Fan-out thread
+         */
+        void run();
+        
+        /**
+         * Pass record to all sinks in the calling thread
+         */
+        void fan_out(const Sink_Record& rec);
+        
+        // sinks
+        std::vector<Sink*> sinks;
+        
+        // ring between the producer and the fan-out thread
+        SPSC_Ring<Sink_Record, SINK_STAGING> ring;
+        
+        // eventfd waking up the fan-out thread (-1 = not staged), flag
+        // whether the fan-out thread waits for it and whether it has to stop
+        int wakeup;
+        std::atomic<bool> waiting;
+        std::atomic<bool> stopping;
+        
+        // fan-out thread
+        std::thread thread;
+};
+#endif
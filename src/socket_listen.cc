@@ -0,0 +1,109 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "socket_listen.hh"
+#include <stdexcept>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+
+/**
+ * Open listening socket
+ */
+int socket_listen(const std::string& address, std::string& path)
+{
+    path.clear();
+    int fd = -1;
+    if(address.find('/') != std::string::npos) {
+        sockaddr_un sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sun_family = AF_UNIX;
+        if(address.size() >= sizeof(sa.sun_path)) {
+            throw std::runtime_error("Socket path too long: " + address);
+        }
+        strcpy(sa.sun_path, address.c_str());
+        
+        // remove stale socket of a previous run, but never another file
+        struct stat st;
+        if(lstat(address.c_str(), &st) == 0) {
+            if(!S_ISSOCK(st.st_mode)) {
+                throw std::runtime_error("Listening on " + address
+                    + " failed: File exists and is no socket");
+            }
+            unlink(address.c_str());
+        }
+        fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+        if(fd < 0 || bind(fd, (sockaddr*)&sa, sizeof(sa)) != 0
+            || listen(fd, 16) != 0) {
+            std::string err = strerror(errno);
+            if(fd >= 0) {
+                close(fd);
+            }
+            throw std::runtime_error("Listening on " + address + " failed: "
+                + err);
+        }
+        path = address;
+        return fd;
+    }
+    
+    // TCP port on the loopback interface or host:port
+    std::string host = "127.0.0.1";
+    std::string port = address;
+    size_t colon = address.rfind(':');
+    if(colon != std::string::npos) {
+        host = address.substr(0, colon);
+        port = address.substr(colon+1);
+    }
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* res = 0;
+    int r = getaddrinfo(host.empty() ? 0 : host.c_str(), port.c_str(),
+        &hints, &res);
+    if(r != 0) {
+        throw std::runtime_error("Resolving " + address + " failed: "
+            + gai_strerror(r));
+    }
+    for(addrinfo* ai = res; ai != 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype|SOCK_CLOEXEC,
+            ai->ai_protocol);
+        if(fd < 0) {
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if(bind(fd, ai->ai_addr, ai->ai_addrlen) == 0
+            && listen(fd, 16) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if(fd < 0) {
+        throw std::runtime_error("Listening on " + address + " failed");
+    }
+    return fd;
+}
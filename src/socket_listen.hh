@@ -0,0 +1,38 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Listening sockets for local and network clients
+ */
+#ifndef SOCKET_LISTEN_HH
+#define SOCKET_LISTEN_HH
+
+#include <string>
+
+
+/**
+ * Open listening stream socket
+ * \param address path of a Unix socket (contains '/'), TCP port on the
+ *                loopback interface or `host:port` (empty host = all
+ *                interfaces)
+ * \param path set to the path of a Unix socket, which has to be removed after
+ *             closing, or cleared
+ * \return file descriptor of the socket
+ */
+int socket_listen(const std::string& address, std::string& path);
+#endif
@@ -0,0 +1,138 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Bounded lock-free single-producer/single-consumer ring buffer, which
+ * decouples the USB reception from slow frame consumers
+ */
+#ifndef SPSC_RING_HH
+#define SPSC_RING_HH
+
+#include <atomic>
+#include <stddef.h>
+
+
+/**
+ * This class represents a ring buffer of N elements of type T. Exactly one
+ * thread may push and exactly one thread may pop elements. N has to be a power
+ * of two. The producer and consumer indices are placed on separate cache lines
+ * to avoid false sharing. Padding is used instead of alignas, so that the ring
+ * may be a member of objects allocated with new.
+ */
+template<typename T, size_t N>
+class SPSC_Ring
+{
+    static_assert(N > 0 && (N & (N-1)) == 0, "N has to be a power of two");
+    
+    public:
+        SPSC_Ring() : head(0), tail(0), overflow_cnt(0), high_water_mark(0) { }
+        
+        /**
+         * Push element (producer only)
+         * \param v element
+         * \param reserve number of slots kept free for other elements
+         * \return false if the ring is full and the element is dropped
+         */
+        bool push(const T& v, size_t reserve=0)
+        {
+            size_t h = head.load(std::memory_order_relaxed);
+            size_t used = h - tail.load(std::memory_order_acquire);
+            if(used + reserve >= N) {
+                overflow_cnt.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            buf[h & (N-1)] = v;
+            head.store(h+1, std::memory_order_release);
+            if(used+1 > high_water_mark.load(std::memory_order_relaxed)) {
+                high_water_mark.store(used+1, std::memory_order_relaxed);
+            }
+            return true;
+        }
+        
+        /**
+         * Pop element (consumer only)
+         * \param v destination of the element
+         * \return false if the ring is empty
+         */
+        bool pop(T& v)
+        {
+            size_t t = tail.load(std::memory_order_relaxed);
+            if(t == head.load(std::memory_order_acquire)) {
+                return false;
+            }
+            v = buf[t & (N-1)];
+            tail.store(t+1, std::memory_order_release);
+            return true;
+        }
+        
+        /**
+         * Return number of buffered elements
+         */
+        size_t size() const
+        {
+            return head.load(std::memory_order_acquire)
+                - tail.load(std::memory_order_acquire);
+        }
+        
+        /**
+         * Return capacity
+         */
+        size_t capacity() const
+        {
+            return N;
+        }
+        
+        /**
+         * Return number of elements dropped because the ring was full
+         */
+        size_t overflows() const
+        {
+            return overflow_cnt.load(std::memory_order_relaxed);
+        }
+        
+        /**
+         * Return maximum number of buffered elements seen so far
+         */
+        size_t high_water() const
+        {
+            return high_water_mark.load(std::memory_order_relaxed);
+        }
+        
+    private:
+        
+        // size of a cache line
+        static const size_t LINE = 64;
+        
+        // index of next element to write, written by producer
+        char pad0[LINE];
+        std::atomic<size_t> head;
+        
+        // index of next element to read, written by consumer
+        char pad1[LINE - sizeof(std::atomic<size_t>)];
+        std::atomic<size_t> tail;
+        
+        // statistics, written by producer
+        char pad2[LINE - sizeof(std::atomic<size_t>)];
+        std::atomic<size_t> overflow_cnt;
+        std::atomic<size_t> high_water_mark;
+        
+        // elements
+        char pad3[LINE - 2*sizeof(std::atomic<size_t>)];
+        T buf[N];
+};
+#endif
@@ -0,0 +1,120 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "terminal_view.hh"
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+
+
+/**
+ * Create view
+ */
+Terminal_View::Terminal_View(size_t lines, int rate, int fd) :
+    lines(lines), shown(lines), interval((rate > 0) ? 1000000000LL/rate : 0),
+    fd(fd), cleared(false)
+{
+    t_refresh.tv_sec = 0;
+    t_refresh.tv_nsec = 0;
+    buf.reserve(1024);
+}
+
+
+/**
+ * Move cursor below view
+ */
+Terminal_View::~Terminal_View()
+{
+    if(cleared) {
+        refresh(true);
+        char s[32];
+        snprintf(s, sizeof(s), "\033[%zu;1H\n", lines.size()+1);
+        buf = s;
+        flush();
+    }
+}
+
+
+/**
+ * Set text of a line
+ */
+void Terminal_View::set_line(size_t i, const std::string& text)
+{
+    if(i < lines.size()) {
+        lines[i] = text;
+    }
+}
+
+
+/**
+ * Redraw changed lines
+ */
+void Terminal_View::refresh(bool force)
+{
+    timespec t_now;
+    clock_gettime(CLOCK_MONOTONIC, &t_now);
+    long long dt = (t_now.tv_sec - t_refresh.tv_sec)*1000000000LL;
+    dt += t_now.tv_nsec - t_refresh.tv_nsec;
+    if(!force && cleared && dt < interval) {
+        return;
+    }
+    
+    // clear screen and draw all lines at first refresh
+    bool all = !cleared;
+    buf.clear();
+    if(all) {
+        buf += "\033[2J";
+        cleared = true;
+    }
+    for(size_t i = 0; i < lines.size(); ++i) {
+        if(!all && lines[i] == shown[i]) {
+            continue;
+        }
+        
+        // move cursor to line, write text and erase rest of line
+        char s[32];
+        snprintf(s, sizeof(s), "\033[%zu;1H", i+1);
+        buf += s;
+        buf += lines[i];
+        buf += "\033[K";
+        shown[i] = lines[i];
+    }
+    if(!buf.empty()) {
+        flush();
+    }
+    t_refresh = t_now;
+}
+
+
+/**
+ * Write buffer to terminal
+ */
+void Terminal_View::flush()
+{
+    size_t n = 0;
+    while(n < buf.size()) {
+        ssize_t r = write(fd, buf.data()+n, buf.size()-n);
+        if(r < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        n += r;
+    }
+}
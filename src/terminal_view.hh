@@ -0,0 +1,93 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Incremental terminal renderer for the live view. The view consists of a
+ * fixed number of lines, which are positioned with ANSI escape sequences.
+ * Only changed lines are redrawn and each repaint is sent with a single
+ * write.
+ */
+#ifndef TERMINAL_VIEW_HH
+#define TERMINAL_VIEW_HH
+
+#include <string>
+#include <vector>
+#include <time.h>
+
+
+/**
+ * This class represents the live view on a terminal
+ */
+class Terminal_View
+{
+    public:
+        
+        /**
+         * Create view
+         * \param lines number of lines of the view
+         * \param rate maximum refresh rate in Hz (0 = unlimited)
+         * \param fd file descriptor of the terminal
+         */
+        Terminal_View(size_t lines, int rate=10, int fd=1);
+        
+        /**
+         * Move cursor below the view
+         */
+        ~Terminal_View();
+        
+        /**
+         * Set text of a line. The line is redrawn on the next refresh if its
+         * text changed.
+         * \param i line number
+         * \param text text of the line without line break
+         */
+        void set_line(size_t i, const std::string& text);
+        
+        /**
+         * Redraw changed lines, if the refresh rate allows it
+         * \param force redraw regardless of the refresh rate
+         */
+        void refresh(bool force=false);
+        
+    private:
+        
+        /**
+         * Write buffer completely to the terminal
+         */
+        void flush();
+        
+        // text of the lines as set and as currently shown
+        std::vector<std::string> lines;
+        std::vector<std::string> shown;
+        
+        // minimum time between two refreshes in ns
+        long long interval;
+        
+        // time of last refresh
+        timespec t_refresh;
+        
+        // file descriptor of the terminal
+        int fd;
+        
+        // whether screen was cleared initially
+        bool cleared;
+        
+        // output buffer of a single repaint
+        std::string buf;
+};
+#endif
@@ -0,0 +1,811 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Micro-benchmarks of the hot paths of capturing: frame assembly from the
+ * usb data packages, decoding, string conversion and log line formatting.
+ * Each benchmark is repeated and the best and median time per operation is
+ * reported as text or, with -j, as JSON.
+ * 
+ * Before timing, the SIMD kernels of the batch decoder are checked against
+ * the scalar kernel and the compressed columnar format is checked to restore
+ * the encoded records exactly. The program fails without timing anything if
+ * a check fails.
+ */
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include "fs9922_dmm3.hh"
+#include "fs9922_batch.hh"
+#include "ch9325_adapter.hh"
+#include "capture_file.hh"
+#include "decimal_format.hh"
+#include "encoder.hh"
+#include "column_file.hh"
+
+// number of synthetic frames
+static const size_t FRAMES = 1 << 16;
+
+// number of repetitions of each benchmark
+static int repeat = 20;
+
+// frames per second sent by a single multimeter
+static const double FRAME_RATE = 2;
+
+// data packages per frame of a real adapter, the packages between two frames
+// are empty
+static const int REPORTS_PER_FRAME = 50;
+
+// prevents that the compiler removes benchmarked code
+static volatile uint64_t sink;
+
+
+/**
+ * Result of a single benchmark
+ */
+struct Result
+{
+    std::string name;
+    
+    // operation the time refers to, e.g. "frame" or "byte"
+    std::string unit;
+    
+    // number of operations per repetition
+    size_t n;
+    
+    // best and median time per operation in ns
+    double best;
+    double median;
+};
+
+// results of all benchmarks
+static std::vector<Result> results;
+
+
+/**
+ * Return monotonic time in s
+ */
+static double now()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+
+/**
+ * Fill buffer with random but valid frames
+ */
+static void generate(std::vector<char>& frames, size_t n)
+{
+    static const char DECIMAL[4] = {'0', '1', '2', '4'};
+    frames.resize(14*n);
+    srand(1);
+    for(size_t i = 0; i < n; ++i) {
+        char* f = &frames[14*i];
+        f[0] = (rand() % 2) ? '+' : '-';
+        for(int k = 1; k < 5; ++k) {
+            f[k] = '0' + rand() % 10;
+        }
+        f[5] = ' ';
+        f[6] = DECIMAL[rand() % 4];
+        f[7] = rand() & 0x3f;
+        f[8] = rand() & 0x3e;
+        f[9] = rand() & 0xfe;
+        f[10] = 1 << (rand() % 8);
+        f[11] = rand() & 0xff;
+        f[12] = 0x0d;
+        f[13] = 0x0a;
+    }
+}
+
+
+/**
+ * Convert frames to the data packages of the adapter: one package per byte
+ * followed by empty packages until the next frame
+ * \param frames raw frames
+ * \param n number of frames
+ * \param noise probability that a byte is replaced by a random byte
+ * \param reports resulting data packages
+ */
+static void packetize(const std::vector<char>& frames, size_t n, double noise,
+    std::vector<unsigned char>& reports)
+{
+    reports.assign(8*REPORTS_PER_FRAME*n, 0);
+    srand(2);
+    for(size_t i = 0; i < n; ++i) {
+        unsigned char* r = &reports[8*REPORTS_PER_FRAME*i];
+        for(int k = 0; k < REPORTS_PER_FRAME; ++k) {
+            r[8*k] = 0xf0;
+        }
+        for(int k = 0; k < 14; ++k) {
+            r[8*k] = 0xf1;
+            r[8*k+1] = frames[14*i+k];
+            if(noise > 0 && rand() < noise*RAND_MAX) {
+                r[8*k+1] = rand() & 0xff;
+            }
+        }
+    }
+}
+
+
+/**
+ * Run benchmark and store its result
+ * \param name name of benchmark
+ * \param unit operation the time refers to
+ * \param n number of operations per call of f
+ * \param f benchmarked function
+ */
+template<typename F>
+static void run(const std::string& name, const std::string& unit, size_t n,
+    F f)
+{
+    std::vector<double> t(repeat);
+    f();
+    for(int r = 0; r < repeat; ++r) {
+        double t0 = now();
+        f();
+        t[r] = now() - t0;
+    }
+    std::sort(t.begin(), t.end());
+    Result res;
+    res.name = name;
+    res.unit = unit;
+    res.n = n;
+    res.best = t[0]/n*1e9;
+    res.median = t[repeat/2]/n*1e9;
+    results.push_back(res);
+}
+
+
+/**
+ * Adapter without transport, which passes given data packages to the frame
+ * assembly
+ */
+class Bench_Adapter : public CH9325_Adapter
+{
+    public:
+        void feed(const unsigned char* reports, size_t n)
+        {
+            // one data package every 10 ms like the real adapter
+            for(size_t i = 0; i < n; ++i) {
+                handle_report(&reports[8*i], 10000000*i + 1);
+            }
+        }
+        void start() {}
+        void finish() {}
+        bool active() const { return true; }
+        void close() {}
+        bool reopen() { return true; }
+};
+
+
+/**
+ * Count assembled frames
+ */
+static void count_frame(const char* frame, void*)
+{
+    sink += frame[0];
+}
+
+
+/**
+ * Decode frame and format log line like the command line tool
+ */
+static void format_frame(const char* frame, void* arg)
+{
+    std::ostringstream& os = *(std::ostringstream*)arg;
+    Reading r;
+    FS9922_DMM3::decode(frame, r);
+    os.str("");
+    capture_text_line(os, 1.5, r);
+    os << "1-2.4 \n";
+    sink += os.str().size();
+}
+
+
+/**
+ * Assemble frames from data packages with varying corruption
+ */
+static void bench_sync(const std::vector<char>& frames, size_t n)
+{
+    static const double NOISE[5] = {0, 1e-4, 1e-3, 1e-2, 1e-1};
+    std::vector<unsigned char> reports;
+    for(int i = 0; i < 5; ++i) {
+        packetize(frames, n, NOISE[i], reports);
+        std::ostringstream name;
+        name << "sync noise=" << NOISE[i];
+        Bench_Adapter a;
+        a.set_callback(count_frame);
+        run(name.str(), "frame", n, [&]() {
+            a.feed(&reports[0], reports.size()/8);
+        });
+    }
+    
+    // complete path of the command line tool: assembly, decoding and
+    // formatting of the log line
+    packetize(frames, n, 0, reports);
+    std::ostringstream os;
+    Bench_Adapter a;
+    a.set_callback(format_frame, &os);
+    run("pipeline", "frame", n, [&]() {
+        a.feed(&reports[0], reports.size()/8);
+    });
+}
+
+
+/**
+ * Decode all frames with each accessor of FS9922_DMM3
+ */
+static void bench_accessors(const std::vector<char>& frames, size_t n)
+{
+    #define BENCH_ACCESSOR(name, expr) \
+        run("accessor " name, "frame", n, [&]() { \
+            uint64_t s = 0; \
+            for(size_t i = 0; i < n; ++i) { \
+                FS9922_DMM3 frame(&frames[14*i]); \
+                s += (uint64_t)(expr); \
+            } \
+            sink += s; \
+        })
+    BENCH_ACCESSOR("value", frame.value());
+    BENCH_ACCESSOR("value_unscaled", frame.value_unscaled());
+    BENCH_ACCESSOR("overflow", frame.overflow());
+    BENCH_ACCESSOR("hold", frame.hold());
+    BENCH_ACCESSOR("relative", frame.relative());
+    BENCH_ACCESSOR("bargraph", frame.bargraph());
+    BENCH_ACCESSOR("autorange", frame.autorange());
+    BENCH_ACCESSOR("autopoweroff", frame.autopoweroff());
+    BENCH_ACCESSOR("lowbattery", frame.lowbattery());
+    BENCH_ACCESSOR("diode", frame.diode());
+    BENCH_ACCESSOR("beep", frame.beep());
+    BENCH_ACCESSOR("bargraph_value", frame.bargraph_value());
+    BENCH_ACCESSOR("power", frame.power());
+    BENCH_ACCESSOR("minmax", frame.minmax());
+    BENCH_ACCESSOR("unit_prefix", frame.unit_prefix());
+    BENCH_ACCESSOR("unit", frame.unit());
+    #undef BENCH_ACCESSOR
+    
+    // all fields with the accessors as done before the single pass decoding
+    run("accessors", "frame", n, [&]() {
+        uint64_t s = 0;
+        for(size_t i = 0; i < n; ++i) {
+            FS9922_DMM3 frame(&frames[14*i]);
+            s += (uint64_t)frame.value() + frame.unit()
+                + frame.unit_prefix() + frame.power() + frame.minmax()
+                + frame.bargraph_value() + (frame.overflow()
+                | frame.hold() << 1 | frame.relative() << 2
+                | frame.bargraph() << 3 | frame.autorange() << 4
+                | frame.autopoweroff() << 5 | frame.lowbattery() << 6
+                | frame.diode() << 7 | frame.beep() << 8);
+        }
+        sink += s;
+    });
+    run("decode", "frame", n, [&]() {
+        uint64_t s = 0;
+        Reading r;
+        for(size_t i = 0; i < n; ++i) {
+            FS9922_DMM3::decode(&frames[14*i], r);
+            s += (uint64_t)r.value + r.flags;
+        }
+        sink += s;
+    });
+    run("valid", "frame", n, [&]() {
+        uint64_t s = 0;
+        for(size_t i = 0; i < n; ++i) {
+            s += FS9922_DMM3::valid(&frames[14*i]);
+        }
+        sink += s;
+    });
+}
+
+
+/**
+ * Convert decoded constants to strings
+ */
+static void bench_strings(const std::vector<char>& frames, size_t n)
+{
+    std::vector<Reading> r(n);
+    for(size_t i = 0; i < n; ++i) {
+        FS9922_DMM3::decode(&frames[14*i], r[i]);
+    }
+    run("unit2str", "call", n, [&]() {
+        for(size_t i = 0; i < n; ++i) {
+            sink += FS9922_DMM3::unit2str((unit_t)r[i].unit).size();
+        }
+    });
+    run("unit_prefix2str", "call", n, [&]() {
+        for(size_t i = 0; i < n; ++i) {
+            sink += FS9922_DMM3::unit_prefix2str(
+                (unit_prefix_t)r[i].prefix).size();
+        }
+    });
+    run("power2str", "call", n, [&]() {
+        for(size_t i = 0; i < n; ++i) {
+            sink += FS9922_DMM3::power2str((power_t)r[i].power).size();
+        }
+    });
+    run("minmax2str", "call", n, [&]() {
+        for(size_t i = 0; i < n; ++i) {
+            sink += FS9922_DMM3::minmax2str((minmax_t)r[i].minmax).size();
+        }
+    });
+    
+    // log line of a decoded frame as written by the command line tool
+    std::ostringstream os;
+    run("log line", "frame", n, [&]() {
+        for(size_t i = 0; i < n; ++i) {
+            os.str("");
+            capture_text_line(os, i*0.5, r[i]);
+            os << "1-2.4 \n";
+            sink += os.str().size();
+        }
+    });
+    
+    // log line formatted into a buffer as written by the command line tool
+    char line[CAPTURE_TEXT_MAX];
+    run("log line buffer", "frame", n, [&]() {
+        for(size_t i = 0; i < n; ++i) {
+            sink += capture_text_format(line, i*0.5, r[i]);
+        }
+    });
+    
+    // exact value of a decoded frame
+    char value[DECIMAL_MAX];
+    run("format value", "frame", n, [&]() {
+        for(size_t i = 0; i < n; ++i) {
+            sink += format_decimal(value, r[i].count, r[i].exponent);
+        }
+    });
+    
+    // decoded frame in each output format of the log file and as binary
+    // record sent to subscribers
+    const char* formats[] = {"text", "csv", "json", "bin"};
+    const char* device = "1-2.4";
+    char buf[ENCODER_MAX];
+    for(size_t f = 0; f < 4; ++f) {
+        Encoder* enc = (f < 3) ? Encoder::create(formats[f])
+            : new Binary_Encoder();
+        run(std::string("encode ") + formats[f], "frame", n, [&]() {
+            for(size_t i = 0; i < n; ++i) {
+                sink += enc->encode(buf, device, i*500000000LL,
+                    &frames[14*i], r[i]);
+            }
+        });
+        delete enc;
+    }
+}
+
+
+/**
+ * Decode all frames with a kernel of the batch decoder
+ */
+static void bench_batch(const std::vector<char>& frames, size_t n,
+    batch_kernel_t kernel)
+{
+    if(!FS9922_Batch::supported(kernel)) {
+        return;
+    }
+    std::vector<float> value(n);
+    std::vector<uint16_t> unit(n), prefix(n), flags(n);
+    std::vector<uint8_t> reject(n);
+    Reading_Columns out = {&value[0], &unit[0], &prefix[0], &flags[0],
+        &reject[0]};
+    run(std::string("batch ") + FS9922_Batch::kernel2str(kernel), "frame", n,
+        [&]() {
+            FS9922_Batch::decode(&frames[0], n, out, kernel);
+        });
+}
+
+
+/**
+ * Fill buffer with frames for checking the batch decoder: valid frames,
+ * overflow frames, frames with single corrupted bytes or flag bits and
+ * random bytes
+ */
+static void generate_mixed(const std::vector<char>& valid,
+    std::vector<char>& frames, size_t n)
+{
+    frames.resize(14*n);
+    srand(4);
+    for(size_t i = 0; i < n; ++i) {
+        char* f = &frames[14*i];
+        memcpy(f, &valid[14*(rand() % (valid.size()/14))], 14);
+        switch(rand() % 8) {
+            case 0:
+                // overflow, digits 0x30-0x3f or invalid
+                f[1] = '?';
+                for(int k = 2; k < 5; ++k) {
+                    f[k] = 0x30 + rand() % ((rand() % 4) ? 16 : 256);
+                }
+                break;
+            case 1:
+                f[rand() % 14] = rand() & 0xff;
+                break;
+            case 2:
+                // single flag bit, e.g. a reserved bit or a second unit
+                f[7 + rand() % 4] ^= 1 << (rand() % 8);
+                break;
+            case 3:
+                f[1 + rand() % 4] = (rand() % 2) ? '?' : ':';
+                break;
+            case 4:
+                for(int k = 0; k < 14; ++k) {
+                    f[k] = rand() & 0xff;
+                }
+                break;
+        }
+    }
+}
+
+
+/**
+ * Decode frames with a kernel into columns, which are followed by guard
+ * elements
+ * \return number of rejected frames
+ */
+static size_t decode_guarded(const char* frames, size_t n,
+    batch_kernel_t kernel, std::vector<float>& value,
+    std::vector<uint16_t>& unit, std::vector<uint16_t>& prefix,
+    std::vector<uint16_t>& flags, std::vector<uint8_t>& reject)
+{
+    static const size_t GUARD = 4;
+    value.assign(n + GUARD, 1234.5f);
+    unit.assign(n + GUARD, 0xa5a5);
+    prefix.assign(n + GUARD, 0xa5a5);
+    flags.assign(n + GUARD, 0xa5a5);
+    reject.assign(n + GUARD, 0xa5);
+    Reading_Columns out = {&value[0], &unit[0], &prefix[0], &flags[0],
+        &reject[0]};
+    return FS9922_Batch::decode(frames, n, out, kernel);
+}
+
+
+/**
+ * Check that each supported SIMD kernel of the batch decoder yields the
+ * same columns, reject mask and number of rejected frames as the scalar
+ * kernel, for each count of frames up to a few vectors and different
+ * alignments, and that no element after the last frame is written
+ * \param frames valid frames the checked frames are derived from
+ * \return whether the kernels agree
+ */
+static bool verify_batch(const std::vector<char>& frames)
+{
+    static const batch_kernel_t KERNELS[2] = {KERNEL_SSSE3, KERNEL_AVX2};
+    std::vector<char> mixed;
+    generate_mixed(frames, mixed, 4096);
+    
+    std::vector<size_t> counts;
+    for(size_t n = 0; n <= 40; ++n) {
+        counts.push_back(n);
+    }
+    counts.push_back(1023);
+    counts.push_back(4000);
+    
+    std::vector<float> value[2];
+    std::vector<uint16_t> unit[2], prefix[2], flags[2];
+    std::vector<uint8_t> reject[2];
+    for(int k = 0; k < 2; ++k) {
+        if(!FS9922_Batch::supported(KERNELS[k])) {
+            continue;
+        }
+        const char* name = FS9922_Batch::kernel2str(KERNELS[k]);
+        for(size_t c = 0; c < counts.size(); ++c) {
+            for(size_t first = 0; first < 3; ++first) {
+                size_t n = counts[c];
+                const char* p = &mixed[14*first];
+                size_t r0 = decode_guarded(p, n, KERNEL_SCALAR, value[0],
+                    unit[0], prefix[0], flags[0], reject[0]);
+                size_t r1 = decode_guarded(p, n, KERNELS[k], value[1],
+                    unit[1], prefix[1], flags[1], reject[1]);
+                const char* column = 0;
+                if(r0 != r1) {
+                    column = "rejected count";
+                }
+                else if(memcmp(&value[0][0], &value[1][0],
+                    value[0].size()*sizeof(float)) != 0) {
+                    column = "value";
+                }
+                else if(unit[0] != unit[1]) {
+                    column = "unit";
+                }
+                else if(prefix[0] != prefix[1]) {
+                    column = "prefix";
+                }
+                else if(flags[0] != flags[1]) {
+                    column = "flags";
+                }
+                else if(reject[0] != reject[1]) {
+                    column = "reject";
+                }
+                if(column != 0) {
+                    std::cerr << "Batch kernel " << name << " differs from ";
+                    std::cerr << "scalar in " << column << " for " << n;
+                    std::cerr << " frames at frame " << first << "\n";
+                    return false;
+                }
+            }
+        }
+    }
+    
+    // the scalar kernel is checked against the single frame decoder and
+    // must not write beyond the last frame
+    size_t n = 1023;
+    decode_guarded(&mixed[0], n, KERNEL_SCALAR, value[0], unit[0],
+        prefix[0], flags[0], reject[0]);
+    for(size_t i = 0; i < value[0].size(); ++i) {
+        const char* f = &mixed[14*i];
+        Reading r;
+        FS9922_DMM3::decode(f, r);
+        bool ok;
+        if(i >= n) {
+            ok = (value[0][i] == 1234.5f && unit[0][i] == 0xa5a5
+                && prefix[0][i] == 0xa5a5 && flags[0][i] == 0xa5a5
+                && reject[0][i] == 0xa5);
+        }
+        else if(!FS9922_DMM3::valid(f)) {
+            ok = (reject[0][i] == 1 && std::isnan(value[0][i]));
+        }
+        else {
+            ok = (reject[0][i] == 0 && flags[0][i] == r.flags
+                && unit[0][i] == r.unit && prefix[0][i] == r.prefix
+                && (value[0][i] == r.value || (std::isinf(value[0][i])
+                && std::isinf(r.value))));
+        }
+        if(!ok) {
+            std::cerr << "Batch kernel scalar differs from the frame ";
+            std::cerr << "decoder at frame " << i << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * Write records in the compressed columnar format, read them back and
+ * compare them with the written ones. The records cover the edge cases of
+ * the encoders: overflow and corrupted frames, "-0000", sign changes of the
+ * delta-of-delta of the times, long gaps, marker blocks and block
+ * boundaries by count and by time span.
+ * \param frames valid frames the records are derived from
+ * \param n number of frames
+ * \param records maximum number of records per block
+ * \return whether all records are restored
+ */
+static bool verify_columns(const std::vector<char>& frames, size_t n,
+    size_t records)
+{
+    char path[] = "/tmp/ut61b_bench.XXXXXX";
+    int fd = mkstemp(path);
+    if(fd < 0) {
+        std::cerr << "Creating temporary file failed\n";
+        return false;
+    }
+    close(fd);
+    
+    std::vector<Column_Row> expected;
+    {
+        Log_Writer out(path);
+        Column_Writer w(out, records, 60, 1);
+        srand(3);
+        uint64_t t = 0;
+        int64_t d = 500000000;
+        Column_Row row;
+        memset(&row, 0, sizeof(row));
+        for(size_t i = 0; i < n; ++i) {
+            switch(rand() % 8) {
+                case 0:
+                    break;
+                case 1:
+                    d += rand() % 2000001 - 1000000;
+                    break;
+                case 2:
+                    d = 0;
+                    break;
+                case 3:
+                    d = (int64_t)(rand() % 3600)*1000000000;
+                    break;
+                default:
+                    d = 500000000 + rand() % 1001 - 500;
+            }
+            d = (d < 0) ? 0 : d;
+            t += d;
+            if(rand() % 500 == 0) {
+                bool connected = rand() % 2;
+                w.mark(t, connected);
+                row.time = t;
+                row.state = connected ? COLUMN_RECONNECTED : COLUMN_LOST;
+                expected.push_back(row);
+                row.state = 0;
+                continue;
+            }
+            if(rand() % 100 == 0) {
+                w.expire(t + rand() % 120000000000LL);
+            }
+            
+            // steady frames repeat the previous frame
+            int kind = rand() % 10;
+            if(kind != 0 || i == 0) {
+                memcpy(row.frame, &frames[14*(i % n)], 14);
+            }
+            switch(kind) {
+                case 1:
+                    memcpy(row.frame, "-0000", 5);
+                    break;
+                case 2:
+                    memcpy(row.frame, (rand() % 2) ? "+0000" : "-0001", 5);
+                    break;
+                case 3:
+                    memcpy(row.frame, (rand() % 2) ? "+9999" : "-9999", 5);
+                    break;
+                case 4:
+                    // overflow, e.g. "?0:?"
+                    row.frame[1] = '?';
+                    for(int k = 2; k < 5; ++k) {
+                        row.frame[k] = 0x30 + rand() % 16;
+                    }
+                    break;
+                case 5:
+                    // corrupted frame
+                    for(int k = 0; k < 14; ++k) {
+                        row.frame[k] = rand() & 0xff;
+                    }
+                    break;
+            }
+            row.time = t;
+            Reading r;
+            FS9922_DMM3::decode(row.frame, r);
+            w.write(t, row.frame, r);
+            expected.push_back(row);
+        }
+    }
+    
+    std::vector<Column_Row> rows;
+    bool ok = true;
+    try {
+        Column_Reader reader(path);
+        for(size_t i = 0; i < reader.size(); ++i) {
+            if(reader.block(i).count > records) {
+                std::cerr << "Block " << i << " exceeds " << records;
+                std::cerr << " records\n";
+                ok = false;
+            }
+            reader.decode(i, rows);
+        }
+    } catch(std::exception& e) {
+        std::cerr << "Reading columns failed: " << e.what() << "\n";
+        ok = false;
+    }
+    unlink(path);
+    if(rows.size() != expected.size()) {
+        std::cerr << "Columns: " << rows.size() << " of " << expected.size();
+        std::cerr << " records restored (" << records << " per block)\n";
+        return false;
+    }
+    for(size_t i = 0; i < rows.size(); ++i) {
+        if(rows[i].time != expected[i].time
+            || rows[i].state != expected[i].state
+            || (rows[i].state == 0
+            && memcmp(rows[i].frame, expected[i].frame, 14) != 0)) {
+            std::cerr << "Columns: record " << i << " differs (";
+            std::cerr << records << " per block)\n";
+            return false;
+        }
+    }
+    return ok;
+}
+
+
+/**
+ * Print results as text
+ */
+static void print_text()
+{
+    for(size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        std::cout << r.name << ": " << r.best << " ns/" << r.unit;
+        std::cout << " (median " << r.median << ")\n";
+        if(r.name == "pipeline") {
+            std::cout << "  meters per core: ";
+            std::cout << (uint64_t)(1e9/(r.median*FRAME_RATE)) << "\n";
+        }
+    }
+}
+
+
+/**
+ * Print results as JSON
+ */
+static void print_json()
+{
+    std::cout << "{\"repeat\": " << repeat << ", \"frame_rate\": ";
+    std::cout << FRAME_RATE << ", \"benchmarks\": [";
+    for(size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        std::cout << (i ? ",\n  " : "\n  ");
+        std::cout << "{\"name\": \"" << r.name << "\", \"unit\": \"";
+        std::cout << r.unit << "\", \"n\": " << r.n;
+        std::cout << ", \"best_ns\": " << r.best;
+        std::cout << ", \"median_ns\": " << r.median << "}";
+    }
+    std::cout << "\n]";
+    for(size_t i = 0; i < results.size(); ++i) {
+        if(results[i].name == "pipeline") {
+            std::cout << ", \"meters_per_core\": ";
+            std::cout << (uint64_t)(1e9/(results[i].median*FRAME_RATE));
+        }
+    }
+    std::cout << "}\n";
+}
+
+
+int main(int argc, char* argv[])
+{
+    bool json = false;
+    int c;
+    while((c = getopt(argc, argv, "jr:")) != -1) {
+        switch(c) {
+            case 'j':
+                json = true;
+                break;
+            case 'r':
+                repeat = atoi(optarg);
+                repeat = (repeat < 1) ? 1 : repeat;
+                break;
+            default:
+                std::cerr << "Usage: ut61b_bench [-j] [-r <repeat>]\n";
+                return 1;
+        }
+    }
+    
+    std::vector<char> frames;
+    generate(frames, FRAMES);
+    
+    if(!verify_batch(frames)) {
+        return 1;
+    }
+    static const size_t RECORDS[4] = {1, 2, 63, 4096};
+    for(int i = 0; i < 4; ++i) {
+        if(!verify_columns(frames, FRAMES/4, RECORDS[i])) {
+            return 1;
+        }
+    }
+    
+    bench_sync(frames, FRAMES/4);
+    bench_accessors(frames, FRAMES);
+    bench_strings(frames, FRAMES);
+    bench_batch(frames, FRAMES, KERNEL_SCALAR);
+    bench_batch(frames, FRAMES, KERNEL_SSSE3);
+    bench_batch(frames, FRAMES, KERNEL_AVX2);
+    
+    if(json) {
+        print_json();
+    }
+    else {
+        print_text();
+    }
+    return 0;
+}
@@ -17,12 +17,40 @@
  */
 
 #include <iostream>
-#include <fstream>
-#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <exception>
+#include <stdexcept>
 #include <time.h>
 #include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
 #include "fs9922_dmm3.hh"
 #include "wch_ch9325.hh"
+#include "ch9325_manager.hh"
+#include "ch9325_sim.hh"
+#include "ch9325_stream.hh"
+#include "sink_pipeline.hh"
+#include "terminal_view.hh"
+#include "capture_file.hh"
+#include "decimal_format.hh"
+#include "encoder.hh"
+#include "column_file.hh"
+#include "segment_store.hh"
+#include "latency_histogram.hh"
+#include "metrics.hh"
+#include "metrics_exporter.hh"
+#include "publisher.hh"
+#include "shm_ring.hh"
+#include "live_plot.hh"
+#include "reading_stats.hh"
+#include "change_filter.hh"
 
 static const std::string VERSION = "1.0.0";
 
@@ -32,148 +60,1085 @@ int max_frame = 0;
 // maximum time to capture until program stops (0 = inf)
 int max_time = 0;
 
+// flag whether to capture data of all connected adapters
+bool all = false;
+
+// number of queued USB transfers (0 = synchronous transfers)
+int transfers = 4;
+
+// number of simulated adapters, their noise and mean time between disconnects
+int sim_count = 0;
+double sim_noise = 0;
+double sim_disconnects = 0;
+
+// path of a raw serial byte stream, e.g. a pty
+std::string stream;
+
+// maximum refresh rate of the live view in Hz (0 = unlimited)
+int refresh_rate = 10;
+
+// live view
+Terminal_View* view = 0;
+
+// flag whether each sink processes frames in a separate worker thread
+// decoupled from the USB reception, otherwise the sinks are called in the
+// receiving thread
+bool decoupled = true;
+
 // path to data log file
 std::string file;
 
-// file handle for data logging
-std::ofstream fh;
+// flag whether data is logged in the binary capture format
+bool binary = false;
+
+// flag whether data is logged in the compressed columnar format
+bool compressed = false;
+
+// fsync policy and interval of the log file
+fsync_t sync_policy = FSYNC_NEVER;
+int sync_interval = 1000;
+
+// log file
+Log_Writer* out = 0;
+
+// binary capture writer
+Capture_Writer* cap = 0;
+
+// compressed columnar capture writer
+Column_Writer* col = 0;
+
+// format of the log file, if not in a binary capture format, and its encoder
+std::string format = "text";
+Encoder* encoder = 0;
+
+// directory of the segmented store, maximum time span (in s) and size (in
+// MB) of a segment, number of kept segments per adapter and the store
+std::string store_dir;
+double segment_length = 3600;
+int segment_size = 64;
+int segment_keep = 0;
+Segment_Store* store = 0;
 
-// start time of capturing
-timeval t_start;
+// guards the log writers, which are expired by the event loop while the
+// log sink writes
+std::mutex log_mutex;
 
-// device object
+// monotonic time the collected blocks were last expired in ns
+uint64_t t_expire = 0;
+
+// monotonic reception time of the first frame in ns
+uint64_t t_first = 0;
+
+// flag whether the text log holds wall-clock times (seconds since epoch)
+bool wall_clock = false;
+
+// wall-clock anchor: monotonic time in ns and corresponding wall-clock time
+uint64_t t_anchor_mono = 0;
+timespec t_anchor_wall;
+
+// latencies from the reception of the data package completing a frame until
+// the frame is complete, processed and written to the log file, and of the
+// formatting of the log line
+Latency_Histogram lat_frame;
+Latency_Histogram lat_process;
+Latency_Histogram lat_format;
+Latency_Histogram lat_written;
+
+// device manager object
+CH9325_Manager* mgr = 0;
+
+// device object in synchronous transfer mode
 WCH_CH9325* dev = 0;
 
 // number of already captured frames
-int frame_no = 0;
+uint64_t frame_no = 0;
 
+// signalfd receiving SIGINT and SIGTERM, which stop capturing
+int sigfd = -1;
 
 /**
- * Callback which is called for each data frame
+ * Overflow policy and queue size of a sink
+ */
+struct Sink_Config
+{
+    const char* name;
+    overflow_t policy;
+    size_t capacity;
+    unsigned int sample;
+};
+
+// sinks of the frames: no sink blocks the fan-out by default, the log file
+// and the statistics have large queues and count the frames they lose, the
+// live view and shared memory readers see the latest frames, slow
+// subscribers lose the newest frames and the plot is thinned out
+Sink_Config sink_configs[] = {
+    {"log", OVERFLOW_DROP_NEWEST, 4096, 4},
+    {"stats", OVERFLOW_DROP_NEWEST, 4096, 4},
+    {"view", OVERFLOW_DROP_OLDEST, 1024, 4},
+    {"publish", OVERFLOW_DROP_NEWEST, 1024, 4},
+    {"shm", OVERFLOW_DROP_OLDEST, 1024, 4},
+    {"plot", OVERFLOW_SAMPLE, 1024, 4}
+};
+const size_t SINKS = sizeof(sink_configs)/sizeof(sink_configs[0]);
+
+// overflow policies of the sinks given on the command line
+std::vector<std::string> sink_policies;
+
+// fan-out of the frames to the sinks
+Sink_Pipeline* pipeline = 0;
+
+// address of the metrics listener and path of the stats file
+std::string metrics_address;
+std::string metrics_file;
+
+// metrics exporter
+Metrics_Exporter* exporter = 0;
+
+// listening addresses of the publisher
+std::vector<std::string> publish_addresses;
+
+// publisher of live readings
+Publisher* publisher = 0;
+
+// name of the shared memory ring and the ring itself
+std::string shm_ring_name;
+Shm_Ring_Writer* shm_ring = 0;
+
+// flag whether to plot the data and the live plot
+bool plotting = false;
+Live_Plot* plot = 0;
+
+// length of the sliding window of the statistics in s and the statistics
+double stats_window = 60;
+Reading_Stats* stats = 0;
+
+/**
+ * Statistics of the current mode of an adapter formatted for the live view
+ */
+struct Stats_Lines
+{
+    std::string total;
+    std::string window;
+};
+
+// statistics of each adapter shown in the live view, guarded by stats_mutex
+std::map<std::string, Stats_Lines> stats_lines;
+std::mutex stats_mutex;
+
+// deadband of the change-only logging ("" = log all frames), heartbeat
+// interval in s and the filter
+std::string deadband;
+double heartbeat = 60;
+Change_Filter* changes = 0;
+
+// counter of processed frames
+Metric_Counter* m_processed = 0;
+
+
+/**
+ * Return monotonic time in ns
+ */
+uint64_t now()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec*1000000000 + t.tv_nsec;
+}
+
+
+/**
+ * Return wall-clock time in ns since epoch of a monotonic time
+ */
+int64_t wall_time(uint64_t t)
+{
+    return t_anchor_wall.tv_sec*1000000000LL + t_anchor_wall.tv_nsec
+        + ((int64_t)t - (int64_t)t_anchor_mono);
+}
+
+
+/**
+ * Return percentiles of a latency histogram as text
+ */
+std::string latency2str(const Latency_Histogram& h)
+{
+    char s[128];
+    snprintf(s, sizeof(s), "p50 %.3f ms, p99 %.3f ms, max %.3f ms",
+        h.percentile(50)*1e-6, h.percentile(99)*1e-6, h.max()*1e-6);
+    return s;
+}
+
+
+/**
+ * Stop capturing of the device manager or the single device
+ */
+void stop_capture()
+{
+    if(mgr != 0) {
+        mgr->stop();
+    }
+    if(dev != 0) {
+        dev->stop();
+    }
+}
+
+
+/**
+ * Read a pending SIGINT or SIGTERM from the signalfd and stop capturing
+ */
+void handle_signal()
+{
+    signalfd_siginfo info;
+    if(read(sigfd, &info, sizeof(info)) != sizeof(info)) {
+        return;
+    }
+    std::cerr << "Received " << strsignal(info.ssi_signo) << ", stopping\n";
+    stop_capture();
+}
+
+
+/**
+ * Write the blocks of the compressed formats, whose time span has passed
+ * while no frames arrived, e.g. from a switched off meter. The check is
+ * done once a second.
+ */
+void expire_log()
+{
+    uint64_t t = now();
+    if(t - t_expire < 1000000000) {
+        return;
+    }
+    t_expire = t;
+    std::lock_guard<std::mutex> lock(log_mutex);
+    if(store != 0) {
+        store->expire(wall_time(t));
+    }
+    if(col != 0) {
+        col->expire(t - t_anchor_mono);
+    }
+}
+
+
+/**
+ * Run the event loop of the device manager, which also waits for SIGINT and
+ * SIGTERM
+ */
+void listen_manager()
+{
+    std::vector<pollfd> fds;
+    mgr->start();
+    while(true) {
+        fds.clear();
+        mgr->pollfds(fds);
+        pollfd f;
+        f.fd = sigfd;
+        f.events = POLLIN;
+        f.revents = 0;
+        fds.push_back(f);
+        poll(&fds[0], fds.size(), mgr->next_timeout(100));
+        if(fds.back().revents != 0) {
+            handle_signal();
+        }
+        if(!mgr->dispatch(fds)) {
+            break;
+        }
+        expire_log();
+    }
+    mgr->finish();
+}
+
+
+/**
+ * Wait for SIGINT or SIGTERM until the eventfd `quit` becomes readable
+ */
+void wait_signal(int quit)
+{
+    pollfd fds[2];
+    fds[0].fd = sigfd;
+    fds[1].fd = quit;
+    fds[0].events = fds[1].events = POLLIN;
+    while(true) {
+        fds[0].revents = fds[1].revents = 0;
+        int n = poll(fds, 2, 1000);
+        expire_log();
+        if(n < 0) {
+            continue;
+        }
+        if(fds[0].revents != 0) {
+            handle_signal();
+        }
+        if(fds[1].revents != 0) {
+            break;
+        }
+    }
+}
+
+
+/**
+ * Listen to the single device with blocking transfers, while a separate
+ * thread waits for SIGINT and SIGTERM
+ */
+void listen_device()
+{
+    int quit = eventfd(0, EFD_CLOEXEC);
+    if(quit < 0) {
+        throw std::runtime_error("Creating eventfd failed");
+    }
+    std::thread waiter(wait_signal, quit);
+    std::exception_ptr error;
+    try {
+        dev->listen();
+    } catch(...) {
+        error = std::current_exception();
+    }
+    uint64_t one = 1;
+    if(write(quit, &one, sizeof(one)) != sizeof(one)) {
+        std::cerr << "Stopping signal thread failed\n";
+    }
+    waiter.join();
+    close(quit);
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
+
+
+/**
+ * Write a single data frame to the log file
+ * \param path path of the adapter the frame originates from
  * \param data data frame
+ * \param r decoded reading
+ * \param t_report monotonic reception time of the frame in ns
+ * \param t_process monotonic time processing started in ns (0 = do not
+ *                  record formatting latency)
+ */
+void log_frame(const char* path, const char* data, const Reading& r,
+    uint64_t t_report, uint64_t t_process)
+{
+    if(store != 0) {
+        store->write(path, wall_time(t_report), data, r);
+    }
+    if(cap != 0) {
+        cap->write(t_report - t_anchor_mono, data, r, all ? path : 0);
+        if(t_process != 0) {
+            lat_format.record(now() - t_process);
+        }
+    }
+    else if(col != 0) {
+        col->write(t_report - t_anchor_mono, data, r);
+        if(t_process != 0) {
+            lat_format.record(now() - t_process);
+        }
+    }
+    else if(out != 0) {
+        char line[ENCODER_MAX];
+        int64_t t = wall_clock ? wall_time(t_report)
+            : (int64_t)(t_report - t_first);
+        size_t n = encoder->encode(line, path, t, data, r);
+        if(t_process != 0) {
+            lat_format.record(now() - t_process);
+        }
+        out->write(line, n, t_report);
+    }
+}
+
+
+/**
+ * Write the last suppressed frame of an adapter, so that the time its last
+ * logged value held is known
+ * \param path path of the adapter
+ */
+void flush_changes(const char* path)
+{
+    char data[14];
+    uint64_t t;
+    if(changes != 0 && changes->flush(path, data, t)) {
+        Reading r;
+        FS9922_DMM3::decode(data, r);
+        log_frame(path, data, r, t, 0);
+    }
+}
+
+
+/**
+ * Sink, which publishes a frame to the subscribers
+ */
+void publish_sink(const Sink_Record& rec, void*)
+{
+    if(rec.state == 0) {
+        publisher->publish(rec.path, wall_time(rec.t_report), rec.data,
+            rec.reading);
+    }
+}
+
+
+/**
+ * Sink, which writes a frame to the shared memory ring
+ */
+void shm_sink(const Sink_Record& rec, void*)
+{
+    if(rec.state != 0) {
+        return;
+    }
+    Shm_Record s;
+    Binary_Encoder::record(s, rec.path, wall_time(rec.t_report), rec.data,
+        rec.reading);
+    shm_ring->write(s);
+}
+
+
+/**
+ * Sink, which adds a frame to the live plot
+ */
+void plot_sink(const Sink_Record& rec, void*)
+{
+    if(rec.state != 0) {
+        return;
+    }
+    const Reading& r = rec.reading;
+    double elapsed = (rec.t_report - t_first)*1e-9;
+    plot->add(rec.path, elapsed, r.value,
+        FS9922_DMM3::unit_prefix2str((unit_prefix_t)r.prefix)
+        + FS9922_DMM3::unit2str((unit_t)r.unit));
+    plot->refresh(elapsed);
+}
+
+
+/**
+ * Sink, which adds a frame to the statistics of its adapter and formats them
+ * for the live view
  */
-void handle_frame(const char* data, void*)
+void stats_sink(const Sink_Record& rec, void*)
 {
-    FS9922_DMM3 frame(data);
+    if(rec.state != 0) {
+        return;
+    }
+    lat_process.record(now() - rec.t_frame);
+    m_processed->add();
     
-    if(frame_no == 0) {
-        // save start time
-        gettimeofday(&t_start, 0);
+    const Mode_Stats* m = stats->add(rec.path,
+        (rec.t_report - t_first)*1e-9, rec.reading);
+    if(m == 0) {
+        return;
     }
+    char line[128];
+    const Running_Stats& t = m->total;
+    snprintf(line, sizeof(line), "stats  : %s, n %llu, min %g, max %g, "
+        "mean %g, sd %g, rms %g", m->mode.c_str(),
+        (unsigned long long)t.count(), t.min(), t.max(), t.mean(),
+        t.stddev(), t.rms());
+    std::string total = line;
+    const Window_Stats& w = m->window;
+    snprintf(line, sizeof(line), "last %gs: n %llu, min %g, max %g, "
+        "mean %g, rms %g", w.length(), (unsigned long long)w.count(),
+        w.min(), w.max(), w.mean(), w.rms());
     
-    if(!fh.is_open()) {
-        // open log file for first time
-        // write column header
-        fh.open(file, std::ofstream::out);
-        fh << "# time[s] value_unscaled value prefix unit power min/max hold ";
-        fh << "rel auto apo bat diode beep\n";
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    Stats_Lines& l = stats_lines[rec.path];
+    l.total.swap(total);
+    l.window = line;
+}
+
+
+/**
+ * Sink, which shows a frame and the statistics of its adapter in the live
+ * view
+ */
+void view_sink(const Sink_Record& rec, void*)
+{
+    if(rec.state != 0) {
+        return;
     }
-    frame_no++;
+    const std::string path = rec.path;
+    const char* data = rec.data;
+    const Reading& r = rec.reading;
+    const Frame_Timing* timing = rec.timing;
     
     // get time since start of data capturing
-    timeval t_now;
-    gettimeofday(&t_now, 0);
-    double time = (t_now.tv_sec - t_start.tv_sec);
-    time += (t_now.tv_usec - t_start.tv_usec)/1e7;
-    
-    // write data to file
-    fh << time << " ";
-    fh << frame.value_unscaled() << " ";
-    fh << frame.value() << " ";
-    fh << frame.unit_prefix2str(frame.unit_prefix()) << " ";
-    fh << frame.unit2str(frame.unit()) << " ";
-    fh << frame.power2str(frame.power()) << " ";
-    fh << frame.minmax2str(frame.minmax()) << " ";
-    fh << frame.hold() << " ";
-    fh << frame.relative() << " ";
-    fh << frame.autorange() << " ";
-    fh << frame.autopoweroff() << " ";
-    fh << frame.lowbattery() << " ";
-    fh << frame.diode() << " ";
-    fh << frame.beep() << " ";
-    fh << "\n" << std::flush;
+    double elapsed = (rec.t_report - t_first)*1e-9;
     
-    // show data
-    system("clear");
-    std::cout << "Uni-T UT61B\n\n";
-    std::cout << "time   : ";
-    std::cout << std::fixed << std::setprecision(2) << time << " s";
+    char line[128];
+    view->set_line(0, "Uni-T UT61B");
+    int n = snprintf(line, sizeof(line), "time   : %.2f s", elapsed);
     if(max_time != 0) {
-        std::cout << " (max " << max_time << " s)";
+        snprintf(line+n, sizeof(line)-n, " (max %d s)", max_time);
     }
-    std::cout << "\n";
-    std::cout << "frame  : " << frame_no;
+    view->set_line(2, line);
+    n = snprintf(line, sizeof(line), "frame  : %llu",
+        (unsigned long long)rec.frame_no);
     if(max_frame != 0) {
-        std::cout << " (max " << max_frame << ")";
+        snprintf(line+n, sizeof(line)-n, " (max %d)", max_frame);
     }
-    std::cout << "\n";
-    std::cout << "value  : " << frame.value();
-    std::cout << " ";
-    std::cout << frame.unit_prefix2str(
-        frame.unit_prefix()
-    );
-    std::cout << frame.unit2str(
-        frame.unit()
-    );
-    std::cout << "\n";
-    std::cout << "status : ";
-    if(frame.hold()) {
-        std::cout << "HOLD ";
+    view->set_line(3, line);
+    view->set_line(4, "device : " + path);
+    char value[DECIMAL_MAX] = "inf";
+    if(!r.has(FLAG_OVERFLOW)) {
+        format_decimal(value, r.count, r.decimal);
+    }
+    snprintf(line, sizeof(line), "value  : %s ", value);
+    view->set_line(5, line
+        + FS9922_DMM3::unit_prefix2str((unit_prefix_t)r.prefix)
+        + FS9922_DMM3::unit2str((unit_t)r.unit));
+    std::string status = "status : ";
+    if(r.has(FLAG_HOLD)) {
+        status += "HOLD ";
     }
-    if(frame.relative()) {
-        std::cout << "REL ";
+    if(r.has(FLAG_RELATIVE)) {
+        status += "REL ";
     }
-    if(frame.autorange()) {
-        std::cout << "AUTO ";
+    if(r.has(FLAG_AUTORANGE)) {
+        status += "AUTO ";
     }
-    if(frame.autopoweroff()) {
-        std::cout << "APO ";
+    if(r.has(FLAG_AUTOPOWEROFF)) {
+        status += "APO ";
     }
-    if(frame.lowbattery()) {
-        std::cout << "BAT ";
+    if(r.has(FLAG_LOWBATTERY)) {
+        status += "BAT ";
     }
-    if(frame.diode()) {
-        std::cout << "DIODE ";
+    if(r.has(FLAG_DIODE)) {
+        status += "DIODE ";
     }
-    if(frame.beep()) {
-        std::cout << "BEEP ";
+    if(r.has(FLAG_BEEP)) {
+        status += "BEEP ";
     }
-    std::cout << frame.power2str(frame.power()) << " ";
-    std::cout << frame.minmax2str(frame.minmax()) << " ";
-    std::cout << "\n\n";
-    std::cout << "bargraph:\n";
-    if(frame.bargraph()) {
-        int v = frame.bargraph_value();
+    status += FS9922_DMM3::power2str((power_t)r.power) + " ";
+    status += FS9922_DMM3::minmax2str((minmax_t)r.minmax) + " ";
+    view->set_line(6, status);
+    view->set_line(8, "bargraph:");
+    if(r.has(FLAG_BARGRAPH)) {
+        int v = r.bargraph;
         int BAR_MAX = 40;
         int maxv = (std::abs(v) < BAR_MAX) ? abs(v) : BAR_MAX;
-        std::cout << ((v < 0) ? "-" : "+") << " [ ";
-        for(int i = 0; i < maxv; ++i) {
-            std::cout << "|";
+        std::string bar = (v < 0) ? "- [ " : "+ [ ";
+        bar.append(maxv, '|');
+        bar.append(BAR_MAX-maxv, ' ');
+        bar += " ]";
+        view->set_line(9, bar);
+        view->set_line(10, "    1        10        20        30        40");
+    }
+    else {
+        view->set_line(9, "");
+        view->set_line(10, "");
+    }
+    view->set_line(12, "raw value:");
+    for(int i=0; i < 14; ++i) {
+        snprintf(line+3*i, sizeof(line)-3*i, "%02x ", (unsigned char)data[i]);
+    }
+    view->set_line(13, line);
+    if(out != 0) {
+        view->set_line(15, "latency: " + latency2str(lat_written));
+    }
+    else {
+        view->set_line(15, "latency: " + latency2str(lat_process));
+    }
+    snprintf(line, sizeof(line),
+        "timing : interval %.1f ms, jitter %.2f ms, dropped %llu",
+        timing->interval()*1e-6, timing->jitter()*1e-6,
+        (unsigned long long)timing->dropped());
+    view->set_line(16, line);
+    Stats_Lines l;
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        std::map<std::string, Stats_Lines>::const_iterator it =
+            stats_lines.find(path);
+        if(it != stats_lines.end()) {
+            l = it->second;
         }
-        for(int i = maxv; i < BAR_MAX; ++i) {
-            std::cout << " ";
+    }
+    view->set_line(18, l.total);
+    view->set_line(19, l.window);
+    view->refresh();
+}
+
+
+/**
+ * Write a gap marker to the log file, whenever an adapter is lost or
+ * reconnected
+ * \param path path of the adapter
+ * \param connected whether the adapter is connected again
+ * \param t monotonic time of the event in ns
+ */
+void process_state(const char* path, bool connected, uint64_t t)
+{
+    if(!connected) {
+        flush_changes(path);
+    }
+    if(store != 0) {
+        store->mark(path, wall_time(t), connected);
+    }
+    if(cap != 0) {
+        cap->mark(t - t_anchor_mono, connected, all ? path : 0);
+    }
+    else if(col != 0) {
+        col->mark(t - t_anchor_mono, connected);
+    }
+    else if(out != 0) {
+        char line[ENCODER_MAX];
+        int64_t time = wall_clock ? wall_time(t) : (int64_t)(t - t_first);
+        size_t n = encoder->state(line, path, time, connected);
+        if(n > 0) {
+            out->write(line, n, t);
         }
-        std::cout << " ]\n";
-        std::cout << "    1        10        20        30        40";
     }
-    std::cout << "\n\n";
-    std::cout << "raw value:\n";
-    std::ios::fmtflags f(std::cout.flags()); // save std::cout format
-    for(int i=0; i < 14; ++i) {
-        std::cout << std::setw(2) << std::setfill('0') << std::hex;
-        std::cout << ((int)(unsigned char) data[i]) << " ";
+}
+
+
+/**
+ * Sink, which writes a frame or a gap marker to the log file
+ */
+void log_sink(const Sink_Record& rec, void*)
+{
+    std::lock_guard<std::mutex> lock(log_mutex);
+    if(rec.state != 0) {
+        process_state(rec.path, (rec.state > 0), rec.t_frame);
+        return;
     }
-    std::cout.flags(f); // restore std::cout format
-    std::cout << "\n";
+    uint64_t t_process = now();
+    if(changes == 0 || changes->pass(rec.path, rec.data, rec.reading,
+            rec.t_report)) {
+        log_frame(rec.path, rec.data, rec.reading, rec.t_report, t_process);
+    }
+}
+
+
+/**
+ * Pass frame or state change to the sinks
+ */
+void dispatch(const std::string& path, const char* data, int state,
+    uint64_t t_report, const Frame_Timing* timing)
+{
+    Sink_Record rec;
+    rec.t_report = t_report;
+    rec.t_frame = now();
+    rec.timing = timing;
+    rec.frame_no = frame_no;
+    strncpy(rec.path, path.c_str(), sizeof(rec.path)-1);
+    rec.path[sizeof(rec.path)-1] = 0;
+    if(data != 0) {
+        lat_frame.record(rec.t_frame - t_report);
+        memcpy(rec.data, data, 14);
+        FS9922_DMM3::decode(data, rec.reading);
+    }
+    rec.state = state;
+    pipeline->push(rec);
+}
+
+
+/**
+ * Callback which is called for each data frame
+ * \param dev device the frame originates from
+ * \param data data frame
+ */
+void handle_frame(const CH9325_Adapter* dev, const char* data, void*)
+{
+    uint64_t t_report = dev->frame_time();
+    if(frame_no == 0) {
+        t_first = t_report;
+    }
+    frame_no++;
+    dispatch(dev->path(), data, 0, t_report, &dev->timing());
     
     // check if max time is reached
-    if(max_time != 0 && time > max_time) {
-        dev->stop();
+    if(max_time != 0 && (t_report - t_first)*1e-9 > max_time) {
+        stop_capture();
     }
     
     // check if max frame is reached
-    if(max_frame != 0 && frame_no > max_frame) {
-        dev->stop();
+    if(max_frame != 0 && frame_no > (uint64_t)max_frame) {
+        stop_capture();
+    }
+}
+
+
+/**
+ * Callback which is called whenever an adapter is lost or reconnected
+ * \param path path of the adapter
+ * \param connected whether the adapter is connected again
+ */
+void handle_state(const std::string& path, bool connected, void*)
+{
+    Metrics_Registry& reg = Metrics_Registry::instance();
+    std::string l = Metrics_Registry::label("device", path);
+    reg.gauge("ut61b_device_connected", "Whether the adapter is connected",
+        l).set(connected);
+    if(!connected) {
+        reg.counter("ut61b_device_lost_total", "Number of lost connections",
+            l).add();
+    }
+    dispatch(path, 0, connected ? 1 : -1, 0, 0);
+}
+
+
+/**
+ * Callback which is called for each data frame in synchronous transfer mode
+ * \param data data frame
+ */
+void handle_frame_sync(const char* data, void*)
+{
+    handle_frame(dev, data, 0);
+}
+
+
+/**
+ * Return number of bytes written to the log file
+ */
+double log_bytes(const void* arg)
+{
+    return ((Log_Writer*)arg)->stats().bytes;
+}
+
+
+/**
+ * Return number of failed writes of the log file
+ */
+double log_errors(const void* arg)
+{
+    return ((Log_Writer*)arg)->stats().errors;
+}
+
+
+/**
+ * Return number of bytes dropped by the full queue of the log file
+ */
+double log_dropped(const void* arg)
+{
+    return ((Log_Writer*)arg)->stats().dropped;
+}
+
+
+/**
+ * Return number of queued bytes of the log file
+ */
+double log_queued(const void* arg)
+{
+    return ((Log_Writer*)arg)->queued();
+}
+
+
+/**
+ * Return number of frames processed by a sink
+ */
+double sink_processed(const void* arg)
+{
+    return ((const Sink*)arg)->processed();
+}
+
+
+/**
+ * Return number of frames dropped by a sink
+ */
+double sink_dropped(const void* arg)
+{
+    return ((const Sink*)arg)->dropped();
+}
+
+
+/**
+ * Return number of frames queued by a sink
+ */
+double sink_depth(const void* arg)
+{
+    return ((Sink*)arg)->depth();
+}
+
+
+/**
+ * Return number of frames staged for the fan-out thread
+ */
+double staging_depth(const void* arg)
+{
+    return ((const Sink_Pipeline*)arg)->staging_depth();
+}
+
+
+/**
+ * Return number of frames dropped by the full staging ring
+ */
+double staging_overflows(const void* arg)
+{
+    return ((const Sink_Pipeline*)arg)->staging_overflows();
+}
+
+
+/**
+ * Register metrics of the program and start exporting
+ */
+void init_metrics()
+{
+    Metrics_Registry& reg = Metrics_Registry::instance();
+    m_processed = &reg.counter("ut61b_processed_frames_total",
+        "Frames logged and shown");
+    static const char* STAGES[4] = {"frame", "process", "format", "written"};
+    const Latency_Histogram* hist[4] = {&lat_frame, &lat_process,
+        &lat_format, &lat_written};
+    for(int i = 0; i < 4; ++i) {
+        reg.summary("ut61b_latency_seconds",
+            "Time from the reception of a frame until it is complete, "
+            "processed, formatted and written",
+            Metrics_Registry::label("stage", STAGES[i]), hist[i]);
+    }
+    if(!metrics_address.empty() || !metrics_file.empty()) {
+        exporter = new Metrics_Exporter(reg, metrics_address, metrics_file);
+    }
+    if(!publish_addresses.empty()) {
+        publisher = new Publisher(publish_addresses);
+    }
+    if(!shm_ring_name.empty()) {
+        shm_ring = new Shm_Ring_Writer(shm_ring_name);
+    }
+    if(plotting) {
+        // a closed gnuplot must not terminate capturing
+        signal(SIGPIPE, SIG_IGN);
+        plot = new Live_Plot();
+    }
+}
+
+
+/**
+ * Create log file and write header
+ */
+void open_log()
+{
+    if(!store_dir.empty()) {
+        store = new Segment_Store(store_dir, segment_length,
+            (uint64_t)segment_size << 20, segment_keep, sync_policy,
+            sync_interval);
+    }
+    if(file.empty()) {
+        return;
+    }
+    out = new Log_Writer(file, sync_policy, sync_interval);
+    out->set_latency_histogram(&lat_written);
+    
+    Metrics_Registry& reg = Metrics_Registry::instance();
+    reg.probe("ut61b_log_written_bytes_total", "Bytes written to the log file",
+        "", METRIC_COUNTER, log_bytes, out);
+    reg.probe("ut61b_log_errors_total", "Failed writes of the log file", "",
+        METRIC_COUNTER, log_errors, out);
+    reg.probe("ut61b_log_queued_bytes", "Bytes waiting to be written", "",
+        METRIC_GAUGE, log_queued, out);
+    reg.probe("ut61b_log_dropped_bytes_total",
+        "Bytes dropped by the full queue of the log file", "", METRIC_COUNTER,
+        log_dropped, out);
+    if(compressed) {
+        col = new Column_Writer(*out, 4096, 600, wall_time(t_anchor_mono));
+    }
+    else if(binary) {
+        cap = new Capture_Writer(*out, wall_time(t_anchor_mono));
+    }
+    else {
+        char buf[ENCODER_MAX];
+        encoder = Encoder::create(format, all);
+        out->write(buf, encoder->header(buf));
+    }
+}
+
+
+/**
+ * Set overflow policy and queue size of a sink
+ * \param spec <sink>=<policy>[:<size>[:<n>]]
+ */
+void configure_sink(const std::string& spec)
+{
+    size_t eq = spec.find('=');
+    std::string name = spec.substr(0, eq);
+    for(size_t i = 0; eq != std::string::npos && i < SINKS; ++i) {
+        if(name != sink_configs[i].name) {
+            continue;
+        }
+        std::string policy = spec.substr(eq+1);
+        size_t colon = policy.find(':');
+        if(colon != std::string::npos) {
+            int size = atoi(policy.c_str()+colon+1);
+            if(size <= 0) {
+                throw std::runtime_error("Invalid queue size of sink " + name);
+            }
+            sink_configs[i].capacity = size;
+            size_t next = policy.find(':', colon+1);
+            if(next != std::string::npos) {
+                sink_configs[i].sample = atoi(policy.c_str()+next+1);
+            }
+            policy.erase(colon);
+        }
+        sink_configs[i].policy = Sink_Pipeline::str2policy(policy);
+        return;
+    }
+    throw std::runtime_error("Unknown sink " + spec);
+}
+
+
+/**
+ * Attach a sink to the pipeline and register its metrics
+ * \param name name of the sink
+ * \param callback callback of the sink
+ */
+void add_sink(const std::string& name, sink_callback_t callback)
+{
+    const Sink_Config* cfg = 0;
+    for(size_t i = 0; i < SINKS; ++i) {
+        if(name == sink_configs[i].name) {
+            cfg = &sink_configs[i];
+        }
+    }
+    Sink* sink = new Sink(name, callback, 0, cfg->policy,
+        decoupled ? cfg->capacity : 0, cfg->sample);
+    pipeline->add(sink);
+    
+    Metrics_Registry& reg = Metrics_Registry::instance();
+    std::string l = Metrics_Registry::label("sink", name);
+    reg.probe("ut61b_sink_processed_frames_total", "Frames processed by a sink",
+        l, METRIC_COUNTER, sink_processed, sink);
+    reg.probe("ut61b_sink_dropped_frames_total",
+        "Frames dropped by the full queue of a sink", l, METRIC_COUNTER,
+        sink_dropped, sink);
+    reg.probe("ut61b_sink_queue_depth", "Frames waiting in the queue of "
+        "a sink", l, METRIC_GAUGE, sink_depth, sink);
+}
+
+
+/**
+ * Create the sinks of all enabled outputs
+ */
+void init_sinks()
+{
+    pipeline = new Sink_Pipeline(decoupled);
+    if(decoupled) {
+        Metrics_Registry& reg = Metrics_Registry::instance();
+        reg.probe("ut61b_ring_depth", "Frames waiting in the ring buffer "
+            "of the fan-out thread", "", METRIC_GAUGE, staging_depth,
+            pipeline);
+        reg.probe("ut61b_ring_overflows_total", "Frames dropped by the full "
+            "ring buffer of the fan-out thread", "", METRIC_COUNTER,
+            staging_overflows, pipeline);
+    }
+    if(out != 0 || store != 0) {
+        add_sink("log", log_sink);
+    }
+    add_sink("stats", stats_sink);
+    add_sink("view", view_sink);
+    if(publisher != 0) {
+        add_sink("publish", publish_sink);
+    }
+    if(shm_ring != 0) {
+        add_sink("shm", shm_sink);
+    }
+    if(plot != 0) {
+        add_sink("plot", plot_sink);
+    }
+}
+
+
+/**
+ * Process remaining frames, stop and delete the sinks and print their
+ * statistics
+ */
+void close_sinks()
+{
+    if(pipeline == 0) {
+        return;
+    }
+    pipeline->stop();
+    Metrics_Registry::instance().remove(pipeline);
+    if(decoupled) {
+        std::cerr << "Ring buffer: " << pipeline->staging_overflows();
+        std::cerr << " overflows, high water ";
+        std::cerr << pipeline->staging_high_water() << "/" << SINK_STAGING;
+        std::cerr << "\n";
+    }
+    for(size_t i = 0; i < pipeline->size(); ++i) {
+        Sink* sink = pipeline->sink(i);
+        Metrics_Registry::instance().remove(sink);
+        std::cerr << "Sink " << sink->name() << ": " << sink->processed();
+        std::cerr << " frames processed, " << sink->dropped() << " dropped, ";
+        if(sink->capacity() == 0) {
+            std::cerr << "called inline\n";
+            continue;
+        }
+        std::cerr << sink->blocked() << " blocked, high water ";
+        std::cerr << sink->high_water() << "/" << sink->capacity() << " (";
+        std::cerr << Sink_Pipeline::policy2str(sink->policy()) << ")\n";
+    }
+    delete pipeline;
+    pipeline = 0;
+}
+
+
+/**
+ * Close log file and print its statistics
+ */
+void close_log()
+{
+    delete store;
+    store = 0;
+    if(out == 0) {
+        return;
+    }
+    
+    // the last block is written on destruction
+    delete col;
+    col = 0;
+    out->close();
+    Metrics_Registry::instance().remove(out);
+    Log_Stats st = out->stats();
+    delete cap;
+    cap = 0;
+    delete encoder;
+    encoder = 0;
+    delete out;
+    out = 0;
+    std::cerr << "Log file: " << st.bytes << " bytes in " << st.writes;
+    std::cerr << " writes, " << st.fsyncs << " fsyncs, max queue ";
+    std::cerr << st.queue_max << " bytes, " << st.dropped;
+    std::cerr << " bytes dropped, write latency ";
+    if(st.writes > 0) {
+        std::cerr << "avg " << st.latency_sum/st.writes*1e3 << " ms, ";
+    }
+    std::cerr << "max " << st.latency_max*1e3 << " ms\n";
+}
+
+
+/**
+ * Print link statistics of a device
+ */
+void print_link(const CH9325_Adapter* dev)
+{
+    if(dev == 0) {
+        return;
+    }
+    const Frame_Sync& sync = dev->synchronizer();
+    std::cerr << "Device " << dev->path() << ": " << sync.accepted();
+    std::cerr << " frames accepted, " << sync.rejected() << " rejected, ";
+    std::cerr << sync.skipped() << " bytes skipped\n";
+    const Frame_Timing& timing = dev->timing();
+    std::cerr << "  interval " << timing.interval()*1e-6 << " ms, jitter ";
+    std::cerr << timing.jitter()*1e-6 << " ms, " << timing.dropped();
+    std::cerr << " frames dropped, intervals ";
+    std::cerr << latency2str(timing.intervals()) << "\n";
+}
+
+
+/**
+ * Print latency histograms
+ */
+void print_latency()
+{
+    static const char* NAMES[4] = {"frame complete", "frame processed",
+        "line formatted", "log written"};
+    const Latency_Histogram* hist[4] = {&lat_frame, &lat_process,
+        &lat_format, &lat_written};
+    std::cerr << "Latency:\n";
+    for(int i = 0; i < 4; ++i) {
+        const Latency_Histogram& h = *hist[i];
+        if(h.count() == 0) {
+            continue;
+        }
+        char s[256];
+        snprintf(s, sizeof(s), "  %-16s %8llu frames, min %.3f ms, mean "
+            "%.3f ms, p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, p99.9 %.3f ms, "
+            "max %.3f ms\n", NAMES[i], (unsigned long long)h.count(),
+            h.min()*1e-6, h.mean()*1e-6, h.percentile(50)*1e-6,
+            h.percentile(90)*1e-6, h.percentile(99)*1e-6,
+            h.percentile(99.9)*1e-6, h.max()*1e-6);
+        std::cerr << s;
     }
 }
 
@@ -191,8 +1156,68 @@ void usage()
     std::cout << "-h            show help\n";
     std::cout << "-v            show version\n";
     std::cout << "-f <file>     log data to file\n";
+    std::cout << "-o <dir>      log data to a store of rotating segments per\n";
+    std::cout << "              adapter, which is queried with ut61b_query\n";
+    std::cout << "-l <time>     maximum time span (in sec) of a segment\n";
+    std::cout << "              (default 3600)\n";
+    std::cout << "-b <size>     maximum size (in MB) of a segment (default 64)\n";
+    std::cout << "-L <count>    number of segments kept per adapter\n";
+    std::cout << "              (default 0 = all)\n";
+    std::cout << "-w            log wall-clock time (seconds since epoch)\n";
+    std::cout << "              instead of the time since the first frame\n";
+    std::cout << "-F <format>   format of the log file: text (default), csv,\n";
+    std::cout << "              or json (JSON lines)\n";
+    std::cout << "-B            log data in the binary capture format, which can\n";
+    std::cout << "              be converted to text with ut61b_conv\n";
+    std::cout << "-Z            log data in the compressed columnar capture\n";
+    std::cout << "              format, which can be converted to text with\n";
+    std::cout << "              ut61b_conv\n";
+    std::cout << "-y <policy>   fsync policy of the log file: never (default),\n";
+    std::cout << "              record or an interval in ms\n";
     std::cout << "-n <frames>   maximum count of data frames to capture\n";
     std::cout << "-t <time>     maximum time (in sec) to capture data\n";
+    std::cout << "-a            capture data of all connected adapters\n";
+    std::cout << "-d            hand frames over to a fan-out thread and\n";
+    std::cout << "              process them in a separate thread per sink\n";
+    std::cout << "              (log, stats, view, publish, shm, plot)\n";
+    std::cout << "              decoupled from the USB reception (default)\n";
+    std::cout << "-I            call the sinks directly in the thread receiving\n";
+    std::cout << "              the USB data instead\n";
+    std::cout << "-P <sink>=<policy>[:<size>[:<n>]]\n";
+    std::cout << "              overflow policy of the queue of a sink:\n";
+    std::cout << "              block, drop-oldest, drop-newest or sample\n";
+    std::cout << "              (every n-th frame once half full, default 4)\n";
+    std::cout << "-m <address>  serve metrics in the Prometheus text format on\n";
+    std::cout << "              a Unix socket path, a local TCP port or at\n";
+    std::cout << "              host:port\n";
+    std::cout << "-M <file>     rewrite metrics to file every second\n";
+    std::cout << "-p <address>  publish readings to subscribers connecting to\n";
+    std::cout << "              a Unix socket path, a local TCP port or\n";
+    std::cout << "              host:port, as JSON lines or with prefix bin:\n";
+    std::cout << "              as binary records (can be repeated)\n";
+    std::cout << "-c <band>     log only changed frames: raw compares the raw\n";
+    std::cout << "              data, a value the difference to the last\n";
+    std::cout << "              logged value and a value with % the relative\n";
+    std::cout << "              difference\n";
+    std::cout << "-H <time>     log an unchanged frame at least every <time>\n";
+    std::cout << "              sec with -c (default 60, 0 = never)\n";
+    std::cout << "-T <time>     length (in sec) of the sliding window of the\n";
+    std::cout << "              statistics (default 60)\n";
+    std::cout << "-g            plot the data live via gnuplot\n";
+    std::cout << "-s <name>     write readings to a ring in shared memory\n";
+    std::cout << "              (read with ut61b_shm)\n";
+    std::cout << "-r <rate>     maximum refresh rate of the live view in Hz\n";
+    std::cout << "              (default 10, 0 = unlimited)\n";
+    std::cout << "-q <count>    number of queued USB transfers (default 4,\n";
+    std::cout << "              0 = synchronous transfers)\n";
+    std::cout << "-S <count>    capture data of simulated adapters instead of\n";
+    std::cout << "              USB adapters\n";
+    std::cout << "-N <prob>     probability of a corrupted byte of simulated\n";
+    std::cout << "              adapters (default 0)\n";
+    std::cout << "-D <time>     mean time (in sec) between disconnects of\n";
+    std::cout << "              simulated adapters (default 0 = never)\n";
+    std::cout << "-i <path>     capture raw serial data read from a file or\n";
+    std::cout << "              pty instead of USB adapters\n";
     std::cout << "\n";
     std::cout << "This program is free software: you can redistribute it and/or modify\n";
     std::cout << "it under the terms of the GNU General Public License as published by\n";
@@ -214,7 +1239,7 @@ int main(int argc, char* argv[])
     // parse command line arguments
     int c;
     opterr = 0;
-    while((c = getopt(argc, argv, "hvf:n:t:")) != -1) {
+    while((c = getopt(argc, argv, "hvadIBZgwf:F:P:n:t:q:r:y:S:N:D:i:m:M:p:s:T:c:H:o:l:b:L:")) != -1) {
         switch(c) {
             case 'h':
                 usage();
@@ -222,6 +1247,31 @@ int main(int argc, char* argv[])
             case 'v':
                 std::cout << VERSION << "\n";
                 return 0;
+            case 'a':
+                all = true;
+                break;
+            case 'd':
+                decoupled = true;
+                break;
+            case 'I':
+                decoupled = false;
+                break;
+            case 'P':
+                sink_policies.push_back(optarg);
+                break;
+            case 'B':
+                binary = true;
+                break;
+            case 'F':
+                format = optarg;
+                break;
+            case 'Z':
+                binary = true;
+                compressed = true;
+                break;
+            case 'w':
+                wall_clock = true;
+                break;
             case 'f':
                 file = optarg;
                 break;
@@ -231,6 +1281,72 @@ int main(int argc, char* argv[])
             case 't':
                 max_time = atoi(optarg);
                 break;
+            case 'q':
+                transfers = atoi(optarg);
+                break;
+            case 'r':
+                refresh_rate = atoi(optarg);
+                break;
+            case 'S':
+                sim_count = atoi(optarg);
+                break;
+            case 'N':
+                sim_noise = atof(optarg);
+                break;
+            case 'D':
+                sim_disconnects = atof(optarg);
+                break;
+            case 'i':
+                stream = optarg;
+                break;
+            case 'm':
+                metrics_address = optarg;
+                break;
+            case 'M':
+                metrics_file = optarg;
+                break;
+            case 'p':
+                publish_addresses.push_back(optarg);
+                break;
+            case 'g':
+                plotting = true;
+                break;
+            case 'T':
+                stats_window = atof(optarg);
+                break;
+            case 'c':
+                deadband = optarg;
+                break;
+            case 'H':
+                heartbeat = atof(optarg);
+                break;
+            case 'o':
+                store_dir = optarg;
+                break;
+            case 'l':
+                segment_length = atof(optarg);
+                break;
+            case 'b':
+                segment_size = atoi(optarg);
+                break;
+            case 'L':
+                segment_keep = atoi(optarg);
+                break;
+            case 's':
+                shm_ring_name = optarg;
+                break;
+            case 'y':
+                if(std::string(optarg) == "never") {
+                    sync_policy = FSYNC_NEVER;
+                }
+                else if(std::string(optarg) == "record") {
+                    sync_policy = FSYNC_RECORD;
+                }
+                else {
+                    sync_policy = FSYNC_INTERVAL;
+                    sync_interval = atoi(optarg);
+                }
+                break;
             case '?':
                 if(optopt == 'f') {
                     std::cerr << "Option -f requires a file name\n";
@@ -241,6 +1357,42 @@ int main(int argc, char* argv[])
                 else if(optopt == 't') {
                     std::cerr << "Option -t requires a time (in sec.)\n";
                 }
+                else if(optopt == 'q') {
+                    std::cerr << "Option -q requires a transfer count\n";
+                }
+                else if(optopt == 'r') {
+                    std::cerr << "Option -r requires a refresh rate\n";
+                }
+                else if(optopt == 'y') {
+                    std::cerr << "Option -y requires an fsync policy\n";
+                }
+                else if(optopt == 'S') {
+                    std::cerr << "Option -S requires an adapter count\n";
+                }
+                else if(optopt == 'N') {
+                    std::cerr << "Option -N requires a probability\n";
+                }
+                else if(optopt == 'D') {
+                    std::cerr << "Option -D requires a time (in sec.)\n";
+                }
+                else if(optopt == 'i') {
+                    std::cerr << "Option -i requires a path\n";
+                }
+                else if(optopt == 'm') {
+                    std::cerr << "Option -m requires an address\n";
+                }
+                else if(optopt == 'M') {
+                    std::cerr << "Option -M requires a file name\n";
+                }
+                else if(optopt == 'p') {
+                    std::cerr << "Option -p requires an address\n";
+                }
+                else if(optopt == 'P') {
+                    std::cerr << "Option -P requires a sink policy\n";
+                }
+                else if(optopt == 'F') {
+                    std::cerr << "Option -F requires a format\n";
+                }
                 else {
                     std::cerr << "Invalid option '" << (char)optopt << "'\n";
                 }
@@ -252,15 +1404,150 @@ int main(int argc, char* argv[])
         }
     }
     
+    if(all && compressed) {
+        std::cerr << "The compressed format holds a single adapter, use -o\n";
+        std::cerr << "for several adapters\n";
+        return 1;
+    }
+    if(format != "text" && format != "csv" && format != "json") {
+        std::cerr << "Unknown log format '" << format << "'\n";
+        std::cerr << "Type ut61b_cli -h for help\n";
+        return 1;
+    }
+    
+    try {
+        for(size_t i = 0; i < sink_policies.size(); ++i) {
+            configure_sink(sink_policies[i]);
+        }
+    } catch(std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    
+    // SIGINT and SIGTERM are received via a signalfd and have to be blocked
+    // in all threads, so that capturing stops and the remaining frames are
+    // written to the sinks and the log file
+    sigset_t sigmask;
+    sigemptyset(&sigmask);
+    sigaddset(&sigmask, SIGINT);
+    sigaddset(&sigmask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sigmask, 0);
+    sigfd = signalfd(-1, &sigmask, SFD_NONBLOCK|SFD_CLOEXEC);
+    if(sigfd < 0) {
+        std::cerr << "Error: Creating signalfd failed\n";
+        return 1;
+    }
+    
+    view = new Terminal_View(20, refresh_rate);
+    stats = new Reading_Stats(stats_window);
+    if(deadband == "raw") {
+        changes = new Change_Filter(CHANGE_RAW, 0, heartbeat);
+    }
+    else if(!deadband.empty() && deadband[deadband.size()-1] == '%') {
+        changes = new Change_Filter(CHANGE_RELATIVE,
+            atof(deadband.c_str())*0.01, heartbeat);
+    }
+    else if(!deadband.empty()) {
+        changes = new Change_Filter(CHANGE_ABSOLUTE, atof(deadband.c_str()),
+            heartbeat);
+    }
+    
+    // anchor of the wall-clock time
+    t_anchor_mono = now();
+    clock_gettime(CLOCK_REALTIME, &t_anchor_wall);
+    
     // open device and start listening
+    int ret = 0;
     try{
-        dev = new WCH_CH9325();
-        dev->set_callback(handle_frame, 0);
-        dev->listen();
-        delete dev;
+        init_metrics();
+        if(sim_count > 0 || !stream.empty()) {
+            // simulated adapters and streams replace USB adapters
+            mgr = new CH9325_Manager();
+            for(int i = 0; i < sim_count; ++i) {
+                std::ostringstream ss;
+                ss << "sim" << i;
+                CH9325_Sim* sim = new CH9325_Sim(ss.str(), i+1);
+                sim->set_noise(sim_noise);
+                sim->set_disconnects(sim_disconnects);
+                mgr->add(sim);
+            }
+            if(!stream.empty()) {
+                mgr->add(new CH9325_Stream(stream));
+            }
+            all = (mgr->size() > 1);
+            if(all && compressed) {
+                throw std::runtime_error("The compressed format holds a "
+                    "single adapter, use -o for several adapters");
+            }
+            mgr->set_callback(handle_frame, 0);
+            mgr->set_state_callback(handle_state, 0);
+            open_log();
+            init_sinks();
+            listen_manager();
+        }
+        else if(all || transfers > 0) {
+            mgr = new CH9325_Manager();
+            mgr->set_transfers(transfers);
+            if(mgr->open_usb(all ? 0 : 1) == 0) {
+                throw std::runtime_error("No device found");
+            }
+            mgr->set_callback(handle_frame, 0);
+            mgr->set_state_callback(handle_state, 0);
+            open_log();
+            init_sinks();
+            listen_manager();
+        }
+        else {
+            // synchronous transfers of a single device
+            dev = new WCH_CH9325();
+            dev->set_callback(handle_frame_sync, 0);
+            dev->set_transfers(0);
+            open_log();
+            init_sinks();
+            listen_device();
+        }
     } catch(std::exception& e) {
         std::cerr << "Error: " << e.what() << "\n";
-        return 1;
+        ret = 1;
+    }
+    
+    // a further SIGINT or SIGTERM terminates immediately, while the
+    // remaining frames are processed
+    pthread_sigmask(SIG_UNBLOCK, &sigmask, 0);
+    
+    // process remaining frames
+    close_sinks();
+    delete exporter;
+    exporter = 0;
+    delete publisher;
+    publisher = 0;
+    delete shm_ring;
+    shm_ring = 0;
+    delete plot;
+    plot = 0;
+    delete view;
+    view = 0;
+    for(size_t i = 0; mgr != 0 && i < mgr->size(); ++i) {
+        print_link(mgr->device(i));
+    }
+    print_link(dev);
+    print_latency();
+    stats->summary(std::cerr);
+    delete stats;
+    stats = 0;
+    delete mgr;
+    delete dev;
+    if(changes != 0) {
+        while(changes->size() > 0) {
+            flush_changes(changes->device(0).c_str());
+        }
+        std::cerr << "Change filter: " << changes->passed();
+        std::cerr << " frames logged, " << changes->suppressed();
+        std::cerr << " suppressed\n";
+        delete changes;
+        changes = 0;
     }
-    return 0;
+    close_log();
+    close(sigfd);
+    return ret;
 }
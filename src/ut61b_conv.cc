@@ -0,0 +1,180 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <vector>
+#include <unistd.h>
+#include <string.h>
+#include "capture_file.hh"
+#include "column_file.hh"
+#include "decimal_format.hh"
+
+
+/**
+ * Print program usage
+ */
+void usage()
+{
+    std::cout << "Converts binary and compressed capture files of ut61b_cli to the text\n";
+    std::cout << "log format\n";
+    std::cout << "Copyright (C) 2014 Lukas Schwarz\n";
+    std::cout << "\n";
+    std::cout << "Usage: ut61b_conv [OPTION] <file>\n";
+    std::cout << "Options:\n";
+    std::cout << "-h            show help\n";
+    std::cout << "-r            truncate torn records at the end of the file\n";
+    std::cout << "              before converting (e.g. after a crash), a torn\n";
+    std::cout << "              block of a compressed file is always skipped\n";
+}
+
+
+/**
+ * Print comment line of a lost or reconnected adapter
+ * \param time time since start of capture in s
+ * \param device path of the adapter (empty = unknown)
+ * \param connected whether the adapter was reconnected or lost
+ */
+void print_state(double time, const std::string& device, bool connected)
+{
+    // blank line interrupts the plotted line in gnuplot
+    char buf[DECIMAL_MAX];
+    std::cout << "\n# ";
+    std::cout.write(buf, format_fixed(buf, time, 6));
+    if(!device.empty()) {
+        std::cout << " device " << device;
+    }
+    std::cout << (connected ? " reconnected\n" : " lost\n");
+}
+
+
+/**
+ * Convert compressed columnar capture file
+ */
+void convert_columns(const std::string& file)
+{
+    Column_Reader reader(file);
+    capture_text_header(std::cout);
+    std::cout << "\n";
+    std::vector<Column_Row> rows;
+    for(size_t i = 0; i < reader.size(); ++i) {
+        rows.clear();
+        try {
+            reader.decode(i, rows);
+        } catch(std::exception& e) {
+            std::cerr << "Skipping corrupted block " << i << "\n";
+            continue;
+        }
+        for(size_t k = 0; k < rows.size(); ++k) {
+            if(rows[k].state != 0) {
+                print_state(rows[k].time*1e-9, "",
+                    rows[k].state == COLUMN_RECONNECTED);
+                continue;
+            }
+            capture_text_line(std::cout, rows[k].time*1e-9,
+                FS9922_DMM3(rows[k].frame).reading());
+            std::cout << "\n";
+        }
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    // parse command line arguments
+    bool recover = false;
+    int c;
+    opterr = 0;
+    while((c = getopt(argc, argv, "hr")) != -1) {
+        switch(c) {
+            case 'h':
+                usage();
+                return 0;
+            case 'r':
+                recover = true;
+                break;
+            default:
+                std::cerr << "Invalid option '" << (char)optopt << "'\n";
+                std::cerr << "Type ut61b_conv -h for help\n";
+                return 1;
+        }
+    }
+    if(optind != argc-1) {
+        std::cerr << "Missing capture file\n";
+        std::cerr << "Type ut61b_conv -h for help\n";
+        return 1;
+    }
+    std::string file = argv[optind];
+    
+    try {
+        if(Column_Reader::probe(file)) {
+            convert_columns(file);
+            return 0;
+        }
+        if(recover) {
+            size_t n = Capture_Reader::recover(file);
+            std::cerr << n << " records recovered\n";
+        }
+        
+        Capture_Reader reader(file);
+        
+        // a capture of several adapters starts with a device record
+        bool tagged = (reader.size() > 0 && reader[0].declaration());
+        std::vector<std::string> devices;
+        uint16_t declared = 0;
+        capture_text_header(std::cout);
+        std::cout << (tagged ? " device\n" : "\n");
+        for(size_t i = 0; i < reader.size(); ++i) {
+            const Capture_Record& r = reader[i];
+            if(!r.valid()) {
+                std::cerr << "Skipping corrupted record " << i << "\n";
+                continue;
+            }
+            if(r.declaration()) {
+                // long paths continue in the following device records
+                size_t d = r.device & 0x7fff;
+                if(devices.size() <= d) {
+                    devices.resize(d+1);
+                }
+                if(declared != r.device) {
+                    devices[d].clear();
+                }
+                devices[d].append(r.frame, strnlen(r.frame, sizeof(r.frame)));
+                declared = r.device;
+                continue;
+            }
+            declared = 0;
+            if(r.state()) {
+                size_t d = r.device & 0x3fff;
+                print_state(r.time*1e-9, tagged ? ((d < devices.size())
+                    ? devices[d] : "?") : "", r.connected());
+                continue;
+            }
+            capture_text_line(std::cout, r.time*1e-9,
+                FS9922_DMM3(r.frame).reading());
+            if(tagged) {
+                std::cout << ((r.device < devices.size())
+                    ? devices[r.device] : "?") << " ";
+            }
+            std::cout << "\n";
+        }
+    } catch(std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
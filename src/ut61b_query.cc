@@ -0,0 +1,224 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "segment_store.hh"
+
+
+/**
+ * Aggregate of a time bucket
+ */
+struct Bucket
+{
+    uint64_t count;
+    double min;
+    double max;
+    double sum;
+};
+
+
+/**
+ * State of a query of a single adapter
+ */
+struct Query
+{
+    std::string channel;
+    int64_t from;
+    int64_t to;
+    
+    // buckets of an aggregating query (empty = print records)
+    std::vector<Bucket> buckets;
+};
+
+
+/**
+ * Print program usage
+ */
+void usage()
+{
+    std::cout << "Reads a time range from a capture store of ut61b_cli\n";
+    std::cout << "Copyright (C) 2014 Lukas Schwarz\n";
+    std::cout << "\n";
+    std::cout << "Usage: ut61b_query [OPTION] <dir> <from> <to>\n";
+    std::cout << "Times are given in seconds since epoch or as local time\n";
+    std::cout << "YYYY-MM-DD HH:MM:SS\n";
+    std::cout << "Options:\n";
+    std::cout << "-h            show help\n";
+    std::cout << "-d <device>   read only the given adapter (directory name\n";
+    std::cout << "              in the store)\n";
+    std::cout << "-n <count>    print count, minimum, maximum and mean of the\n";
+    std::cout << "              unscaled values in <count> time buckets\n";
+    std::cout << "              instead of the records\n";
+    std::cout << "-v            print number of segments and blocks read\n";
+}
+
+
+/**
+ * Parse time
+ * \return time in ns since epoch or -1 if invalid
+ */
+int64_t parse_time(const std::string& s)
+{
+    if(s.find_first_not_of("0123456789.") == std::string::npos) {
+        return (int64_t)(atof(s.c_str())*1e9);
+    }
+    tm t = {};
+    const char* end = strptime(s.c_str(), "%Y-%m-%d %H:%M:%S", &t);
+    if(end == 0 || *end != 0) {
+        end = strptime(s.c_str(), "%Y-%m-%dT%H:%M:%S", &t);
+    }
+    if(end == 0 || *end != 0) {
+        return -1;
+    }
+    t.tm_isdst = -1;
+    return (int64_t)mktime(&t)*1000000000;
+}
+
+
+/**
+ * Print or aggregate a record
+ */
+void handle_row(const Column_Row& row, void* arg)
+{
+    Query& q = *(Query*)arg;
+    if(row.state != 0) {
+        // blank line interrupts the plotted line in gnuplot
+        if(q.buckets.empty()) {
+            char s[64];
+            snprintf(s, sizeof(s), "\n# %.6f device ", row.time*1e-9);
+            std::cout << s << q.channel << ((row.state == COLUMN_RECONNECTED)
+                ? " reconnected\n" : " lost\n");
+        }
+        return;
+    }
+    Reading r;
+    FS9922_DMM3::decode(row.frame, r);
+    if(q.buckets.empty()) {
+        capture_text_line(std::cout, row.time*1e-9, r);
+        std::cout << q.channel << "\n";
+        return;
+    }
+    if(r.has(FLAG_OVERFLOW)) {
+        return;
+    }
+    size_t i = (size_t)((double)((int64_t)row.time - q.from)
+        /(q.to - q.from + 1)*q.buckets.size());
+    Bucket& b = q.buckets[(i < q.buckets.size()) ? i : q.buckets.size()-1];
+    if(b.count == 0 || r.value_unscaled < b.min) {
+        b.min = r.value_unscaled;
+    }
+    if(b.count == 0 || r.value_unscaled > b.max) {
+        b.max = r.value_unscaled;
+    }
+    b.sum += r.value_unscaled;
+    b.count++;
+}
+
+
+int main(int argc, char* argv[])
+{
+    // parse command line arguments
+    std::string device;
+    int buckets = 0;
+    bool verbose = false;
+    int c;
+    opterr = 0;
+    while((c = getopt(argc, argv, "hd:n:v")) != -1) {
+        switch(c) {
+            case 'h':
+                usage();
+                return 0;
+            case 'd':
+                device = optarg;
+                break;
+            case 'n':
+                buckets = atoi(optarg);
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            default:
+                std::cerr << "Invalid option '" << (char)optopt << "'\n";
+                std::cerr << "Type ut61b_query -h for help\n";
+                return 1;
+        }
+    }
+    if(optind != argc-3) {
+        std::cerr << "Missing store or time range\n";
+        std::cerr << "Type ut61b_query -h for help\n";
+        return 1;
+    }
+    int64_t from = parse_time(argv[optind+1]);
+    int64_t to = parse_time(argv[optind+2]);
+    if(from < 0 || to < from) {
+        std::cerr << "Invalid time range\n";
+        return 1;
+    }
+    
+    try {
+        Segment_Query store(argv[optind]);
+        std::vector<std::string> channels;
+        if(device.empty()) {
+            channels = store.channels();
+        }
+        else {
+            channels.push_back(Segment_Store::channel(device));
+        }
+        if(buckets > 0) {
+            std::cout << "# time[s] count min max mean device\n";
+        }
+        else {
+            capture_text_header(std::cout);
+            std::cout << " device\n";
+        }
+        for(size_t i = 0; i < channels.size(); ++i) {
+            Query q;
+            q.channel = channels[i];
+            q.from = from;
+            q.to = to;
+            Bucket empty = {0, 0, 0, 0};
+            q.buckets.assign((buckets > 0) ? buckets : 0, empty);
+            store.read(q.channel, from, to, handle_row, &q);
+            for(size_t k = 0; k < q.buckets.size(); ++k) {
+                const Bucket& b = q.buckets[k];
+                if(b.count == 0) {
+                    continue;
+                }
+                char s[256];
+                snprintf(s, sizeof(s), "%.6f %llu %g %g %g ",
+                    (from + (double)(to - from)*k/buckets)*1e-9,
+                    (unsigned long long)b.count, b.min, b.max,
+                    b.sum/b.count);
+                std::cout << s << q.channel << "\n";
+            }
+        }
+        if(verbose) {
+            std::cerr << store.segments_read() << " segments, ";
+            std::cerr << store.blocks_read() << " blocks read\n";
+        }
+    } catch(std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,113 @@
+/*
+ * Uni-T UT61B libusb driver
+ * Copyright (C) 2014 Lukas Schwarz
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <iostream>
+#include <unistd.h>
+#include <string.h>
+#include "shm_ring.hh"
+#include "capture_file.hh"
+
+
+/**
+ * Print program usage
+ */
+void usage()
+{
+    std::cout << "Reads readings of ut61b_cli from a ring in shared memory\n";
+    std::cout << "Copyright (C) 2014 Lukas Schwarz\n";
+    std::cout << "\n";
+    std::cout << "Usage: ut61b_shm [OPTION] <name>\n";
+    std::cout << "Options:\n";
+    std::cout << "-h            show help\n";
+    std::cout << "-a            print all readings in the ring instead of\n";
+    std::cout << "              the latest reading\n";
+    std::cout << "-f            follow the ring and print new readings\n";
+}
+
+
+/**
+ * Print reading as log line followed by the device
+ */
+void print(const Shm_Record& r)
+{
+    capture_text_line(std::cout, r.time*1e-9,
+        FS9922_DMM3(r.frame).reading());
+    std::cout << " " << std::string(r.device,
+        strnlen(r.device, sizeof(r.device))) << "\n";
+}
+
+
+int main(int argc, char* argv[])
+{
+    // parse command line arguments
+    bool history = false;
+    bool follow = false;
+    int c;
+    opterr = 0;
+    while((c = getopt(argc, argv, "haf")) != -1) {
+        switch(c) {
+            case 'h':
+                usage();
+                return 0;
+            case 'a':
+                history = true;
+                break;
+            case 'f':
+                follow = true;
+                break;
+            default:
+                std::cerr << "Invalid option '" << (char)optopt << "'\n";
+                std::cerr << "Type ut61b_shm -h for help\n";
+                return 1;
+        }
+    }
+    if(optind != argc-1) {
+        std::cerr << "Missing name of the shared memory\n";
+        std::cerr << "Type ut61b_shm -h for help\n";
+        return 1;
+    }
+    
+    try {
+        Shm_Ring_Reader reader(argv[optind]);
+        Shm_Record r;
+        if(history) {
+            reader.rewind();
+            while(reader.next(r)) {
+                print(r);
+            }
+        }
+        else if(reader.latest(r)) {
+            print(r);
+        }
+        while(follow) {
+            if(reader.next(r)) {
+                print(r);
+                continue;
+            }
+            std::cout.flush();
+            usleep(10000);
+        }
+        if(reader.lost() > 0) {
+            std::cerr << reader.lost() << " readings overwritten before "
+                "they were read\n";
+        }
+    } catch(std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -16,17 +16,69 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <unistd.h>
 #include "wch_ch9325.hh"
 
 int WCH_CH9325::cnt = 0;
 libusb_context* WCH_CH9325::ctx = 0;
+std::mutex WCH_CH9325::ctx_mutex;
+void (*WCH_CH9325::hotplug_callback)(const std::string&, bool, void*) = 0;
+void* WCH_CH9325::hotplug_arg = 0;
+libusb_hotplug_callback_handle WCH_CH9325::hotplug_handle;
 
 
 /**
- * Open device
+ * Open next available device
  */
-WCH_CH9325::WCH_CH9325() : devh(0), do_listen(false)
+WCH_CH9325::WCH_CH9325() : devh(0), do_listen(false), transfers(4),
+    pending(0), failures(0), halted(false)
 {
+    memset(m_errors, 0, sizeof(m_errors));
+    init();
+    std::vector<std::string> paths = list();
+    for(size_t i = 0; i < paths.size(); ++i) {
+        if(open(paths[i])) {
+            break;
+        }
+    }
+    if(devh == 0) {
+        uninit();
+        throw std::runtime_error("No device found");
+    }
+}
+
+
+/**
+ * Open device at given path
+ */
+WCH_CH9325::WCH_CH9325(const std::string& path) : devh(0), do_listen(false),
+    transfers(4), pending(0), failures(0), halted(false)
+{
+    memset(m_errors, 0, sizeof(m_errors));
+    init();
+    if(!open(path)) {
+        uninit();
+        throw std::runtime_error("Opening device " + path + " failed");
+    }
+}
+
+
+/**
+ * Close device
+ */
+WCH_CH9325::~WCH_CH9325()
+{
+    close();
+    uninit();
+}
+
+
+/**
+ * Return paths of all connected adapters
+ */
+std::vector<std::string> WCH_CH9325::list()
+{
+    std::vector<std::string> paths;
     init();
     
     // loop through all usb devices
@@ -42,65 +94,113 @@ WCH_CH9325::WCH_CH9325() : devh(0), do_listen(false)
         
         // check for correct vendor and product id
         if(desc.idVendor == 6790 && desc.idProduct == 57352) {
-            
-            // try opening device
-            r = libusb_open(devs[i], &devh);
-            if(r != 0) {
-                std::cerr << "Opening device failed: " << r << "\n";
-                continue;
-            }
-            if(libusb_kernel_driver_active(devh, 0) == 1) {
-                if(libusb_detach_kernel_driver(devh, 0) != 0) {
-                    std::cerr << "Detaching kernel driver failed" << "\n";
-                    libusb_close(devh);
-                    devh = 0;
-                    continue;
-                }
-            }
-            r = libusb_claim_interface(devh, 0);
-            if(r != 0) {
-                std::cerr << "Claiming interface failed: " << r << "\n";
+            paths.push_back(device_path(devs[i]));
+        }
+    }
+    if(dev_cnt >= 0) {
+        libusb_free_device_list(devs, 1);
+    }
+    uninit();
+    return paths;
+}
+
+
+/**
+ * Return bus/port path of a device in the format "bus-port.port..."
+ */
+std::string WCH_CH9325::device_path(libusb_device* device)
+{
+    uint8_t ports[8];
+    int n = libusb_get_port_numbers(device, ports, sizeof(ports));
+    std::stringstream ss;
+    ss << (int)libusb_get_bus_number(device);
+    for(int i = 0; i < n; ++i) {
+        ss << ((i == 0) ? "-" : ".") << (int)ports[i];
+    }
+    return ss.str();
+}
+
+
+/**
+ * Open and claim device
+ */
+bool WCH_CH9325::open(const std::string& path)
+{
+    libusb_device** devs;
+    ssize_t dev_cnt = libusb_get_device_list(WCH_CH9325::ctx, &devs);
+    for(ssize_t i = 0; i < dev_cnt; i++) {
+        libusb_device_descriptor desc;
+        int r = libusb_get_device_descriptor(devs[i], &desc);
+        if (r != 0) {
+            continue;
+        }
+        if(desc.idVendor != 6790 || desc.idProduct != 57352
+            || device_path(devs[i]) != path) {
+            continue;
+        }
+        
+        // try opening device
+        r = libusb_open(devs[i], &devh);
+        if(r != 0) {
+            std::cerr << "Opening device failed: " << r << "\n";
+            devh = 0;
+            break;
+        }
+        if(libusb_kernel_driver_active(devh, 0) == 1) {
+            if(libusb_detach_kernel_driver(devh, 0) != 0) {
+                std::cerr << "Detaching kernel driver failed" << "\n";
                 libusb_close(devh);
                 devh = 0;
-                continue;
+                break;
             }
+        }
+        r = libusb_claim_interface(devh, 0);
+        if(r != 0) {
+            std::cerr << "Claiming interface failed: " << r << "\n";
+            libusb_close(devh);
+            devh = 0;
             break;
         }
+        id = path;
+        init_errors();
+        break;
     }
-    libusb_free_device_list(devs, 1);
-    
-    if(devh == 0) {
-        throw std::runtime_error("No device found");
+    if(dev_cnt >= 0) {
+        libusb_free_device_list(devs, 1);
     }
-    WCH_CH9325::cnt++;
+    return (devh != 0);
 }
 
 
 /**
- * Close device
+ * Listen for data packages
  */
-WCH_CH9325::~WCH_CH9325()
+void WCH_CH9325::listen()
 {
-    if(devh != 0) {
-        libusb_release_interface(devh, 0);
-        libusb_close(devh);
-        WCH_CH9325::cnt--;
+    if(transfers == 0) {
+        set_report();
+        restart();
+        do_listen = true;
+        failures = 0;
+        listen_sync();
+        return;
     }
-    uninit();
+    
+    // handle completed transfers until stopped or no transfer is left
+    start();
+    while(do_listen && pending > 0) {
+        handle_events(100);
+    }
+    finish();
 }
 
 
 /**
- * Listen for data packages
+ * Send SET_REPORT request
  */
-void WCH_CH9325::listen()
+void WCH_CH9325::set_report()
 {
-    int transferred = 0;
-    int pos = 0;
-    unsigned char* data = new unsigned char[8];
-    char* frame = new char[14];
-    
-    // send SET_REPORT request:
+    unsigned char data[5];
     
     // bytes 0 and 1 set baudrate = 2400
     data[0] = 0x60;
@@ -123,17 +223,26 @@ void WCH_CH9325::listen()
     );
     
     if(r < 0) {
+        count_error(USB_CONTROL, r);
         std::stringstream ss;
         ss << "Sending SET_REPORT request failed: " << r;
         throw std::runtime_error(ss.str());
     }
+}
+
+
+/**
+ * Listen with blocking interrupt transfers
+ */
+void WCH_CH9325::listen_sync()
+{
+    int transferred = 0;
+    unsigned char data[8];
     
-    // retrieve data frames:
-    do_listen = true;
     while(do_listen) {
         
         // wait for interrupt
-        r = libusb_interrupt_transfer(devh,
+        int r = libusb_interrupt_transfer(devh,
             (2|LIBUSB_ENDPOINT_IN), // endpoint
             data,                   // data buffer
             8,                      // size of data buffer
@@ -141,46 +250,323 @@ void WCH_CH9325::listen()
             100                     // timeout in ms
         );
         
-        // continue on timeout
+        // continue on timeout, the device has no data
         if(r == LIBUSB_ERROR_TIMEOUT) {
             continue;
         }
         
-        // continue on errors
+        // stop on lost device instead of retrying without delay
+        if(r == LIBUSB_ERROR_NO_DEVICE || r == LIBUSB_ERROR_IO) {
+            count_error(USB_INTERRUPT, r);
+            do_listen = false;
+            throw std::runtime_error("Device lost");
+        }
+        
+        // retry other errors after a delay, but not indefinitely
         if(r < 0) {
-            std::cerr << "Interrupt transfer failed: " << r << "\n";
+            count_error(USB_INTERRUPT, r);
+            if(failures++ == 0) {
+                std::cerr << "Interrupt transfer failed: " << r << "\n";
+            }
+            if(failures >= USB_MAX_FAILURES) {
+                do_listen = false;
+                throw std::runtime_error("Device lost");
+            }
+            if(r == LIBUSB_ERROR_PIPE) {
+                libusb_clear_halt(devh, (2|LIBUSB_ENDPOINT_IN));
+            }
+            usleep(100000);
             continue;
         }
         
         // continue on invalid data length
         if(transferred != 8) {
+            count_error(USB_INTERRUPT, USB_SHORT_TRANSFER);
             std::cerr << "Too less data transferred" << "\n";
             continue;
         }
-        
-        // frame contains data --> buffer data
-        if(data[0] == 0xf1) {
-            frame[pos] = data[1];
-            pos++;
+        failures = 0;
+        handle_report(data, now());
+    }
+}
+
+
+/**
+ * Submit queued asynchronous interrupt transfers
+ */
+void WCH_CH9325::start()
+{
+    if(halted) {
+        libusb_clear_halt(devh, (2|LIBUSB_ENDPOINT_IN));
+        halted = false;
+    }
+    set_report();
+    restart();
+    do_listen = true;
+    failures = 0;
+    
+    // one 8 byte data buffer per transfer
+    int n = (transfers > 0) ? transfers : 1;
+    buffers.assign(8*n, 0);
+    queue.assign(n, (libusb_transfer*)0);
+    
+    // fill queue with transfers, which are resubmitted on completion
+    pending = 0;
+    for(int i = 0; i < n; ++i) {
+        queue[i] = libusb_alloc_transfer(0);
+        if(queue[i] == 0) {
+            std::cerr << "Allocating transfer failed" << "\n";
+            break;
         }
-        
-        // data buffer is full
-        if(pos == 14) {
-            
-            // check for valid frame
-            if(frame[12] == 0x0d && frame[13] == 0x0a) {
-                callback(frame, callback_arg);
-                pos = 0;
+        libusb_fill_interrupt_transfer(queue[i], devh,
+            (2|LIBUSB_ENDPOINT_IN), // endpoint
+            &buffers[8*i],          // data buffer
+            8,                      // size of data buffer
+            transfer_done,          // completion handler
+            this,                   // argument of completion handler
+            0                       // no timeout
+        );
+        int r = libusb_submit_transfer(queue[i]);
+        if(r != 0) {
+            count_error(USB_SUBMIT, r);
+            std::cerr << "Submitting transfer failed: " << r << "\n";
+            break;
+        }
+        pending++;
+    }
+}
+
+
+/**
+ * Cancel submitted transfers and wait for their completion
+ */
+void WCH_CH9325::finish()
+{
+    do_listen = false;
+    for(size_t i = 0; i < queue.size(); ++i) {
+        if(queue[i] != 0) {
+            libusb_cancel_transfer(queue[i]);
+        }
+    }
+    while(pending > 0) {
+        handle_events(100);
+    }
+    for(size_t i = 0; i < queue.size(); ++i) {
+        if(queue[i] != 0) {
+            libusb_free_transfer(queue[i]);
+        }
+    }
+    queue.clear();
+}
+
+
+/**
+ * Return whether asynchronous transfers are submitted
+ */
+bool WCH_CH9325::active() const
+{
+    return (pending > 0);
+}
+
+
+/**
+ * Release and close device
+ */
+void WCH_CH9325::close()
+{
+    if(devh != 0) {
+        libusb_release_interface(devh, 0);
+        libusb_close(devh);
+        devh = 0;
+    }
+}
+
+
+/**
+ * Reopen device
+ */
+bool WCH_CH9325::reopen()
+{
+    return (devh != 0) || open(id);
+}
+
+
+/**
+ * Return whether hotplug events are supported
+ */
+bool WCH_CH9325::hotplug() const
+{
+    return true;
+}
+
+
+/**
+ * Append file descriptors of libusb
+ */
+void WCH_CH9325::pollfds(std::vector<pollfd>& fds)
+{
+    if(WCH_CH9325::ctx == 0) {
+        return;
+    }
+    const libusb_pollfd** p = libusb_get_pollfds(WCH_CH9325::ctx);
+    for(int i = 0; p != 0 && p[i] != 0; ++i) {
+        pollfd f;
+        f.fd = p[i]->fd;
+        f.events = p[i]->events;
+        f.revents = 0;
+        fds.push_back(f);
+    }
+    libusb_free_pollfds(p);
+}
+
+
+/**
+ * Return time until libusb has to handle internal timeouts
+ */
+int WCH_CH9325::next_timeout(int timeout)
+{
+    timeval tv;
+    if(WCH_CH9325::ctx == 0
+        || libusb_get_next_timeout(WCH_CH9325::ctx, &tv) != 1) {
+        return timeout;
+    }
+    int t = tv.tv_sec*1000 + (tv.tv_usec+999)/1000;
+    return (timeout >= 0 && timeout < t) ? timeout : t;
+}
+
+
+/**
+ * Handle pending events of all devices
+ */
+void WCH_CH9325::handle_events(int timeout)
+{
+    if(WCH_CH9325::ctx == 0) {
+        return;
+    }
+    timeval tv;
+    tv.tv_sec = timeout/1000;
+    tv.tv_usec = (timeout%1000)*1000;
+    libusb_handle_events_timeout_completed(WCH_CH9325::ctx, &tv, 0);
+}
+
+
+/**
+ * Set hotplug callback function
+ */
+bool WCH_CH9325::set_hotplug_callback(
+    void (*callback)(const std::string&, bool, void*), void* arg)
+{
+    if(!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
+        return false;
+    }
+    
+    // remove previous registration
+    if(hotplug_callback != 0) {
+        libusb_hotplug_deregister_callback(WCH_CH9325::ctx, hotplug_handle);
+        hotplug_callback = 0;
+        uninit();
+    }
+    if(callback == 0) {
+        return true;
+    }
+    
+    // keep libusb context alive while registered
+    init();
+    hotplug_callback = callback;
+    hotplug_arg = arg;
+    int r = libusb_hotplug_register_callback(WCH_CH9325::ctx,
+        (libusb_hotplug_event)(LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED
+            | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT),
+        LIBUSB_HOTPLUG_NO_FLAGS, 6790, 57352, LIBUSB_HOTPLUG_MATCH_ANY,
+        hotplug_event, 0, &hotplug_handle);
+    if(r != 0) {
+        std::cerr << "Registering hotplug callback failed: " << r << "\n";
+        hotplug_callback = 0;
+        uninit();
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Handle hotplug event
+ */
+int LIBUSB_CALL WCH_CH9325::hotplug_event(libusb_context*,
+    libusb_device* device, libusb_hotplug_event event, void*)
+{
+    if(hotplug_callback != 0) {
+        hotplug_callback(device_path(device),
+            (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED), hotplug_arg);
+    }
+    return 0;
+}
+
+
+/**
+ * Handle completed asynchronous transfer
+ */
+void LIBUSB_CALL WCH_CH9325::transfer_done(libusb_transfer* transfer)
+{
+    WCH_CH9325* dev = (WCH_CH9325*)transfer->user_data;
+    
+    switch(transfer->status) {
+        case LIBUSB_TRANSFER_COMPLETED:
+            if(transfer->actual_length == 8) {
+                dev->failures = 0;
+                dev->handle_report(transfer->buffer, now());
             }
-            // invalid or missaligned frame -> skip first byte
             else {
-                memmove(frame, frame+1, 13);
-                pos = 13;
+                dev->count_error(USB_INTERRUPT, USB_SHORT_TRANSFER);
+                std::cerr << "Too less data transferred" << "\n";
             }
-        }
+            break;
+        case LIBUSB_TRANSFER_TIMED_OUT:
+            break;
+        case LIBUSB_TRANSFER_CANCELLED:
+            dev->pending--;
+            return;
+        case LIBUSB_TRANSFER_NO_DEVICE:
+            dev->count_error(USB_INTERRUPT, LIBUSB_ERROR_NO_DEVICE);
+            std::cerr << "Interrupt transfer failed: device lost" << "\n";
+            dev->pending--;
+            return;
+        default:
+            dev->count_error(USB_INTERRUPT,
+                (transfer->status == LIBUSB_TRANSFER_STALL)
+                ? LIBUSB_ERROR_PIPE
+                : (transfer->status == LIBUSB_TRANSFER_OVERFLOW)
+                ? LIBUSB_ERROR_OVERFLOW : LIBUSB_ERROR_IO);
+            dev->halted |= (transfer->status == LIBUSB_TRANSFER_STALL);
+            
+            // report only the first of consecutive failures and give up on
+            // persistent ones, so that the device is reopened as lost
+            // instead of resubmitting the failing transfers busily
+            if(dev->failures++ == 0) {
+                std::cerr << "Interrupt transfer failed: " << transfer->status;
+                std::cerr << "\n";
+            }
+            if(dev->failures >= USB_MAX_FAILURES) {
+                if(dev->failures == USB_MAX_FAILURES) {
+                    std::cerr << "Giving up after " << dev->failures;
+                    std::cerr << " failed transfers\n";
+                }
+                dev->pending--;
+                return;
+            }
+            break;
+    }
+    
+    // resubmit transfer as long as listening
+    if(!dev->do_listen) {
+        dev->pending--;
+        return;
+    }
+    int r = libusb_submit_transfer(transfer);
+    if(r != 0) {
+        dev->count_error(USB_SUBMIT, r);
+        dev->pending--;
     }
-    delete[] data;
-    delete[] frame;
 }
 
 
@@ -190,17 +576,22 @@ void WCH_CH9325::listen()
 void WCH_CH9325::stop()
 {
     do_listen = false;
+#if defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000105)
+    // wake up a thread waiting in handle_events()
+    std::lock_guard<std::mutex> lock(ctx_mutex);
+    if(WCH_CH9325::ctx != 0) {
+        libusb_interrupt_event_handler(WCH_CH9325::ctx);
+    }
+#endif
 }
 
 
 /**
- * Set callback function
+ * Set number of queued transfers
  */
-void WCH_CH9325::set_callback(void (*callback)(const char* data, void* arg),
-    void* arg)
+void WCH_CH9325::set_transfers(int n)
 {
-    this->callback = callback;
-    this->callback_arg = arg;
+    transfers = (n < 0) ? 0 : n;
 }
 
 
@@ -209,15 +600,18 @@ void WCH_CH9325::set_callback(void (*callback)(const char* data, void* arg),
  */
 void WCH_CH9325::init()
 {
+    std::lock_guard<std::mutex> lock(WCH_CH9325::ctx_mutex);
     if(WCH_CH9325::ctx == 0) {
         int r = libusb_init(&WCH_CH9325::ctx);
         if(r != 0) {
+            WCH_CH9325::ctx = 0;
             std::stringstream ss;
             ss << "Initialisizing libusb failed: " << r;
             throw std::runtime_error(ss.str());
         }
         libusb_set_debug(WCH_CH9325::ctx, 3);
     }
+    WCH_CH9325::cnt++;
 }
 
 
@@ -226,8 +620,70 @@ void WCH_CH9325::init()
  */
 void WCH_CH9325::uninit()
 {
+    std::lock_guard<std::mutex> lock(WCH_CH9325::ctx_mutex);
+    WCH_CH9325::cnt--;
     if(WCH_CH9325::cnt == 0) {
         libusb_exit(WCH_CH9325::ctx);
         WCH_CH9325::ctx = 0;
     }
 }
+
+
+// labels of the failed operations and of the counted error codes
+static const char* USB_OPS[3] = {"control", "interrupt", "submit"};
+static const char* USB_CODES[7] = {"LIBUSB_ERROR_IO",
+    "LIBUSB_ERROR_NO_DEVICE", "LIBUSB_ERROR_PIPE", "LIBUSB_ERROR_OVERFLOW",
+    "LIBUSB_ERROR_BUSY", "SHORT_TRANSFER", "LIBUSB_ERROR_OTHER"};
+
+
+/**
+ * Register error counters
+ */
+void WCH_CH9325::init_errors()
+{
+    Metrics_Registry& reg = Metrics_Registry::instance();
+    for(int op = 0; op < 3; ++op) {
+        for(int code = 0; code < 7; ++code) {
+            m_errors[op][code] = &reg.counter("ut61b_usb_errors_total",
+                "Failed USB operations by libusb error code",
+                Metrics_Registry::label("device", id) + ","
+                + Metrics_Registry::label("op", USB_OPS[op]) + ","
+                + Metrics_Registry::label("code", USB_CODES[code]));
+        }
+    }
+}
+
+
+/**
+ * Count failed operation
+ */
+void WCH_CH9325::count_error(usb_op_t op, int code)
+{
+    int i;
+    switch(code) {
+        case LIBUSB_ERROR_IO:
+            i = 0;
+            break;
+        case LIBUSB_ERROR_NO_DEVICE:
+            i = 1;
+            break;
+        case LIBUSB_ERROR_PIPE:
+            i = 2;
+            break;
+        case LIBUSB_ERROR_OVERFLOW:
+            i = 3;
+            break;
+        case LIBUSB_ERROR_BUSY:
+            i = 4;
+            break;
+        case USB_SHORT_TRANSFER:
+            i = 5;
+            break;
+        default:
+            i = 6;
+            break;
+    }
+    if(m_errors[op][i] != 0) {
+        m_errors[op][i]->add();
+    }
+}
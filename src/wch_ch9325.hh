@@ -52,26 +52,65 @@
 #include <libusb.h>
 #include <sstream>
 #include <iostream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
 #include <string.h>
+#include <poll.h>
+#include "ch9325_adapter.hh"
 
 
 /**
- * This class represents a single serial-to-usb adapter. It is the "next"
- * available USB device.
+ * Failed USB operation
  */
-class WCH_CH9325
+enum usb_op_t
+{
+    USB_CONTROL = 0,
+    USB_INTERRUPT = 1,
+    USB_SUBMIT = 2
+};
+
+// error code of an interrupt transfer with less than 8 bytes
+const int USB_SHORT_TRANSFER = 1;
+
+// number of consecutive failed transfers, after which the device is
+// considered lost
+const int USB_MAX_FAILURES = 16;
+
+
+/**
+ * This class represents a single serial-to-usb adapter. It is either the
+ * "next" available USB device or the device at a given bus/port path.
+ */
+class WCH_CH9325 : public CH9325_Adapter
 {
     public:
+        
+        /**
+         * Open next available device
+         */
         WCH_CH9325();
+        
+        /**
+         * Open device at given bus/port path
+         * \param path device path as returned by `list()`, e.g. "1-2.4"
+         */
+        WCH_CH9325(const std::string& path);
+        
         ~WCH_CH9325();
         
         /**
-         * Set callback function, which is called for each retrieved valid
-         * 14 byte data frame of the FS9922-DMM3 serial protocol
-         * \param callback function called for each retrieved data frame
-         * \param arg additional argument passed to the callback function
+         * Return bus/port paths of all connected adapters
          */
-        void set_callback(void (*callback)(const char*, void*), void* arg=0);
+        static std::vector<std::string> list();
+        
+        /**
+         * Set number of interrupt transfers which are queued at the same
+         * time. A value of 0 selects the synchronous (blocking) transfer mode.
+         * \param n number of queued transfers
+         */
+        void set_transfers(int n);
         
         
         /**
@@ -81,37 +120,172 @@ class WCH_CH9325
         void listen();
         
         /**
-         * Stop listen
+         * Stop listen (can be called from any thread). Waiting for
+         * asynchronous transfers is interrupted immediately, a blocking
+         * transfer of the synchronous mode within its timeout of 100 ms.
          */
         void stop();
         
+        /**
+         * Send SET_REPORT request and submit the queued asynchronous
+         * transfers without blocking. The transfers are serviced by
+         * `handle_events()`.
+         */
+        void start();
+        
+        /**
+         * Cancel submitted transfers and wait for their completion
+         */
+        void finish();
+        
+        /**
+         * Return whether asynchronous transfers are submitted
+         */
+        bool active() const;
+        
+        /**
+         * Release and close lost device
+         */
+        void close();
+        
+        /**
+         * Reopen and claim device at the same bus/port path
+         */
+        bool reopen();
+        
+        /**
+         * Return true, arrival of devices is signalled by hotplug events
+         */
+        bool hotplug() const;
+        
+        /**
+         * Handle pending events of all devices
+         * \param timeout maximum time to wait for events in ms
+         */
+        static void handle_events(int timeout);
+        
+        /**
+         * Append file descriptors of libusb, which have to be polled by an
+         * external event loop before calling `handle_events(0)`
+         * \param fds list of polled file descriptors
+         */
+        static void pollfds(std::vector<pollfd>& fds);
+        
+        /**
+         * Return time until libusb has to handle internal timeouts
+         * \param timeout maximum time in ms
+         * \return time in ms, at most `timeout`
+         */
+        static int next_timeout(int timeout);
+        
+        /**
+         * Set hotplug callback function, which is called whenever an adapter
+         * is connected or disconnected. The callback must not open the
+         * device itself, but defer this to the event loop.
+         * \param callback function called with the bus/port path of the
+         *                 adapter and whether it arrived (true) or left
+         *                 (false); 0 removes the callback
+         * \param arg additional argument passed to the callback function
+         * \return whether hotplug events are supported
+         */
+        static bool set_hotplug_callback(
+            void (*callback)(const std::string&, bool, void*), void* arg=0);
+        
     private:
         
         /**
-         * Initialisize libusb
+         * Initialisize libusb and acquire a reference to the global context
          */
         static void init();
         
         /**
-         * Uninitialisize libusb
+         * Release reference to the global context and uninitialisize libusb
+         * if it is not used anymore
          */
         static void uninit();
         
-        // global device counter
+        /**
+         * Return bus/port path of a device
+         */
+        static std::string device_path(libusb_device* device);
+        
+        /**
+         * Open and claim device at given bus/port path
+         * \return whether device was opened
+         */
+        bool open(const std::string& path);
+        
+        /**
+         * Send SET_REPORT request to set the baudrate
+         */
+        void set_report();
+        
+        /**
+         * Retrieve data with blocking interrupt transfers
+         */
+        void listen_sync();
+        
+        /**
+         * Completion handler of asynchronous interrupt transfers
+         */
+        static void LIBUSB_CALL transfer_done(libusb_transfer* transfer);
+        
+        /**
+         * Handler of libusb hotplug events
+         */
+        static int LIBUSB_CALL hotplug_event(libusb_context* ctx,
+            libusb_device* device, libusb_hotplug_event event, void* arg);
+        
+        /**
+         * Register the error counters of the device, so that errors are
+         * counted without looking up the metrics registry
+         */
+        void init_errors();
+        
+        /**
+         * Count failed operation
+         * \param op failed operation
+         * \param code libusb error code or USB_SHORT_TRANSFER
+         */
+        void count_error(usb_op_t op, int code);
+        
+        // global reference counter of the libusb context
         static int cnt;
         
         // global libusb context
         static libusb_context* ctx;
         
+        // guards `cnt` and `ctx`
+        static std::mutex ctx_mutex;
+        
+        // hotplug callback, optional argument and handle of registration
+        static void (*hotplug_callback)(const std::string&, bool, void*);
+        static void* hotplug_arg;
+        static libusb_hotplug_callback_handle hotplug_handle;
+        
         // device handle
         libusb_device_handle* devh;
         
-        // callback and optional argument
-        void (*callback)(const char*, void*);
-        void* callback_arg;
+        // counters of failed operations by operation and error code
+        Metric_Counter* m_errors[3][7];
+        
+        // flag whether in listen mode, cleared by `stop()` from any thread
+        std::atomic<bool> do_listen;
+        
+        // number of queued transfers (0 = synchronous mode)
+        int transfers;
+        
+        // number of currently submitted transfers
+        int pending;
+        
+        // number of consecutive failed transfers and flag whether the
+        // endpoint stalled and has to be cleared before restarting
+        int failures;
+        bool halted;
         
-        // flag whether in listen mode
-        bool do_listen;
+        // queued transfers and their data buffers
+        std::vector<libusb_transfer*> queue;
+        std::vector<unsigned char> buffers;
         
 };
 #endif